@@ -585,9 +585,23 @@ int mp_aframe_approx_byte_size(struct mp_aframe *frame)
     return plane_size * planes + sizeof(*frame);
 }
 
+#if LIBAVUTIL_VERSION_MAJOR < 57
+typedef int buffer_size_t;
+#else
+typedef size_t buffer_size_t;
+#endif
+
+// Buffers are allocated in power of 2 size classes, starting with this size.
+#define POOL_MIN_SHIFT 12
+#define POOL_NUM_CLASSES (31 - POOL_MIN_SHIFT)
+
 struct mp_aframe_pool {
-    AVBufferPool *avpool;
-    int element_size;
+    // One pool per size class, created on demand. Since requests of different
+    // sizes are served by different pools, varying frame sizes (variable size
+    // decoder output, speed changes in af_scaletempo, multiple filters sharing
+    // the pool) don't free and reallocate buffers.
+    AVBufferPool *avpools[POOL_NUM_CLASSES];
+    struct mp_aframe_pool_stats stats;
 };
 
 struct mp_aframe_pool *mp_aframe_pool_create(void *ta_parent)
@@ -598,7 +612,21 @@ struct mp_aframe_pool *mp_aframe_pool_create(void *ta_parent)
 static void mp_aframe_pool_destructor(void *p)
 {
     struct mp_aframe_pool *pool = p;
-    av_buffer_pool_uninit(&pool->avpool);
+    for (int n = 0; n < POOL_NUM_CLASSES; n++)
+        av_buffer_pool_uninit(&pool->avpools[n]);
+}
+
+// Called by AVBufferPool if it has no free buffer, and only within
+// av_buffer_pool_get() (i.e. from the thread using the mp_aframe_pool).
+static AVBufferRef *pool_alloc(void *opaque, buffer_size_t size)
+{
+    struct mp_aframe_pool *pool = opaque;
+    AVBufferRef *ref = av_buffer_alloc(size);
+    if (ref) {
+        pool->stats.num_new++;
+        pool->stats.new_bytes += size;
+    }
+    return ref;
 }
 
 // Like mp_aframe_allocate(), but use the pool to allocate data.
@@ -617,14 +645,17 @@ int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame
     if (size <= 0 || mp_aframe_is_allocated(frame))
         return -1;
 
-    if (!pool->avpool || size > pool->element_size) {
-        size_t alloc = ta_calc_prealloc_elems(size);
-        if (alloc >= INT_MAX)
-            return -1;
-        av_buffer_pool_uninit(&pool->avpool);
-        pool->element_size = alloc;
-        pool->avpool = av_buffer_pool_init(pool->element_size, NULL);
-        if (!pool->avpool)
+    int size_class = 0;
+    if (size > (1 << POOL_MIN_SHIFT))
+        size_class = mp_log2(size - 1) + 1 - POOL_MIN_SHIFT;
+    if (size_class >= POOL_NUM_CLASSES)
+        return -1;
+
+    AVBufferPool **avpool = &pool->avpools[size_class];
+    if (!*avpool) {
+        *avpool = av_buffer_pool_init2(1 << (size_class + POOL_MIN_SHIFT),
+                                       pool, pool_alloc, NULL);
+        if (!*avpool)
             return -1;
         talloc_set_destructor(pool, mp_aframe_pool_destructor);
     }
@@ -635,13 +666,19 @@ int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame
     AVFrame *av_frame = frame->av_frame;
     if (av_frame->extended_data != av_frame->data)
         av_freep(&av_frame->extended_data); // sigh
-    av_frame->extended_data =
-        av_mallocz_array(planes, sizeof(av_frame->extended_data[0]));
-    if (!av_frame->extended_data)
-        abort();
-    av_frame->buf[0] = av_buffer_pool_get(pool->avpool);
+    if (planes > AV_NUM_DATA_POINTERS) {
+        av_frame->extended_data =
+            av_mallocz_array(planes, sizeof(av_frame->extended_data[0]));
+        if (!av_frame->extended_data)
+            abort();
+    } else {
+        // Like FFmpeg does; avoids a heap allocation per frame.
+        av_frame->extended_data = av_frame->data;
+    }
+    av_frame->buf[0] = av_buffer_pool_get(*avpool);
     if (!av_frame->buf[0])
         return -1;
+    pool->stats.num_allocs++;
     av_frame->linesize[0] = samples * sstride;
     for (int n = 0; n < planes; n++)
         av_frame->extended_data[n] = av_frame->buf[0]->data + n * plane_size;
@@ -651,3 +688,11 @@ int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame
 
     return 0;
 }
+
+// Return the number of allocations done so far, and how many of them needed
+// a new buffer (instead of reusing one that was returned to the pool).
+void mp_aframe_pool_get_stats(struct mp_aframe_pool *pool,
+                              struct mp_aframe_pool_stats *stats)
+{
+    *stats = pool->stats;
+}
@@ -68,7 +68,17 @@ bool mp_aframe_copy_samples(struct mp_aframe *dst, int dst_offset,
                             int samples);
 bool mp_aframe_set_silence(struct mp_aframe *f, int offset, int samples);
 
+struct mp_aframe_pool_stats {
+    int64_t num_allocs;     // successful mp_aframe_pool_allocate() calls
+    int64_t num_new;        // buffers newly allocated from the heap
+    int64_t new_bytes;      // total size of newly allocated buffers
+};
+
+// Pool for audio sample buffers. Only the data is pooled; the mp_aframe itself
+// (and its AVFrame) is still allocated by the caller.
 struct mp_aframe_pool;
 struct mp_aframe_pool *mp_aframe_pool_create(void *ta_parent);
 int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame,
                             int samples);
+void mp_aframe_pool_get_stats(struct mp_aframe_pool *pool,
+                              struct mp_aframe_pool_stats *stats);
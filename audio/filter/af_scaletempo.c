@@ -31,11 +31,15 @@
  */
 
 #include <float.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
 
+#include <libavcodec/avfft.h>
+#include <libavutil/mem.h>
+
 #include "audio/aframe.h"
 #include "audio/format.h"
 #include "common/common.h"
@@ -49,6 +53,7 @@ struct f_opts {
     float ms_stride;
     float ms_search;
     float percent_overlap;
+    int use_fft;
 #define SCALE_TEMPO 1
 #define SCALE_PITCH 2
     int speed_opt;
@@ -90,6 +95,10 @@ struct priv {
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct priv *s);
+    // FFT based best overlap search (float only)
+    int fft_size;
+    RDFTContext *fft_forward, *fft_inverse;
+    float *fft_corr, *fft_queue;
 };
 
 static bool reinit(struct mp_filter *f);
@@ -166,6 +175,100 @@ static int best_overlap_offset_float(struct priv *s)
     return best_off * 4 * s->num_channels;
 }
 
+// Same as best_overlap_offset_float(), but compute the correlation for all
+// offsets at once, as (pre_corr (*) queue) = IFFT(FFT(queue) * conj(FFT(pre_corr))).
+// This does not depend on the sign convention or scaling of the FFT, as long
+// as the inverse transform is consistent with the forward one.
+static int best_overlap_offset_fft(struct priv *s)
+{
+    int nch = s->num_channels;
+    int len_corr = s->samples_overlap - nch;
+    int len_queue = (s->frames_search - 1) * nch + len_corr;
+
+    float *pw = s->table_window;
+    float *po = (float *)s->buf_overlap + nch;
+    float *pc = s->fft_corr;
+    for (int i = 0; i < len_corr; i++)
+        pc[i] = pw[i] * po[i];
+    memset(pc + len_corr, 0, (s->fft_size - len_corr) * sizeof(float));
+    av_rdft_calc(s->fft_forward, pc);
+
+    float *pq = s->fft_queue;
+    memcpy(pq, (float *)s->buf_queue + nch, len_queue * sizeof(float));
+    memset(pq + len_queue, 0, (s->fft_size - len_queue) * sizeof(float));
+    av_rdft_calc(s->fft_forward, pq);
+
+    // Packed format: DC and Nyquist bins are real and stored in [0] and [1].
+    pq[0] *= pc[0];
+    pq[1] *= pc[1];
+    for (int i = 2; i < s->fft_size; i += 2) {
+        float qr = pq[i], qi = pq[i + 1];
+        pq[i]     = qr * pc[i] + qi * pc[i + 1];
+        pq[i + 1] = qi * pc[i] - qr * pc[i + 1];
+    }
+    av_rdft_calc(s->fft_inverse, pq);
+
+    float best_corr = -INFINITY;
+    int best_off = 0;
+    for (int off = 0; off < s->frames_search; off++) {
+        float corr = pq[off * nch];
+        if (corr > best_corr) {
+            best_corr = corr;
+            best_off  = off;
+        }
+    }
+
+    return best_off * 4 * nch;
+}
+
+static void free_fft(struct priv *s)
+{
+    av_rdft_end(s->fft_forward);
+    av_rdft_end(s->fft_inverse);
+    s->fft_forward = s->fft_inverse = NULL;
+    av_freep(&s->fft_corr);
+    av_freep(&s->fft_queue);
+    s->fft_size = 0;
+}
+
+// Set up best_overlap_offset_fft() if it's cheaper than the direct search.
+static bool init_fft(struct mp_filter *f)
+{
+    struct priv *s = f->priv;
+    int nch = s->num_channels;
+    int len_corr = s->samples_overlap - nch;
+    int len_queue = (s->frames_search - 1) * nch + len_corr;
+
+    int bits = 4;
+    while ((1 << bits) < len_queue)
+        bits++;
+    if (bits > 16)
+        return false;
+
+    // Rough operation counts: 2 forward and 1 inverse real FFT, versus
+    // a multiply-add per overlap sample and search offset.
+    double cost_fft = 3.0 * (1 << bits) * bits;
+    double cost_direct = (double)s->frames_search * len_corr;
+    if (s->opts->use_fft == 0 || (s->opts->use_fft < 0 && cost_fft >= cost_direct))
+        return false;
+
+    if (s->fft_size != 1 << bits) {
+        free_fft(s);
+        s->fft_size = 1 << bits;
+        s->fft_forward = av_rdft_init(bits, DFT_R2C);
+        s->fft_inverse = av_rdft_init(bits, IDFT_C2R);
+        s->fft_corr = av_malloc(s->fft_size * sizeof(float));
+        s->fft_queue = av_malloc(s->fft_size * sizeof(float));
+        if (!s->fft_forward || !s->fft_inverse || !s->fft_corr || !s->fft_queue) {
+            free_fft(s);
+            return false;
+        }
+    }
+
+    MP_VERBOSE(f, "using FFT search (size %d)\n", s->fft_size);
+    return true;
+}
+
 static int best_overlap_offset_s16(struct priv *s)
 {
     int64_t best_corr = INT64_MIN;
@@ -484,6 +587,9 @@ static bool reinit(struct mp_filter *f)
     s->bytes_per_frame = bps * nch;
     s->num_channels    = nch;
 
+    if (s->best_overlap_offset == best_overlap_offset_float && init_fft(f))
+        s->best_overlap_offset = best_overlap_offset_fft;
+
     s->bytes_queue = (s->frames_search + s->frames_stride + frames_overlap)
                         * bps * nch;
     s->buf_queue = realloc(s->buf_queue, s->bytes_queue + UNROLL_PADDING);
@@ -551,6 +657,7 @@ static void destroy(struct mp_filter *f)
     free(s->buf_pre_corr);
     free(s->table_blend);
     free(s->table_window);
+    free_fft(s);
     TA_FREEP(&s->in);
     mp_filter_free_children(f);
 }
@@ -580,7 +687,7 @@ static struct mp_filter *af_scaletempo_create(struct mp_filter *parent,
     s->opts = talloc_steal(s, options);
     s->speed = 1.0;
     s->cur_format = talloc_steal(s, mp_aframe_create());
-    s->out_pool = mp_aframe_pool_create(s);
+    s->out_pool = mp_filter_get_aframe_pool(f);
 
     struct mp_autoconvert *conv = mp_autoconvert_create(f);
     if (!conv)
@@ -608,12 +715,14 @@ const struct mp_user_filter_entry af_scaletempo = {
             .ms_search = 14,
             .speed_opt = SCALE_TEMPO,
             .scale_nominal = 1.0,
+            .use_fft = -1,
         },
         .options = (const struct m_option[]) {
             {"scale", OPT_FLOAT(scale_nominal), M_RANGE(0.01, DBL_MAX)},
             {"stride", OPT_FLOAT(ms_stride), M_RANGE(0.01, DBL_MAX)},
             {"overlap", OPT_FLOAT(percent_overlap), M_RANGE(0, 1)},
             {"search", OPT_FLOAT(ms_search), M_RANGE(0, DBL_MAX)},
+            {"fft", OPT_CHOICE(use_fft, {"auto", -1}, {"no", 0}, {"yes", 1})},
             {"speed", OPT_CHOICE(speed_opt,
                 {"pitch", SCALE_PITCH},
                 {"tempo", SCALE_TEMPO},
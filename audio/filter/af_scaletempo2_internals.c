@@ -61,6 +61,33 @@ static void zero_2d_partial(float **a, int x, int y)
     }
 }
 
+// Dot product of two float arrays. This is the innermost loop of the search,
+// and takes most of the time. The independent partial sums allow the compiler
+// to vectorize it without -ffast-math (which would permit reassociation).
+static float single_channel_dot_product(const float *restrict a,
+                                        const float *restrict b, int num_frames)
+{
+    float sum[8] = {0};
+    int n = 0;
+    for (; n + 8 <= num_frames; n += 8) {
+        for (int i = 0; i < 8; i++)
+            sum[i] += a[n + i] * b[n + i];
+    }
+    for (; n < num_frames; n++)
+        sum[0] += a[n] * b[n];
+    return ((sum[0] + sum[1]) + (sum[2] + sum[3])) +
+           ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+}
+
+// dst[n] = dst[n] * dst_window[n] + src[n] * src_window[n]
+static void mix_windowed(float *restrict dst, const float *restrict dst_window,
+                         const float *restrict src,
+                         const float *restrict src_window, int num_frames)
+{
+    for (int n = 0; n < num_frames; n++)
+        dst[n] = dst[n] * dst_window[n] + src[n] * src_window[n];
+}
+
 // Energies of sliding windows of channels are interleaved.
 // The number windows is |input_frames| - (|frames_per_window| - 1), hence,
 // the method assumes |energy| must be, at least, of size
@@ -72,20 +99,19 @@ static void multi_channel_moving_block_energies(
     int num_blocks = input_frames - (frames_per_block - 1);
 
     for (int k = 0; k < channels; ++k) {
-        const float* input_channel = input[k];
-
-        energy[k] = 0;
+        const float *restrict input_channel = input[k];
+        float *restrict energy_channel = energy + k;
 
         // First block of channel |k|.
-        for (int m = 0; m < frames_per_block; ++m) {
-            energy[k] += input_channel[m] * input_channel[m];
-        }
+        float e = single_channel_dot_product(input_channel, input_channel,
+                                             frames_per_block);
+        energy_channel[0] = e;
 
-        const float* slide_out = input_channel;
-        const float* slide_in = input_channel + frames_per_block;
+        const float *slide_out = input_channel;
+        const float *slide_in = input_channel + frames_per_block;
         for (int n = 1; n < num_blocks; ++n, ++slide_in, ++slide_out) {
-            energy[k + n * channels] = energy[k + (n - 1) * channels]
-                - *slide_out * *slide_out + *slide_in * *slide_in;
+            e = e - *slide_out * *slide_out + *slide_in * *slide_in;
+            energy_channel[n * channels] = e;
         }
     }
 }
@@ -116,13 +142,10 @@ static void multi_channel_dot_product(
     assert(frame_offset_a >= 0);
     assert(frame_offset_b >= 0);
 
-    memset(dot_product, 0, sizeof(*dot_product) * channels);
     for (int k = 0; k < channels; ++k) {
-        const float* ch_a = a[k] + frame_offset_a;
-        const float* ch_b = b[k] + frame_offset_b;
-        for (int n = 0; n < num_frames; ++n) {
-            dot_product[k] += *ch_a++ * *ch_b++;
-        }
+        dot_product[k] = single_channel_dot_product(a[k] + frame_offset_a,
+                                                    b[k] + frame_offset_b,
+                                                    num_frames);
     }
 }
 
@@ -417,7 +440,7 @@ int mp_scaletempo2_fill_input_buffer(struct mp_scaletempo2 *p,
         memcpy(p->input_buffer[i] + p->input_buffer_frames,
             planes[i], read * sizeof(float));
         for (int j = read; j < total_fill; ++j) {
-            p->input_buffer[p->input_buffer_frames + j] = 0;
+            p->input_buffer[i][p->input_buffer_frames + j] = 0;
         }
     }
 
@@ -501,12 +524,10 @@ static void get_optimal_block(struct mp_scaletempo2 *p)
         // where target-block has higher weight close to zero (weight of 1 at index
         // 0) and lower weight close the end.
         for (int k = 0; k < p->channels; ++k) {
-            float* ch_opt = p->optimal_block[k];
-            float* ch_target = p->target_block[k];
-            for (int n = 0; n < p->ola_window_size; ++n) {
-                ch_opt[n] = ch_opt[n] * p->transition_window[n]
-                    + ch_target[n] * p->transition_window[p->ola_window_size + n];
-            }
+            mix_windowed(p->optimal_block[k], p->transition_window,
+                         p->target_block[k],
+                         p->transition_window + p->ola_window_size,
+                         p->ola_window_size);
         }
     }
 
@@ -553,10 +574,8 @@ static bool run_one_wsola_iteration(struct mp_scaletempo2 *p, float playback_rat
     for (int k = 0; k < p->channels; ++k) {
         float* ch_opt_frame = p->optimal_block[k];
         float* ch_output = p->wsola_output[k] + p->num_complete_frames;
-        for (int n = 0; n < p->ola_hop_size; ++n) {
-            ch_output[n] = ch_output[n] * p->ola_window[p->ola_hop_size + n] +
-                ch_opt_frame[n] * p->ola_window[n];
-        }
+        mix_windowed(ch_output, p->ola_window + p->ola_hop_size,
+                     ch_opt_frame, p->ola_window, p->ola_hop_size);
 
         // Copy the second half to the output.
         memcpy(&ch_output[p->ola_hop_size], &ch_opt_frame[p->ola_hop_size],
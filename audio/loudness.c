@@ -0,0 +1,275 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+
+#include "chmap.h"
+#include "loudness.h"
+
+// Gating blocks are 400 ms long and overlap by 75%, so they're made of 4
+// sub-blocks of 100 ms.
+#define SUB_BLOCKS 4
+
+#define ABSOLUTE_GATE -70.0
+#define RELATIVE_GATE -10.0
+
+// Taps of the true peak interpolation filter per output phase.
+#define PEAK_TAPS 12
+
+struct biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+struct mp_loudness {
+    int num_channels;
+    double weights[MP_NUM_CHANNELS];
+
+    // K-weighting: high shelf followed by high pass, with the states of the
+    // transposed direct form II of each per channel.
+    struct biquad shelf, highpass;
+    double state[MP_NUM_CHANNELS][4];
+
+    int sub_block_size;             // samples per sub-block
+    int sub_block_pos;              // samples in the current sub-block
+    double sub_block_sum;           // weighted sum of squares of it
+    double sub_blocks[SUB_BLOCKS];  // sums of the last sub-blocks (ring)
+    int num_sub_blocks;             // number of complete sub-blocks so far
+
+    // Mean square of each gating block.
+    double *blocks;
+    int num_blocks;
+
+    // True peak: polyphase interpolation filter, coeffs[phase * PEAK_TAPS + n].
+    int oversample;
+    float *coeffs;
+    // Last PEAK_TAPS input samples per channel, stored twice so that they're
+    // always contiguous at history[ch][hist_pos + 1].
+    float history[MP_NUM_CHANNELS][PEAK_TAPS * 2];
+    int hist_pos;
+    float peak;
+};
+
+// Coefficients from ITU-R BS.1770, recomputed for the sample rate.
+static void init_k_weighting(struct mp_loudness *l, int rate)
+{
+    double f0 = 1681.974450955533;
+    double g = 3.999843853973347;
+    double q = 0.7071752369554196;
+
+    double k = tan(M_PI * f0 / rate);
+    double vh = pow(10.0, g / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    l->shelf = (struct biquad){
+        .b0 = (vh + vb * k / q + k * k) / a0,
+        .b1 = 2.0 * (k * k - vh) / a0,
+        .b2 = (vh - vb * k / q + k * k) / a0,
+        .a1 = 2.0 * (k * k - 1.0) / a0,
+        .a2 = (1.0 - k / q + k * k) / a0,
+    };
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    l->highpass = (struct biquad){
+        .b0 = 1.0,
+        .b1 = -2.0,
+        .b2 = 1.0,
+        .a1 = 2.0 * (k * k - 1.0) / a0,
+        .a2 = (1.0 - k / q + k * k) / a0,
+    };
+}
+
+// Windowed sinc interpolator, with each phase normalized to unity DC gain.
+static void init_true_peak(struct mp_loudness *l, int rate)
+{
+    l->oversample = rate < 96000 ? 4 : rate < 192000 ? 2 : 1;
+    int len = l->oversample * PEAK_TAPS;
+    l->coeffs = talloc_array(l, float, len);
+
+    double h[4 * PEAK_TAPS];
+    double center = len / 2;
+    for (int n = 0; n < len; n++) {
+        double x = (n - center) / l->oversample;
+        double sinc = x == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double w = 0.42 + 0.5 * cos(2 * M_PI * (n - center) / len) +
+                   0.08 * cos(4 * M_PI * (n - center) / len);
+        h[n] = sinc * w;
+    }
+
+    // history[] is ordered from old to new, so reverse the taps.
+    for (int p = 0; p < l->oversample; p++) {
+        double sum = 0;
+        for (int i = 0; i < PEAK_TAPS; i++)
+            sum += h[(PEAK_TAPS - 1 - i) * l->oversample + p];
+        for (int i = 0; i < PEAK_TAPS; i++) {
+            l->coeffs[p * PEAK_TAPS + i] =
+                h[(PEAK_TAPS - 1 - i) * l->oversample + p] / sum;
+        }
+    }
+}
+
+struct mp_loudness *mp_loudness_create(void *ta_parent, int rate,
+                                       struct mp_chmap *chmap)
+{
+    struct mp_loudness *l = talloc_zero(ta_parent, struct mp_loudness);
+    l->num_channels = chmap->num;
+    l->sub_block_size = MPMAX(rate / 10, 1);
+
+    for (int n = 0; n < chmap->num; n++) {
+        switch (chmap->speaker[n]) {
+        case MP_SPEAKER_ID_LFE:
+        case MP_SPEAKER_ID_LFE2:
+            l->weights[n] = 0.0;
+            break;
+        case MP_SPEAKER_ID_BL:
+        case MP_SPEAKER_ID_BR:
+        case MP_SPEAKER_ID_SL:
+        case MP_SPEAKER_ID_SR:
+            l->weights[n] = 1.41;
+            break;
+        default:
+            l->weights[n] = 1.0;
+        }
+    }
+
+    init_k_weighting(l, rate);
+    init_true_peak(l, rate);
+    return l;
+}
+
+static inline double biquad_run(const struct biquad *f, double *z, double x)
+{
+    double y = f->b0 * x + z[0];
+    z[0] = f->b1 * x - f->a1 * y + z[1];
+    z[1] = f->b2 * x - f->a2 * y;
+    return y;
+}
+
+// Return the weighted sum of squares of the K-weighted samples.
+static double k_weight(struct mp_loudness *l, float **planes, int offset,
+                       int samples)
+{
+    double total = 0;
+    for (int c = 0; c < l->num_channels; c++) {
+        double *z = l->state[c];
+        const float *src = planes[c] + offset;
+        double sum = 0;
+        for (int n = 0; n < samples; n++) {
+            double y = biquad_run(&l->shelf, &z[0], src[n]);
+            y = biquad_run(&l->highpass, &z[2], y);
+            sum += y * y;
+        }
+        total += sum * l->weights[c];
+    }
+    return total;
+}
+
+static void end_sub_block(struct mp_loudness *l)
+{
+    l->sub_blocks[l->num_sub_blocks % SUB_BLOCKS] = l->sub_block_sum;
+    l->num_sub_blocks++;
+    l->sub_block_sum = 0;
+    l->sub_block_pos = 0;
+
+    if (l->num_sub_blocks >= SUB_BLOCKS) {
+        double sum = 0;
+        for (int n = 0; n < SUB_BLOCKS; n++)
+            sum += l->sub_blocks[n];
+        double ms = sum / (l->sub_block_size * SUB_BLOCKS);
+        MP_TARRAY_APPEND(l, l->blocks, l->num_blocks, ms);
+    }
+}
+
+static void true_peak(struct mp_loudness *l, float **planes, int samples)
+{
+    int taps = PEAK_TAPS;
+    float peak = l->peak;
+    for (int n = 0; n < samples; n++) {
+        l->hist_pos = (l->hist_pos + 1) % taps;
+        for (int c = 0; c < l->num_channels; c++) {
+            float x = planes[c][n];
+            float *h = l->history[c];
+            h[l->hist_pos] = h[l->hist_pos + taps] = x;
+            const float *w = &h[l->hist_pos + 1];
+            peak = MPMAX(peak, fabsf(x));
+            for (int p = 0; p < l->oversample; p++) {
+                const float *coeffs = &l->coeffs[p * taps];
+                float y = 0;
+                for (int i = 0; i < taps; i++)
+                    y += coeffs[i] * w[i];
+                peak = MPMAX(peak, fabsf(y));
+            }
+        }
+    }
+    l->peak = peak;
+}
+
+void mp_loudness_add(struct mp_loudness *l, float **planes, int samples)
+{
+    true_peak(l, planes, samples);
+
+    int offset = 0;
+    while (offset < samples) {
+        int n = MPMIN(samples - offset, l->sub_block_size - l->sub_block_pos);
+        l->sub_block_sum += k_weight(l, planes, offset, n);
+        l->sub_block_pos += n;
+        offset += n;
+        if (l->sub_block_pos == l->sub_block_size)
+            end_sub_block(l);
+    }
+}
+
+static double to_lufs(double ms)
+{
+    return -0.691 + 10.0 * log10(ms);
+}
+
+double mp_loudness_get_integrated(struct mp_loudness *l)
+{
+    double sum = 0;
+    int num = 0;
+    for (int n = 0; n < l->num_blocks; n++) {
+        if (to_lufs(l->blocks[n]) > ABSOLUTE_GATE) {
+            sum += l->blocks[n];
+            num++;
+        }
+    }
+    if (!num)
+        return -INFINITY;
+
+    double gate = to_lufs(sum / num) + RELATIVE_GATE;
+    sum = 0;
+    num = 0;
+    for (int n = 0; n < l->num_blocks; n++) {
+        double lufs = to_lufs(l->blocks[n]);
+        if (lufs > ABSOLUTE_GATE && lufs > gate) {
+            sum += l->blocks[n];
+            num++;
+        }
+    }
+    return num ? to_lufs(sum / num) : -INFINITY;
+}
+
+double mp_loudness_get_true_peak(struct mp_loudness *l)
+{
+    return l->peak;
+}
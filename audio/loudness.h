@@ -0,0 +1,23 @@
+#ifndef MP_AUDIO_LOUDNESS_H
+#define MP_AUDIO_LOUDNESS_H
+
+struct mp_chmap;
+
+// Integrated loudness and true peak measurement as in EBU R128 (using the
+// K-weighting, gating and true peak algorithms of ITU-R BS.1770-4).
+struct mp_loudness;
+
+struct mp_loudness *mp_loudness_create(void *ta_parent, int rate,
+                                       struct mp_chmap *chmap);
+
+// Measure samples in AF_FORMAT_FLOATP (planes[n] is channel n).
+void mp_loudness_add(struct mp_loudness *l, float **planes, int samples);
+
+// Integrated loudness of all audio added so far in LUFS. Returns -INFINITY if
+// there was no audio above the absolute gate (-70 LUFS).
+double mp_loudness_get_integrated(struct mp_loudness *l);
+
+// Maximum true peak over all channels so far (linear; 1.0 is full scale).
+double mp_loudness_get_true_peak(struct mp_loudness *l);
+
+#endif
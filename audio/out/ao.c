@@ -575,15 +575,39 @@ void ao_set_gain(struct ao *ao, float gain)
     atomic_store(&ao->gain, gain);
 }
 
-#define MUL_GAIN_i(d, num_samples, gain, low, center, high)                     \
-    for (int n = 0; n < (num_samples); n++)                                     \
-        (d)[n] = MPCLAMP(                                                       \
-            ((((int64_t)((d)[n]) - (center)) * (gain) + 128) >> 8) + (center),  \
-            (low), (high))
+// The gain and conversion loops are written so that compilers can vectorize
+// them (no aliasing, no calls or early exits in the loop body, and 32 bit
+// intermediates if the value range allows it). They must return exactly the
+// same results as the plain scalar code; test/ao_kernels.c checks this.
+
+// Above this, (d - center) * gi may overflow int32 for 8 and 16 bit samples.
+#define GAIN_I32_MAX 65535
+
+#define GAIN_KERNEL_i(name, type, itype, low, center, high)                     \
+    static void name(type *restrict d, int num_samples, int gain)               \
+    {                                                                           \
+        for (int n = 0; n < num_samples; n++) {                                 \
+            itype v = ((((itype)d[n] - (center)) * gain + 128) >> 8) + (center); \
+            d[n] = MPCLAMP(v, (low), (high));                                   \
+        }                                                                       \
+    }
+
+#define GAIN_KERNEL_f(name, type)                                               \
+    static void name(type *restrict d, int num_samples, float gain)             \
+    {                                                                           \
+        for (int n = 0; n < num_samples; n++) {                                 \
+            type v = d[n] * gain;                                               \
+            d[n] = MPCLAMP(v, (type)-1.0, (type)1.0);                           \
+        }                                                                       \
+    }
 
-#define MUL_GAIN_f(d, num_samples, gain)                                        \
-    for (int n = 0; n < (num_samples); n++)                                     \
-        (d)[n] = MPCLAMP(((d)[n]) * (gain), -1.0, 1.0)
+GAIN_KERNEL_i(gain_u8,      uint8_t, int32_t, 0, 128, 255)
+GAIN_KERNEL_i(gain_u8_64,   uint8_t, int64_t, 0, 128, 255)
+GAIN_KERNEL_i(gain_s16,     int16_t, int32_t, INT16_MIN, 0, INT16_MAX)
+GAIN_KERNEL_i(gain_s16_64,  int16_t, int64_t, INT16_MIN, 0, INT16_MAX)
+GAIN_KERNEL_i(gain_s32,     int32_t, int64_t, INT32_MIN, 0, INT32_MAX)
+GAIN_KERNEL_f(gain_float,   float)
+GAIN_KERNEL_f(gain_double,  double)
 
 static void process_plane(struct ao *ao, void *data, int num_samples)
 {
@@ -591,21 +615,22 @@ static void process_plane(struct ao *ao, void *data, int num_samples)
     int gi = lrint(256.0 * gain);
     if (gi == 256)
         return;
+    bool small = gi <= GAIN_I32_MAX;
     switch (af_fmt_from_planar(ao->format)) {
     case AF_FORMAT_U8:
-        MUL_GAIN_i((uint8_t *)data, num_samples, gi, 0, 128, 255);
+        (small ? gain_u8 : gain_u8_64)(data, num_samples, gi);
         break;
     case AF_FORMAT_S16:
-        MUL_GAIN_i((int16_t *)data, num_samples, gi, INT16_MIN, 0, INT16_MAX);
+        (small ? gain_s16 : gain_s16_64)(data, num_samples, gi);
         break;
     case AF_FORMAT_S32:
-        MUL_GAIN_i((int32_t *)data, num_samples, gi, INT32_MIN, 0, INT32_MAX);
+        gain_s32(data, num_samples, gi);
         break;
     case AF_FORMAT_FLOAT:
-        MUL_GAIN_f((float *)data, num_samples, gain);
+        gain_float(data, num_samples, gain);
         break;
     case AF_FORMAT_DOUBLE:
-        MUL_GAIN_f((double *)data, num_samples, gain);
+        gain_double(data, num_samples, gain);
         break;
     default:;
         // all other sample formats are simply not supported
@@ -652,25 +677,56 @@ bool ao_need_conversion(struct ao_convert_fmt *fmt)
 #define SHIFT24(x) (((x)+1)*8)
 #endif
 
+static void pack_s24(void *data, int num_samples)
+{
+    int s = 0;
+#if BYTE_ORDER != BIG_ENDIAN
+    // Pack 4 samples into 3 words at once. All source bytes of a block are
+    // read before the destination (which is at a lower or equal address) is
+    // written, and no later block is touched.
+    uint8_t *p = data;
+    for (; s + 4 <= num_samples; s += 4) {
+        uint32_t v[4], w[3];
+        memcpy(v, p + s * 4, sizeof(v));
+        w[0] = (v[0] >> 8)  | ((v[1] & 0xFF00u) << 16);
+        w[1] = (v[1] >> 16) | ((v[2] & 0xFFFF00u) << 8);
+        w[2] = (v[2] >> 24) | (v[3] & 0xFFFFFF00u);
+        memcpy(p + s * 3, w, sizeof(w));
+    }
+#endif
+    for (; s < num_samples; s++) {
+        uint32_t val = *((uint32_t *)data + s);
+        uint8_t *ptr = (uint8_t *)data + s * 3;
+        ptr[0] = val >> SHIFT24(0);
+        ptr[1] = val >> SHIFT24(1);
+        ptr[2] = val >> SHIFT24(2);
+    }
+}
+
+// Like pack_s24(), but the 4th (most significant) byte is set to 0, so each
+// sample stays in place.
+static void pad_s24(uint32_t *restrict data, int num_samples)
+{
+    for (int s = 0; s < num_samples; s++) {
+#if BYTE_ORDER == BIG_ENDIAN
+        data[s] &= 0xFFFFFF00u;
+#else
+        data[s] >>= 8;
+#endif
+    }
+}
+
 static void convert_plane(int type, void *data, int num_samples)
 {
     switch (type) {
     case 0:
         break;
-    case 1: /* fall through */
-    case 2: {
-        int bytes = type == 1 ? 3 : 4;
-        for (int s = 0; s < num_samples; s++) {
-            uint32_t val = *((uint32_t *)data + s);
-            uint8_t *ptr = (uint8_t *)data + s * bytes;
-            ptr[0] = val >> SHIFT24(0);
-            ptr[1] = val >> SHIFT24(1);
-            ptr[2] = val >> SHIFT24(2);
-            if (type == 2)
-                ptr[3] = 0;
-        }
+    case 1:
+        pack_s24(data, num_samples);
+        break;
+    case 2:
+        pad_s24(data, num_samples);
         break;
-    }
     default:
         abort();
     }
@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
 
 #include <libavutil/common.h>
 
@@ -41,25 +42,34 @@
 #include "common/msg.h"
 
 #include "common/encode_lavc.h"
+#include "osdep/atomic.h"
 
-struct priv {
+// One per output file (the main one, and each --oextra).
+struct output {
+    struct ao *ao;
     struct encoder_context *enc;
 
     int pcmhack;
     int aframesize;
-    int framecount;
     int64_t lastpts;
-    int sample_size;
-    double expected_next_pts;
-    struct mp_filter *filter_root;
     struct mp_filter *fix_frame_size;
 
     AVRational worst_time_base;
+};
+
+struct priv {
+    struct output *outputs;
+    int num_outputs;
+    atomic_int num_ready;       // number of outputs with muxer initialized
+
+    int sample_size;
+    double expected_next_pts;
+    struct mp_filter *filter_root;
 
     bool shutdown;
 };
 
-static bool write_frame(struct ao *ao, struct mp_frame frame);
+static bool write_frame(struct output *out, struct mp_frame frame);
 
 static bool supports_format(const AVCodec *codec, int format)
 {
@@ -88,25 +98,86 @@ static void select_format(struct ao *ao, const AVCodec *codec)
 
 static void on_ready(void *ptr)
 {
-    struct ao *ao = ptr;
+    struct output *out = ptr;
+    struct ao *ao = out->ao;
+    struct priv *ac = ao->priv;
+
+    out->worst_time_base = encoder_get_mux_timebase_unlocked(out->enc);
+
+    // Each output's muxer is initialized separately, and audio must not be
+    // sent before all of them are.
+    if (atomic_fetch_add(&ac->num_ready, 1) + 1 == ac->num_outputs)
+        ao_add_events(ao, AO_EVENT_INITIAL_UNBLOCK);
+}
+
+// The sample format, rate and channel layout are chosen for the main output,
+// and used for all outputs.
+static bool init_output(struct ao *ao, struct output *out)
+{
     struct priv *ac = ao->priv;
+    AVCodecContext *encoder = out->enc->encoder;
+
+    if (!supports_format(encoder->codec, ao->format)) {
+        MP_FATAL(ao, "Codec %s for %s does not support sample format %s.\n",
+                 encoder->codec->name, out->enc->options->file,
+                 af_fmt_to_str(ao->format));
+        return false;
+    }
+
+    encoder->time_base.num = 1;
+    encoder->time_base.den = ao->samplerate;
+
+    encoder->sample_rate = ao->samplerate;
+
+    encoder->channels = ao->channels.num;
+    encoder->channel_layout = mp_chmap_to_lavc(&ao->channels);
+
+    encoder->sample_fmt = af_to_avformat(ao->format);
+    encoder->bits_per_raw_sample = ac->sample_size * 8;
+
+    if (!encoder_init_codec_and_muxer(out->enc, on_ready, out))
+        return false;
+
+    out->pcmhack = 0;
+    if (encoder->frame_size <= 1)
+        out->pcmhack = av_get_bits_per_sample(encoder->codec_id) / 8;
+
+    if (out->pcmhack) {
+        out->aframesize = 16384; // "enough"
+    } else {
+        out->aframesize = encoder->frame_size;
+    }
 
-    ac->worst_time_base = encoder_get_mux_timebase_unlocked(ac->enc);
+    out->lastpts = AV_NOPTS_VALUE;
 
-    ao_add_events(ao, AO_EVENT_INITIAL_UNBLOCK);
+    out->fix_frame_size = mp_fixed_aframe_size_create(ac->filter_root,
+                                                      out->aframesize, true);
+    MP_HANDLE_OOM(out->fix_frame_size);
+
+    return true;
 }
 
 // open & setup audio device
 static int init(struct ao *ao)
 {
     struct priv *ac = ao->priv;
+    struct encode_lavc_context *ctx = ao->encode_lavc_ctx;
+
+    for (int n = 0; n < 1 + ctx->num_extra; n++) {
+        struct output out = {
+            .ao = ao,
+            .enc = encoder_context_alloc(n ? ctx->extra[n - 1] : ctx,
+                                         STREAM_AUDIO, ao->log),
+        };
+        if (!out.enc) {
+            ac->shutdown = true;
+            return -1;
+        }
+        talloc_steal(ac, out.enc);
+        MP_TARRAY_APPEND(ac, ac->outputs, ac->num_outputs, out);
+    }
 
-    ac->enc = encoder_context_alloc(ao->encode_lavc_ctx, STREAM_AUDIO, ao->log);
-    if (!ac->enc)
-        return -1;
-    talloc_steal(ac, ac->enc);
-
-    AVCodecContext *encoder = ac->enc->encoder;
+    AVCodecContext *encoder = ac->outputs[0].enc->encoder;
     const AVCodec *codec = encoder->codec;
 
     int samplerate = af_select_best_samplerate(ao->samplerate,
@@ -114,55 +185,33 @@ static int init(struct ao *ao)
     if (samplerate > 0)
         ao->samplerate = samplerate;
 
-    encoder->time_base.num = 1;
-    encoder->time_base.den = ao->samplerate;
-
-    encoder->sample_rate = ao->samplerate;
-
     struct mp_chmap_sel sel = {0};
     mp_chmap_sel_add_any(&sel);
     if (!ao_chmap_sel_adjust2(ao, &sel, &ao->channels, false))
         goto fail;
     mp_chmap_reorder_to_lavc(&ao->channels);
-    encoder->channels = ao->channels.num;
-    encoder->channel_layout = mp_chmap_to_lavc(&ao->channels);
-
-    encoder->sample_fmt = AV_SAMPLE_FMT_NONE;
 
     select_format(ao, codec);
 
     ac->sample_size = af_fmt_to_bytes(ao->format);
-    encoder->sample_fmt = af_to_avformat(ao->format);
-    encoder->bits_per_raw_sample = ac->sample_size * 8;
-
-    if (!encoder_init_codec_and_muxer(ac->enc, on_ready, ao))
-        goto fail;
 
-    ac->pcmhack = 0;
-    if (encoder->frame_size <= 1)
-        ac->pcmhack = av_get_bits_per_sample(encoder->codec_id) / 8;
+    ac->filter_root = mp_filter_create_root(ao->global);
 
-    if (ac->pcmhack) {
-        ac->aframesize = 16384; // "enough"
-    } else {
-        ac->aframesize = encoder->frame_size;
+    for (int n = 0; n < ac->num_outputs; n++) {
+        if (!init_output(ao, &ac->outputs[n]))
+            goto fail;
     }
 
+    int aframesize = ac->outputs[0].aframesize;
+
     // enough frames for at least 0.25 seconds
-    ac->framecount = ceil(ao->samplerate * 0.25 / ac->aframesize);
+    int framecount = ceil(ao->samplerate * 0.25 / aframesize);
     // but at least one!
-    ac->framecount = MPMAX(ac->framecount, 1);
-
-    ac->lastpts = AV_NOPTS_VALUE;
+    framecount = MPMAX(framecount, 1);
 
     ao->untimed = true;
 
-    ao->device_buffer = ac->aframesize * ac->framecount;
-
-    ac->filter_root = mp_filter_create_root(ao->global);
-    ac->fix_frame_size = mp_fixed_aframe_size_create(ac->filter_root,
-                                                     ac->aframesize, true);
-    MP_HANDLE_OOM(ac->fix_frame_size);
+    ao->device_buffer = aframesize * framecount;
 
     return 0;
 
@@ -182,25 +231,28 @@ static void uninit(struct ao *ao)
         double outpts = ac->expected_next_pts;
 
         pthread_mutex_lock(&ectx->lock);
-        if (!ac->enc->options->rawts)
+        if (!ac->outputs[0].enc->options->rawts)
             outpts += ectx->discontinuity_pts_offset;
         pthread_mutex_unlock(&ectx->lock);
 
-        outpts += encoder_get_offset(ac->enc);
+        outpts += encoder_get_offset(ac->outputs[0].enc);
 
-        if (!write_frame(ao, MP_EOF_FRAME))
-            MP_WARN(ao, "could not flush last frame\n");
-        encoder_encode(ac->enc, NULL);
+        for (int n = 0; n < ac->num_outputs; n++) {
+            struct output *out = &ac->outputs[n];
+            if (!write_frame(out, MP_EOF_FRAME))
+                MP_WARN(ao, "could not flush last frame\n");
+            encoder_encode(out->enc, NULL);
+        }
     }
 
     talloc_free(ac->filter_root);
 }
 
-// must get exactly ac->aframesize amount of data
-static void encode(struct ao *ao, struct mp_aframe *af)
+// must get exactly out->aframesize amount of data
+static void encode(struct output *out, struct mp_aframe *af)
 {
-    struct priv *ac = ao->priv;
-    AVCodecContext *encoder = ac->enc->encoder;
+    struct ao *ao = out->ao;
+    AVCodecContext *encoder = out->enc->encoder;
     double outpts = mp_aframe_get_pts(af);
 
     AVFrame *frame = mp_aframe_to_avframe(af);
@@ -210,43 +262,41 @@ static void encode(struct ao *ao, struct mp_aframe *af)
     frame->pts = rint(outpts * av_q2d(av_inv_q(encoder->time_base)));
 
     int64_t frame_pts = av_rescale_q(frame->pts, encoder->time_base,
-                                     ac->worst_time_base);
-    if (ac->lastpts != AV_NOPTS_VALUE && frame_pts <= ac->lastpts) {
+                                     out->worst_time_base);
+    if (out->lastpts != AV_NOPTS_VALUE && frame_pts <= out->lastpts) {
         // whatever the fuck this code does?
         MP_WARN(ao, "audio frame pts went backwards (%d <- %d), autofixed\n",
-                (int)frame->pts, (int)ac->lastpts);
-        frame_pts = ac->lastpts + 1;
-        ac->lastpts = frame_pts;
-        frame->pts = av_rescale_q(frame_pts, ac->worst_time_base,
+                (int)frame->pts, (int)out->lastpts);
+        frame_pts = out->lastpts + 1;
+        out->lastpts = frame_pts;
+        frame->pts = av_rescale_q(frame_pts, out->worst_time_base,
                                   encoder->time_base);
         frame_pts = av_rescale_q(frame->pts, encoder->time_base,
-                                 ac->worst_time_base);
+                                 out->worst_time_base);
     }
-    ac->lastpts = frame_pts;
+    out->lastpts = frame_pts;
 
     frame->quality = encoder->global_quality;
-    encoder_encode(ac->enc, frame);
+    encoder_encode(out->enc, frame);
     av_frame_free(&frame);
 }
 
-static bool write_frame(struct ao *ao, struct mp_frame frame)
+static bool write_frame(struct output *out, struct mp_frame frame)
 {
-    struct priv *ac = ao->priv;
-
     // Can't push in frame if it doesn't want it output one.
-    mp_pin_out_request_data(ac->fix_frame_size->pins[1]);
+    mp_pin_out_request_data(out->fix_frame_size->pins[1]);
 
-    if (!mp_pin_in_write(ac->fix_frame_size->pins[0], frame))
+    if (!mp_pin_in_write(out->fix_frame_size->pins[0], frame))
         return false; // shouldn't happen™
 
     while (1) {
-        struct mp_frame fr = mp_pin_out_read(ac->fix_frame_size->pins[1]);
+        struct mp_frame fr = mp_pin_out_read(out->fix_frame_size->pins[1]);
         if (!fr.type)
             break;
         if (fr.type != MP_FRAME_AUDIO)
             continue;
         struct mp_aframe *af = fr.data;
-        encode(ao, af);
+        encode(out, af);
         mp_frame_unref(&fr);
     }
 
@@ -257,6 +307,7 @@ static bool audio_write(struct ao *ao, void **data, int samples)
 {
     struct priv *ac = ao->priv;
     struct encode_lavc_context *ectx = ao->encode_lavc_ctx;
+    struct encoder_context *enc = ac->outputs[0].enc;
 
     // See ao_driver.write_frames.
     struct mp_aframe *af = mp_aframe_new_ref(*(struct mp_aframe **)data);
@@ -286,7 +337,7 @@ static bool audio_write(struct ao *ao, void **data, int samples)
     }
 
     // Shift pts by the pts offset first.
-    outpts += encoder_get_offset(ac->enc);
+    outpts += encoder_get_offset(enc);
 
     // Calculate expected pts of next audio frame (input side).
     ac->expected_next_pts = pts + mp_aframe_get_size(af) / (double) ao->samplerate;
@@ -302,7 +353,13 @@ static bool audio_write(struct ao *ao, void **data, int samples)
 
     mp_aframe_set_pts(af, outpts);
 
-    return write_frame(ao, MAKE_FRAME(MP_FRAME_AUDIO, af));
+    // Every output gets a reference to the same data.
+    struct mp_frame frame = MAKE_FRAME(MP_FRAME_AUDIO, af);
+    bool ok = true;
+    for (int n = 0; n < ac->num_outputs; n++)
+        ok &= write_frame(&ac->outputs[n], mp_frame_ref(frame));
+    mp_frame_unref(&frame);
+    return ok;
 }
 
 static void get_state(struct ao *ao, struct mp_pcm_state *state)
@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "ao.h"
 #include "internal.h"
@@ -31,6 +32,8 @@
 #include "common/msg.h"
 #include "common/common.h"
 
+#include "misc/ring.h"
+
 #include "filters/f_async_queue.h"
 #include "filters/filter_internal.h"
 
@@ -52,6 +55,17 @@ struct buffer_state {
     // Immutable.
     struct mp_async_queue *queue;
 
+    // "Pull" AOs only (AOs without driver->write). The playthread moves audio
+    // from the queue to the rings (one per plane), and ao_read_data() reads
+    // from them without ever taking a lock or running filters.
+    struct mp_ring *rings[MP_NUM_CHANNELS];
+    int ring_size;              // in samples
+    atomic_bool rt_playing;     // copy of playing && !paused
+    atomic_bool rt_underrun;    // ao_read_data() could not return enough data
+    atomic_int ring_flush_req;  // incremented by ao_reset()
+    atomic_int ring_flush_ack;  // set to ring_flush_req after flushing
+    mp_atomic_int64 end_time_us; // absolute output time of last played sample
+
     // --- protected by lock
 
     struct mp_filter *filter_root;
@@ -62,8 +76,6 @@ struct buffer_state {
     bool playing;               // logically playing audio from buffer
     bool paused;                // logically paused
 
-    int64_t end_time_us;        // absolute output time of last played sample
-
     bool initial_unblocked;
 
     // "Push" AOs only (AOs with driver->write).
@@ -114,6 +126,37 @@ struct mp_async_queue *ao_get_queue(struct ao *ao)
     return p->queue;
 }
 
+// called locked
+static void update_rt_state(struct ao *ao)
+{
+    struct buffer_state *p = ao->buffer_state;
+    atomic_store(&p->rt_playing, p->playing && !p->paused);
+}
+
+// called locked
+// Make p->pending contain unread samples. Returns false if there is no data
+// available right now. Sets *eof if EOF was read from the queue.
+static bool get_pending(struct ao *ao, bool *eof)
+{
+    struct buffer_state *p = ao->buffer_state;
+
+    while (!p->pending || !mp_aframe_get_size(p->pending)) {
+        TA_FREEP(&p->pending);
+        struct mp_frame frame = mp_pin_out_read(p->input->pins[0]);
+        if (!frame.type)
+            return false; // we can't/don't want to block
+        if (frame.type != MP_FRAME_AUDIO) {
+            if (frame.type == MP_FRAME_EOF)
+                *eof = true;
+            mp_frame_unref(&frame);
+            continue;
+        }
+        p->pending = frame.data;
+    }
+
+    return true;
+}
+
 // Special behavior with data==NULL: caller uses p->pending.
 static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
 {
@@ -122,19 +165,8 @@ static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
     *eof = false;
 
     while (p->playing && !p->paused && pos < samples) {
-        if (!p->pending || !mp_aframe_get_size(p->pending)) {
-            TA_FREEP(&p->pending);
-            struct mp_frame frame = mp_pin_out_read(p->input->pins[0]);
-            if (!frame.type)
-                break; // we can't/don't want to block
-            if (frame.type != MP_FRAME_AUDIO) {
-                if (frame.type == MP_FRAME_EOF)
-                    *eof = true;
-                mp_frame_unref(&frame);
-                continue;
-            }
-            p->pending = frame.data;
-        }
+        if (!get_pending(ao, eof))
+            break;
 
         if (!data)
             break;
@@ -170,6 +202,73 @@ static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
     return pos;
 }
 
+// Samples that can be read from the rings (all planes are written together).
+static int ring_samples(struct ao *ao)
+{
+    struct buffer_state *p = ao->buffer_state;
+    int bytes = INT_MAX;
+    for (int n = 0; n < ao->num_planes; n++)
+        bytes = MPMIN(bytes, mp_ring_buffered(p->rings[n]));
+    return bytes / ao->sstride;
+}
+
+// Consumer side of the rings: discard their contents if ao_reset() asked for
+// it. Must be called only by ao_read_data(), or while it can't be running.
+static void flush_rings(struct ao *ao)
+{
+    struct buffer_state *p = ao->buffer_state;
+
+    int req = atomic_load(&p->ring_flush_req);
+    if (req == atomic_load(&p->ring_flush_ack))
+        return;
+
+    for (int n = 0; n < ao->num_planes; n++)
+        mp_ring_drain(p->rings[n], INT_MAX);
+    atomic_store(&p->ring_flush_ack, req);
+}
+
+// called locked
+// Producer side of the rings: move as much audio from the queue as fits.
+static void fill_rings(struct ao *ao)
+{
+    struct buffer_state *p = ao->buffer_state;
+
+    // Old data must be gone before new data is added.
+    if (atomic_load(&p->ring_flush_req) != atomic_load(&p->ring_flush_ack))
+        return;
+
+    int space = INT_MAX;
+    for (int n = 0; n < ao->num_planes; n++)
+        space = MPMIN(space, mp_ring_available(p->rings[n]) / ao->sstride);
+
+    int pos = 0;
+    bool eof = false;
+    while (p->playing && !p->paused && pos < space) {
+        if (!get_pending(ao, &eof))
+            break;
+
+        int copy = MPMIN(mp_aframe_get_size(p->pending), space - pos);
+        uint8_t **fdata = mp_aframe_get_data_ro(p->pending);
+        for (int n = 0; n < ao->num_planes; n++)
+            mp_ring_write(p->rings[n], fdata[n], copy * ao->sstride);
+        mp_aframe_skip_samples(p->pending, copy);
+        pos += copy;
+    }
+
+    // ao_read_data() ran dry, and there is nothing left to play: underrun or
+    // EOF. ao_read_data() can't do this itself, because it must not lock.
+    if (atomic_exchange(&p->rt_underrun, false) && p->playing && !p->paused &&
+        !pos && !ring_samples(ao))
+    {
+        MP_VERBOSE(ao, "audio end or underrun\n");
+        p->playing = false;
+        update_rt_state(ao);
+        ao->wakeup_cb(ao->wakeup_ctx);
+        // For ao_drain().
+        pthread_cond_broadcast(&p->wakeup);
+    }
+}
+
 // Read the given amount of samples in the user-provided data buffer. Returns
 // the number of samples copied. If there is not enough data (buffer underrun
 // or EOF), return the number of samples that could be copied, and fill the
@@ -178,25 +277,38 @@ static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
 // If this is called in paused mode, it will always return 0.
 // The caller should set out_time_us to the expected delay until the last sample
 // reaches the speakers, in microseconds, using mp_time_us() as reference.
+// This is typically called from the audio API's realtime thread, so it only
+// reads from the rings, and never blocks.
 int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
 {
     struct buffer_state *p = ao->buffer_state;
     assert(!ao->driver->write);
 
-    pthread_mutex_lock(&p->lock);
+    flush_rings(ao);
 
-    int pos = read_buffer(ao, data, samples, &(bool){0});
+    bool playing = atomic_load(&p->rt_playing);
 
-    if (pos > 0)
-        p->end_time_us = out_time_us;
+    int pos = 0;
+    if (playing) {
+        pos = MPMIN(samples, ring_samples(ao));
+        for (int n = 0; n < ao->num_planes; n++)
+            mp_ring_read(p->rings[n], data[n], pos * ao->sstride);
+    }
 
-    if (pos < samples && p->playing && !p->paused) {
-        p->playing = false;
-        // For ao_drain().
-        pthread_cond_broadcast(&p->wakeup);
+    // pad with silence (underflow/paused/eof)
+    for (int n = 0; n < ao->num_planes; n++) {
+        af_fill_silence((char *)data[n] + pos * ao->sstride,
+                        (samples - pos) * ao->sstride, ao->format);
     }
 
-    pthread_mutex_unlock(&p->lock);
+    ao_post_process_data(ao, data, pos);
+
+    if (pos > 0)
+        atomic_store(&p->end_time_us, out_time_us);
+
+    // The playthread decides whether this is an underrun.
+    if (pos < samples && playing)
+        atomic_store(&p->rt_underrun, true);
 
     return pos;
 }
@@ -268,7 +380,7 @@ double ao_get_delay(struct ao *ao)
         get_dev_state(ao, &state);
         driver_delay = state.delay;
     } else {
-        int64_t end = p->end_time_us;
+        int64_t end = atomic_load(&p->end_time_us);
         int64_t now = mp_time_us();
         driver_delay = MPMAX(0, (end - now) / (1000.0 * 1000.0));
     }
@@ -276,6 +388,8 @@ double ao_get_delay(struct ao *ao)
     int pending = mp_async_queue_get_samples(p->queue);
     if (p->pending)
         pending += mp_aframe_get_size(p->pending);
+    if (!ao->driver->write)
+        pending += ring_samples(ao);
 
     pthread_mutex_unlock(&p->lock);
     return driver_delay + pending / (double)ao->samplerate;
@@ -295,6 +409,10 @@ void ao_reset(struct ao *ao)
     mp_filter_reset(p->filter_root);
     mp_async_queue_resume_reading(p->queue);
 
+    bool was_streaming = p->streaming;
+    if (!ao->driver->write)
+        atomic_fetch_add(&p->ring_flush_req, 1);
+
     if (!ao->stream_silence && ao->driver->reset) {
         if (ao->driver->write) {
             ao->driver->reset(ao);
@@ -309,13 +427,22 @@ void ao_reset(struct ao *ao)
     p->playing = false;
     p->recover_pause = false;
     p->hw_paused = false;
-    p->end_time_us = 0;
+    atomic_store(&p->end_time_us, 0);
+    atomic_store(&p->rt_underrun, false);
+    update_rt_state(ao);
 
     pthread_mutex_unlock(&p->lock);
 
     if (do_reset)
         ao->driver->reset(ao);
 
+    // If the driver is stopped, ao_read_data() won't flush the rings.
+    if (!ao->driver->write && (do_reset || !was_streaming)) {
+        pthread_mutex_lock(&p->lock);
+        flush_rings(ao);
+        pthread_mutex_unlock(&p->lock);
+    }
+
     if (wakeup)
         ao_wakeup_playthread(ao);
 }
@@ -333,9 +460,14 @@ void ao_start(struct ao *ao)
 
     p->playing = true;
 
-    if (!ao->driver->write && !p->paused && !p->streaming) {
-        p->streaming = true;
-        do_start = true;
+    if (!ao->driver->write) {
+        // Prefill, so the driver does not start with an underrun.
+        fill_rings(ao);
+        update_rt_state(ao);
+        if (!p->paused && !p->streaming) {
+            p->streaming = true;
+            do_start = true;
+        }
     }
 
     pthread_mutex_unlock(&p->lock);
@@ -387,6 +519,7 @@ void ao_set_paused(struct ao *ao, bool paused)
         wakeup = true;
     }
     p->paused = paused;
+    update_rt_state(ao);
 
     pthread_mutex_unlock(&p->lock);
 
@@ -519,21 +652,27 @@ bool init_buffer_post(struct ao *ao)
     };
     mp_async_queue_set_config(p->queue, cfg);
 
-    if (ao->driver->write) {
-        mp_filter_graph_set_wakeup_cb(p->filter_root, wakeup_filters, ao);
+    if (!ao->driver->write) {
+        // Enough for the device buffer, plus some slack for playthread wakeup
+        // latency.
+        p->ring_size = MPMAX(ao->device_buffer * 2, ao->samplerate / 10);
+        for (int n = 0; n < ao->num_planes; n++)
+            p->rings[n] = mp_ring_new(p, p->ring_size * ao->sstride);
 
-        p->thread_valid = true;
-        if (pthread_create(&p->thread, NULL, playthread, ao)) {
-            p->thread_valid = false;
-            return false;
-        }
-    } else {
         if (ao->stream_silence) {
             ao->driver->start(ao);
             p->streaming = true;
         }
     }
 
+    mp_filter_graph_set_wakeup_cb(p->filter_root, wakeup_filters, ao);
+
+    p->thread_valid = true;
+    if (pthread_create(&p->thread, NULL, playthread, ao)) {
+        p->thread_valid = false;
+        return false;
+    }
+
     if (ao->stream_silence) {
         MP_WARN(ao, "The --audio-stream-silence option is set. This will break "
                 "certain player behavior.\n");
@@ -655,8 +794,11 @@ static void *playthread(void *arg)
         pthread_mutex_lock(&p->lock);
 
         bool retry = false;
-        if (!ao->driver->initially_blocked || p->initial_unblocked)
+        if (!ao->driver->write) {
+            fill_rings(ao);
+        } else if (!ao->driver->initially_blocked || p->initial_unblocked) {
             retry = ao_play_data(ao);
+        }
 
         // Wait until the device wants us to write more data to it.
         // Fallback to guessing.
@@ -665,7 +807,8 @@ static void *playthread(void *arg)
             // Wake up again if half of the audio buffer has been played.
             // Since audio could play at a faster or slower pace, wake up twice
             // as often as ideally needed.
-            timeout = ao->device_buffer / (double)ao->samplerate * 0.25;
+            int buffer = ao->driver->write ? ao->device_buffer : p->ring_size;
+            timeout = buffer / (double)ao->samplerate * 0.25;
         }
 
         pthread_mutex_unlock(&p->lock);
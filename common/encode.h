@@ -46,6 +46,10 @@ struct encode_opts {
     int copy_metadata;
     char **set_metadata;
     char **remove_metadata;
+    int queue_frames;
+    char **extra_outputs;
+    int chunks;
+    double chunk_length;
 };
 
 // interface for player core
@@ -32,6 +32,7 @@
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/options.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "video/out/vo.h"
 #include "mpv_talloc.h"
@@ -53,6 +54,16 @@ struct encode_priv {
     struct mux_stream **streams;
     int num_streams;
 
+    // Muxer thread (only with --oqueue-frames > 0). While it runs, only the
+    // thread itself accesses the muxer.
+    bool mux_thread_valid;
+    pthread_t mux_thread;
+    pthread_cond_t mux_wakeup;      // signaled on mux_queue changes
+    AVPacket **mux_queue;           // packets ready for muxing, in FIFO order
+    int num_mux_queue;
+    bool mux_terminate;             // exit mux_thread once the queue is empty
+    int64_t out_size;               // output size, updated by mux_thread
+
     // Statistics
     double t0;
 
@@ -74,6 +85,21 @@ struct mux_stream {
     void *on_ready_ctx;
 };
 
+struct encoder_queue {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;  // signaled on any state change
+    AVFrame **frames;       // frames to encode, NULL means flush
+    int num_frames;
+    bool busy;              // thread is encoding a frame taken from the queue
+    bool failed;
+    bool terminate;
+};
+
+// Maximum number of packets queued for the muxer thread. The encoders block
+// if it's full.
+#define MUX_QUEUE_MAX 64
+
 #define OPT_BASE_STRUCT struct encode_opts
 const struct m_sub_options encode_config = {
     .opts = (const m_option_t[]) {
@@ -96,6 +122,10 @@ const struct m_sub_options encode_config = {
         {"ocopy-metadata", OPT_FLAG(copy_metadata)},
         {"oset-metadata", OPT_KEYVALUELIST(set_metadata)},
         {"oremove-metadata", OPT_STRINGLIST(remove_metadata)},
+        {"oqueue-frames", OPT_INT(queue_frames), M_RANGE(0, 1000)},
+        {"oextra", OPT_STRINGLIST(extra_outputs)},
+        {"ochunks", OPT_INT(chunks), M_RANGE(0, 64)},
+        {"ochunk-length", OPT_DOUBLE(chunk_length), M_RANGE(1, 86400)},
 
         {"ocopyts", OPT_REMOVED("ocopyts is now the default")},
         {"oneverdrop", OPT_REMOVED("no replacement")},
@@ -108,22 +138,28 @@ const struct m_sub_options encode_config = {
     .size = sizeof(struct encode_opts),
     .defaults = &(const struct encode_opts){
         .copy_metadata = 1,
+        .queue_frames = 8,
+        .chunk_length = 60,
     },
 };
 
-struct encode_lavc_context *encode_lavc_init(struct mpv_global *global)
+// Takes ownership of options.
+static struct encode_lavc_context *create_context(struct mpv_global *global,
+                                                  struct encode_opts *options,
+                                                  struct mp_log *log)
 {
     struct encode_lavc_context *ctx = talloc_ptrtype(NULL, ctx);
     *ctx = (struct encode_lavc_context){
         .global = global,
-        .options = mp_get_config_group(ctx, global, &encode_config),
+        .options = talloc_steal(ctx, options),
         .priv = talloc_zero(ctx, struct encode_priv),
-        .log = mp_log_new(ctx, global->log, "encode"),
+        .log = talloc_steal(ctx, log),
     };
     pthread_mutex_init(&ctx->lock, NULL);
 
     struct encode_priv *p = ctx->priv;
     p->log = ctx->log;
+    pthread_cond_init(&p->mux_wakeup, NULL);
 
     const char *filename = ctx->options->file;
 
@@ -168,11 +204,126 @@ fail:
     return NULL;
 }
 
+static void steal_keyvalue_list(void *ta_parent, char **list)
+{
+    talloc_steal(ta_parent, list);
+    for (int n = 0; list && list[n]; n++)
+        talloc_steal(list, list[n]);
+}
+
+// Parse an --oextra entry, which is a key/value list with the output file and
+// the settings that differ from the main output. Returns NULL on error.
+static struct encode_opts *parse_extra_output(struct encode_lavc_context *ctx,
+                                              const char *spec,
+                                              int *scale_w, int *scale_h)
+{
+    const struct m_option kv_opt = {.type = &m_option_type_keyvalue_list};
+    char **kv = NULL;
+    if (m_option_parse(ctx->log, &kv_opt, bstr0("oextra"), bstr0(spec), &kv) < 0)
+        return NULL;
+
+    // Strings not overridden are shared with the main context, which outlives
+    // the extra outputs.
+    struct encode_opts *opts = talloc_dup(NULL, ctx->options);
+    opts->file = NULL;
+    opts->extra_outputs = NULL;
+    bool ok = true;
+
+    for (int n = 0; kv && kv[n * 2]; n++) {
+        const char *key = kv[n * 2 + 0], *val = kv[n * 2 + 1];
+        if (!strcmp(key, "o")) {
+            opts->file = talloc_strdup(opts, val);
+        } else if (!strcmp(key, "of")) {
+            opts->format = talloc_strdup(opts, val);
+        } else if (!strcmp(key, "ovc")) {
+            opts->vcodec = talloc_strdup(opts, val);
+        } else if (!strcmp(key, "oac")) {
+            opts->acodec = talloc_strdup(opts, val);
+        } else if (!strcmp(key, "ovcopts") || !strcmp(key, "oacopts")) {
+            char **list = NULL;
+            if (m_option_parse(ctx->log, &kv_opt, bstr0(key), bstr0(val),
+                               &list) < 0)
+            {
+                ok = false;
+                break;
+            }
+            steal_keyvalue_list(opts, list);
+            if (key[2] == 'v') {
+                opts->vopts = list;
+            } else {
+                opts->aopts = list;
+            }
+        } else if (!strcmp(key, "scale")) {
+            if (sscanf(val, "%dx%d", scale_w, scale_h) != 2 ||
+                *scale_w == 0 || *scale_w < -1 || *scale_h == 0 ||
+                *scale_h < -1 || (*scale_w < 0 && *scale_h < 0))
+            {
+                MP_FATAL(ctx, "invalid scale '%s' in --oextra\n", val);
+                ok = false;
+                break;
+            }
+        } else {
+            MP_FATAL(ctx, "unknown key '%s' in --oextra\n", key);
+            ok = false;
+            break;
+        }
+    }
+
+    m_option_free(&kv_opt, &kv);
+
+    if (ok && !(opts->file && opts->file[0])) {
+        MP_FATAL(ctx, "--oextra entry '%s' has no output file (o=...)\n", spec);
+        ok = false;
+    }
+
+    if (!ok)
+        TA_FREEP(&opts);
+    return opts;
+}
+
+struct encode_lavc_context *encode_lavc_init(struct mpv_global *global)
+{
+    struct encode_lavc_context *ctx =
+        create_context(global, mp_get_config_group(NULL, global, &encode_config),
+                       mp_log_new(NULL, global->log, "encode"));
+    if (!ctx)
+        return NULL;
+
+    for (int n = 0; ctx->options->extra_outputs &&
+                    ctx->options->extra_outputs[n]; n++)
+    {
+        int scale_w = 0, scale_h = 0;
+        struct encode_opts *opts = parse_extra_output(ctx,
+                            ctx->options->extra_outputs[n], &scale_w, &scale_h);
+        if (!opts)
+            goto fail;
+        char name[20];
+        snprintf(name, sizeof(name), "extra%d", n + 1);
+        struct encode_lavc_context *extra =
+            create_context(global, opts, mp_log_new(NULL, ctx->log, name));
+        if (!extra)
+            goto fail;
+        extra->scale_w = scale_w;
+        extra->scale_h = scale_h;
+        MP_TARRAY_APPEND(ctx, ctx->extra, ctx->num_extra, extra);
+    }
+
+    return ctx;
+
+fail:
+    ctx->priv->failed = true;
+    encode_lavc_free(ctx);
+    return NULL;
+}
+
 void encode_lavc_set_metadata(struct encode_lavc_context *ctx,
                               struct mp_tags *metadata)
 {
     struct encode_priv *p = ctx->priv;
 
+    for (int n = 0; n < ctx->num_extra; n++)
+        encode_lavc_set_metadata(ctx->extra[n], metadata);
+
     pthread_mutex_lock(&ctx->lock);
 
     if (ctx->options->copy_metadata) {
@@ -211,6 +362,20 @@ bool encode_lavc_free(struct encode_lavc_context *ctx)
 
     struct encode_priv *p = ctx->priv;
 
+    for (int n = 0; n < ctx->num_extra; n++)
+        res &= encode_lavc_free(ctx->extra[n]);
+
+    // All encoders have been flushed and destroyed at this point, so this
+    // only waits until the remaining packets are written.
+    if (p->mux_thread_valid) {
+        pthread_mutex_lock(&ctx->lock);
+        p->mux_terminate = true;
+        pthread_cond_broadcast(&p->mux_wakeup);
+        pthread_mutex_unlock(&ctx->lock);
+        pthread_join(p->mux_thread, NULL);
+        p->mux_thread_valid = false;
+    }
+
     if (!p->failed && !p->header_written) {
         MP_FATAL(p, "no data written to target file\n");
         p->failed = true;
@@ -234,14 +399,54 @@ bool encode_lavc_free(struct encode_lavc_context *ctx)
 
     avformat_free_context(p->muxer);
 
-    res = !p->failed;
+    res &= !p->failed;
 
+    pthread_cond_destroy(&p->mux_wakeup);
     pthread_mutex_destroy(&ctx->lock);
     talloc_free(ctx);
 
     return res;
 }
 
+static void *mux_thread(void *ptr)
+{
+    struct encode_lavc_context *ctx = ptr;
+    struct encode_priv *p = ctx->priv;
+
+    mpthread_set_name("encode-mux");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (1) {
+        if (!p->num_mux_queue) {
+            if (p->mux_terminate)
+                break;
+            pthread_cond_wait(&p->mux_wakeup, &ctx->lock);
+            continue;
+        }
+
+        AVPacket *pkt = p->mux_queue[0];
+        MP_TARRAY_REMOVE_AT(p->mux_queue, p->num_mux_queue, 0);
+        pthread_cond_broadcast(&p->mux_wakeup);
+        bool failed = p->failed;
+        pthread_mutex_unlock(&ctx->lock);
+
+        // Write without holding the lock, so the encoders can continue to
+        // queue packets. libavformat interleaves them by timestamp.
+        int r = failed ? 0 : av_interleaved_write_frame(p->muxer, pkt);
+        int64_t size = p->muxer->pb ? avio_tell(p->muxer->pb) : 0;
+        av_packet_free(&pkt);
+
+        pthread_mutex_lock(&ctx->lock);
+        if (r < 0) {
+            MP_ERR(p, "Writing packet failed.\n");
+            p->failed = true;
+        }
+        p->out_size = size;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
 // called locked
 static void maybe_init_muxer(struct encode_lavc_context *ctx)
 {
@@ -296,6 +501,13 @@ static void maybe_init_muxer(struct encode_lavc_context *ctx)
 
     p->header_written = true;
 
+    if (ctx->options->queue_frames > 0) {
+        p->mux_thread_valid =
+            !pthread_create(&p->mux_thread, NULL, mux_thread, ctx);
+        if (!p->mux_thread_valid)
+            MP_WARN(p, "Could not create muxer thread, muxing synchronously.\n");
+    }
+
     for (int n = 0; n < p->num_streams; n++) {
         struct mux_stream *s = p->streams[n];
 
@@ -329,6 +541,9 @@ void encode_lavc_expect_stream(struct encode_lavc_context *ctx,
 {
     struct encode_priv *p = ctx->priv;
 
+    for (int n = 0; n < ctx->num_extra; n++)
+        encode_lavc_expect_stream(ctx->extra[n], type);
+
     pthread_mutex_lock(&ctx->lock);
 
     enum AVMediaType codec_type = mp_to_av_stream_type(type);
@@ -443,7 +658,17 @@ static void encode_lavc_add_packet(struct mux_stream *dst, AVPacket *pkt)
         break;
     }
 
-    if (av_interleaved_write_frame(p->muxer, pkt) < 0) {
+    if (p->mux_thread_valid) {
+        while (p->num_mux_queue >= MUX_QUEUE_MAX && !p->failed)
+            pthread_cond_wait(&p->mux_wakeup, &ctx->lock);
+        if (p->failed)
+            goto done;
+        AVPacket *qpkt = av_packet_alloc();
+        MP_HANDLE_OOM(qpkt);
+        av_packet_move_ref(qpkt, pkt);
+        MP_TARRAY_APPEND(p, p->mux_queue, p->num_mux_queue, qpkt);
+        pthread_cond_broadcast(&p->mux_wakeup);
+    } else if (av_interleaved_write_frame(p->muxer, pkt) < 0) {
         MP_ERR(p, "Writing packet failed.\n");
         p->failed = true;
     }
@@ -697,7 +922,11 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx,
     }
 
     minutes = (now - p->t0) / 60.0 * (1 - f) / f;
-    megabytes = p->muxer->pb ? (avio_size(p->muxer->pb) / 1048576.0 / f) : 0;
+    if (p->mux_thread_valid) {
+        megabytes = p->out_size / 1048576.0 / f;
+    } else {
+        megabytes = p->muxer->pb ? (avio_size(p->muxer->pb) / 1048576.0 / f) : 0;
+    }
     fps = p->frames / (now - p->t0);
     x = p->audioseconds / (now - p->t0);
     if (p->frames) {
@@ -724,12 +953,27 @@ bool encode_lavc_didfail(struct encode_lavc_context *ctx)
     pthread_mutex_lock(&ctx->lock);
     bool fail = ctx->priv->failed;
     pthread_mutex_unlock(&ctx->lock);
+    for (int n = 0; n < ctx->num_extra; n++)
+        fail |= encode_lavc_didfail(ctx->extra[n]);
     return fail;
 }
 
 static void encoder_destroy(void *ptr)
 {
     struct encoder_context *p = ptr;
+    struct encoder_queue *q = p->queue;
+
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        q->terminate = true;
+        pthread_cond_broadcast(&q->wakeup);
+        pthread_mutex_unlock(&q->lock);
+        pthread_join(q->thread, NULL);
+        for (int n = 0; n < q->num_frames; n++)
+            av_frame_free(&q->frames[n]);
+        pthread_cond_destroy(&q->wakeup);
+        pthread_mutex_destroy(&q->lock);
+    }
 
     avcodec_free_context(&p->encoder);
     free_stream(p->twopass_bytebuffer);
@@ -856,6 +1100,95 @@ static void encoder_2pass_prepare(struct encoder_context *p)
     talloc_free(filename);
 }
 
+static bool encode_frame(struct encoder_context *p, AVFrame *frame)
+{
+    int status = avcodec_send_frame(p->encoder, frame);
+    if (status < 0) {
+        if (frame && status == AVERROR_EOF)
+            MP_ERR(p, "new data after sending EOF to encoder\n");
+        goto fail;
+    }
+
+    for (;;) {
+        AVPacket packet = {0};
+        av_init_packet(&packet);
+
+        status = avcodec_receive_packet(p->encoder, &packet);
+        if (status == AVERROR(EAGAIN))
+            break;
+        if (status < 0 && status != AVERROR_EOF)
+            goto fail;
+
+        if (p->twopass_bytebuffer && p->encoder->stats_out) {
+            stream_write_buffer(p->twopass_bytebuffer, p->encoder->stats_out,
+                                strlen(p->encoder->stats_out));
+        }
+
+        if (status == AVERROR_EOF)
+            break;
+
+        encode_lavc_add_packet(p->mux_stream, &packet);
+    }
+
+    return true;
+
+fail:
+    MP_ERR(p, "error encoding at %s\n",
+           frame ? av_ts2timestr(frame->pts, &p->encoder->time_base) : "EOF");
+    return false;
+}
+
+static void *encoder_thread(void *ptr)
+{
+    struct encoder_context *p = ptr;
+    struct encoder_queue *q = p->queue;
+
+    mpthread_set_name(p->type == STREAM_VIDEO ? "encode-video" : "encode-audio");
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->terminate) {
+        if (!q->num_frames) {
+            pthread_cond_wait(&q->wakeup, &q->lock);
+            continue;
+        }
+
+        AVFrame *frame = q->frames[0];
+        MP_TARRAY_REMOVE_AT(q->frames, q->num_frames, 0);
+        q->busy = true;
+        pthread_cond_broadcast(&q->wakeup);
+        pthread_mutex_unlock(&q->lock);
+
+        bool ok = encode_frame(p, frame);
+        av_frame_free(&frame);
+
+        pthread_mutex_lock(&q->lock);
+        q->busy = false;
+        q->failed |= !ok;
+        pthread_cond_broadcast(&q->wakeup);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+// Let encoding run in its own thread, so the AO or VO thread that calls
+// encoder_encode() (and the other stream's encoder) doesn't wait for it. On
+// failure, encoding is done synchronously.
+static void start_encoder_thread(struct encoder_context *p)
+{
+    struct encoder_queue *q = talloc_zero(p, struct encoder_queue);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wakeup, NULL);
+    p->queue = q;
+
+    if (pthread_create(&q->thread, NULL, encoder_thread, p)) {
+        MP_WARN(p, "Could not create encoder thread, encoding synchronously.\n");
+        pthread_cond_destroy(&q->wakeup);
+        pthread_mutex_destroy(&q->lock);
+        p->queue = NULL;
+        talloc_free(q);
+    }
+}
+
 bool encoder_init_codec_and_muxer(struct encoder_context *p,
                                   void (*on_ready)(void *ctx), void *ctx)
 {
@@ -914,6 +1247,9 @@ bool encoder_init_codec_and_muxer(struct encoder_context *p,
     if (!p->mux_stream)
         goto fail;
 
+    if (p->options->queue_frames > 0)
+        start_encoder_thread(p);
+
     return true;
 
 fail:
@@ -923,40 +1259,27 @@ fail:
 
 bool encoder_encode(struct encoder_context *p, AVFrame *frame)
 {
-    int status = avcodec_send_frame(p->encoder, frame);
-    if (status < 0) {
-        if (frame && status == AVERROR_EOF)
-            MP_ERR(p, "new data after sending EOF to encoder\n");
-        goto fail;
-    }
-
-    for (;;) {
-        AVPacket packet = {0};
-        av_init_packet(&packet);
-
-        status = avcodec_receive_packet(p->encoder, &packet);
-        if (status == AVERROR(EAGAIN))
-            break;
-        if (status < 0 && status != AVERROR_EOF)
-            goto fail;
-
-        if (p->twopass_bytebuffer && p->encoder->stats_out) {
-            stream_write_buffer(p->twopass_bytebuffer, p->encoder->stats_out,
-                                strlen(p->encoder->stats_out));
-        }
-
-        if (status == AVERROR_EOF)
-            break;
-
-        encode_lavc_add_packet(p->mux_stream, &packet);
+    struct encoder_queue *q = p->queue;
+    if (!q)
+        return encode_frame(p, frame);
+
+    AVFrame *ref = NULL;
+    if (frame) {
+        ref = av_frame_clone(frame);
+        MP_HANDLE_OOM(ref);
     }
 
-    return true;
-
-fail:
-    MP_ERR(p, "error encoding at %s\n",
-           frame ? av_ts2timestr(frame->pts, &p->encoder->time_base) : "EOF");
-    return false;
+    pthread_mutex_lock(&q->lock);
+    while (q->num_frames >= p->options->queue_frames)
+        pthread_cond_wait(&q->wakeup, &q->lock);
+    MP_TARRAY_APPEND(q, q->frames, q->num_frames, ref);
+    pthread_cond_broadcast(&q->wakeup);
+    // Flushing: wait until the encoder has output everything.
+    while (!frame && (q->num_frames || q->busy))
+        pthread_cond_wait(&q->wakeup, &q->lock);
+    bool ok = !q->failed;
+    pthread_mutex_unlock(&q->lock);
+    return ok;
 }
 
 double encoder_get_offset(struct encoder_context *p)
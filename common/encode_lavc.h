@@ -44,6 +44,16 @@ struct encode_lavc_context {
     AVOutputFormat *oformat;
     const char *filename;
 
+    // Additional outputs (--oextra). Each has its own muxer and encoders, and
+    // ao_lavc/vo_lavc send the same frames to all of them. Only set on the
+    // main context.
+    struct encode_lavc_context **extra;
+    int num_extra;
+
+    // Scale video to this size for this output (0 if unset, -1 to keep the
+    // aspect ratio).
+    int scale_w, scale_h;
+
     // All entry points must be guarded with the lock. Functions called by
     // the playback core lock this automatically, but ao_lavc.c and vo_lavc.c
     // must lock manually before accessing state.
@@ -84,6 +94,9 @@ struct encoder_context {
     struct mux_stream *mux_stream;
 
     struct stream *twopass_bytebuffer;
+
+    // Frames waiting for the encoder thread (NULL if encoding synchronously).
+    struct encoder_queue *queue;
 };
 
 // Free with talloc_free(). (Keep in mind actual deinitialization requires
@@ -103,6 +116,10 @@ bool encoder_init_codec_and_muxer(struct encoder_context *p,
                                   void (*on_ready)(void *ctx), void *ctx);
 
 // Encode the frame and write the packet. frame is ref'ed as need.
+// With --oqueue-frames, this only queues the frame for the encoder thread, and
+// blocks only if the queue is full. Passing frame==NULL (flushing) waits until
+// all queued frames have been encoded. Returns false if encoding failed (for
+// queued frames, this may be reported on a later call).
 bool encoder_encode(struct encoder_context *p, AVFrame *frame);
 
 // Return muxer timebase (only available after on_ready() has been called).
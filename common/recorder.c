@@ -16,6 +16,7 @@
  */
 
 #include <math.h>
+#include <pthread.h>
 
 #include <libavformat/avformat.h>
 
@@ -23,8 +24,12 @@
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "demux/packet.h"
 #include "demux/stheader.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "osdep/threads.h"
 
 #include "recorder.h"
 
@@ -37,9 +42,36 @@
 // Keyframe flags can trigger this earlier.
 #define QUEUE_MIN_PACKETS 16
 
+enum {
+    OVERFLOW_DROP,
+    OVERFLOW_ABORT,
+};
+
+struct recorder_opts {
+    int64_t queue_size;
+    int overflow;
+};
+
+#define OPT_BASE_STRUCT struct recorder_opts
+const struct m_sub_options recorder_conf = {
+    .opts = (const struct m_option[]) {
+        {"record-queue-size", OPT_BYTE_SIZE(queue_size),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
+        {"record-queue-overflow", OPT_CHOICE(overflow,
+            {"drop", OVERFLOW_DROP}, {"abort", OVERFLOW_ABORT})},
+        {0}
+    },
+    .size = sizeof(struct recorder_opts),
+    .defaults = &(const struct recorder_opts){
+        .queue_size = 32 * 1024 * 1024,
+    },
+};
+
 struct mp_recorder {
     struct mpv_global *global;
     struct mp_log *log;
+    struct recorder_opts *opts;
+    struct stats_ctx *stats;
 
     struct mp_recorder_sink **streams;
     int num_streams;
@@ -57,6 +89,26 @@ struct mp_recorder {
     double rebase_ts;
 
     AVFormatContext *mux;
+
+    // Writer thread (only with --record-queue-size > 0). While it runs, only
+    // it accesses mux. Packets are references to the demuxer's packet data.
+    bool thread_valid;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;          // signaled on queue changes
+    AVPacket **queue;               // packets to write, in FIFO order
+    int num_queue;
+    int64_t queue_bytes;
+    bool terminate;
+
+    bool failed;                    // queue overflowed with overflow=abort
+    bool overflow_warning;
+
+    // Statistics (written by the feeding thread only).
+    int64_t num_written;
+    int64_t num_dropped;
+    int max_queue;
+    int64_t max_queue_bytes;
 };
 
 struct mp_recorder_sink {
@@ -66,6 +118,7 @@ struct mp_recorder_sink {
     double max_out_pts;
     bool discont;
     bool proper_eof;
+    bool drop_until_keyframe;       // after queue overflow
     struct demux_packet **packets;
     int num_packets;
 };
@@ -110,6 +163,93 @@ static int add_stream(struct mp_recorder *priv, struct sh_stream *sh)
     return 0;
 }
 
+static void write_packet(struct mp_recorder *priv, AVPacket *pkt)
+{
+    stats_time_start(priv->stats, "write");
+    if (av_interleaved_write_frame(priv->mux, pkt) < 0)
+        MP_ERR(priv, "Failed writing packet.\n");
+    stats_time_end(priv->stats, "write");
+    av_packet_free(&pkt);
+}
+
+static void *writer_thread(void *p)
+{
+    struct mp_recorder *priv = p;
+
+    mpthread_set_name("recorder");
+    stats_register_thread_cputime(priv->stats, "thread");
+
+    pthread_mutex_lock(&priv->lock);
+    while (1) {
+        if (!priv->num_queue) {
+            if (priv->terminate)
+                break;
+            pthread_cond_wait(&priv->wakeup, &priv->lock);
+            continue;
+        }
+
+        AVPacket *pkt = priv->queue[0];
+        MP_TARRAY_REMOVE_AT(priv->queue, priv->num_queue, 0);
+        priv->queue_bytes -= pkt->size;
+        stats_size_value(priv->stats, "queue-bytes", priv->queue_bytes);
+        pthread_mutex_unlock(&priv->lock);
+
+        write_packet(priv, pkt);
+
+        pthread_mutex_lock(&priv->lock);
+    }
+    pthread_mutex_unlock(&priv->lock);
+
+    stats_unregister_thread(priv->stats, "thread");
+    return NULL;
+}
+
+// Write pkt, or queue it for the writer thread. Takes ownership of pkt.
+// Returns false (and frees pkt) if the queue is full.
+static bool queue_packet(struct mp_recorder *priv, AVPacket *pkt)
+{
+    if (!priv->thread_valid) {
+        write_packet(priv, pkt);
+        priv->num_written++;
+        return true;
+    }
+
+    pthread_mutex_lock(&priv->lock);
+    // A single packet larger than the queue is still accepted.
+    bool full = priv->num_queue &&
+                priv->queue_bytes + pkt->size > priv->opts->queue_size;
+    if (!full) {
+        MP_TARRAY_APPEND(priv, priv->queue, priv->num_queue, pkt);
+        priv->queue_bytes += pkt->size;
+        priv->max_queue = MPMAX(priv->max_queue, priv->num_queue);
+        priv->max_queue_bytes = MPMAX(priv->max_queue_bytes, priv->queue_bytes);
+        stats_size_value(priv->stats, "queue-bytes", priv->queue_bytes);
+        pthread_cond_broadcast(&priv->wakeup);
+    }
+    pthread_mutex_unlock(&priv->lock);
+
+    if (full) {
+        av_packet_free(&pkt);
+        return false;
+    }
+    priv->num_written++;
+    return true;
+}
+
+static void stop_thread(struct mp_recorder *priv)
+{
+    if (!priv->thread_valid)
+        return;
+
+    pthread_mutex_lock(&priv->lock);
+    priv->terminate = true;
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+
+    pthread_join(priv->thread, NULL);
+    priv->thread_valid = false;
+}
+
 struct mp_recorder *mp_recorder_create(struct mpv_global *global,
                                        const char *target_file,
                                        struct sh_stream **streams,
@@ -119,6 +259,10 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
 
     priv->global = global;
     priv->log = mp_log_new(priv, global->log, "recorder");
+    priv->opts = mp_get_config_group(priv, global, &recorder_conf);
+    priv->stats = stats_ctx_create(priv, global, "recorder");
+    pthread_mutex_init(&priv->lock, NULL);
+    pthread_cond_init(&priv->wakeup, NULL);
 
     if (!num_streams) {
         MP_ERR(priv, "No streams.\n");
@@ -163,6 +307,13 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
     priv->opened = true;
     priv->muxing_from_start = true;
 
+    if (priv->opts->queue_size > 0) {
+        priv->thread_valid =
+            !pthread_create(&priv->thread, NULL, writer_thread, priv);
+        if (!priv->thread_valid)
+            MP_WARN(priv, "Could not start writer thread.\n");
+    }
+
     priv->base_ts = MP_NOPTS_VALUE;
     priv->rebase_ts = 0;
 
@@ -193,6 +344,17 @@ static void mux_packet(struct mp_recorder_sink *rst,
     struct mp_recorder *priv = rst->owner;
     struct demux_packet mpkt = *pkt;
 
+    if (priv->failed)
+        return;
+
+    if (rst->drop_until_keyframe) {
+        if (!pkt->keyframe) {
+            priv->num_dropped++;
+            return;
+        }
+        rst->drop_until_keyframe = false;
+    }
+
     double diff = priv->rebase_ts - priv->base_ts;
     mpkt.pts = MP_ADD_PTS(mpkt.pts, diff);
     mpkt.dts = MP_ADD_PTS(mpkt.dts, diff);
@@ -207,14 +369,29 @@ static void mux_packet(struct mp_recorder_sink *rst,
     if (avpkt.duration < 0 && rst->sh->type != STREAM_SUB)
         avpkt.duration = 0;
 
+    // New reference to the packet data (not a copy).
     AVPacket *new_packet = av_packet_clone(&avpkt);
     if (!new_packet) {
         MP_ERR(priv, "Failed to allocate packet.\n");
         return;
     }
 
-    if (av_interleaved_write_frame(priv->mux, new_packet) < 0)
-        MP_ERR(priv, "Failed writing packet.\n");
+    if (!queue_packet(priv, new_packet)) {
+        priv->num_dropped++;
+        stats_event(priv->stats, "dropped");
+        if (priv->opts->overflow == OVERFLOW_ABORT) {
+            MP_ERR(priv, "Writing can't keep up (queue full). Stopping "
+                   "recording.\n");
+            priv->failed = true;
+        } else {
+            if (!priv->overflow_warning) {
+                MP_WARN(priv, "Writing can't keep up (queue full). Dropping "
+                        "packets, the output will have gaps.\n");
+                priv->overflow_warning = true;
+            }
+            rst->drop_until_keyframe = true;
+        }
+    }
 }
 
 // Write all packets that currently can be written.
@@ -294,8 +471,18 @@ void mp_recorder_destroy(struct mp_recorder *priv)
             mux_packets(rst, true);
         }
 
+        stop_thread(priv);
+
         if (av_write_trailer(priv->mux) < 0)
             MP_ERR(priv, "Writing trailer failed.\n");
+
+        MP_VERBOSE(priv, "Wrote %"PRId64" packets, maximum queue %d packets "
+                   "(%"PRId64" bytes).\n", priv->num_written, priv->max_queue,
+                   priv->max_queue_bytes);
+        if (priv->num_dropped) {
+            MP_WARN(priv, "%"PRId64" packets were dropped because writing "
+                    "was too slow.\n", priv->num_dropped);
+        }
     }
 
     if (priv->mux) {
@@ -306,6 +493,8 @@ void mp_recorder_destroy(struct mp_recorder *priv)
     }
 
     flush_packets(priv);
+    pthread_cond_destroy(&priv->wakeup);
+    pthread_mutex_destroy(&priv->lock);
     talloc_free(priv);
 }
 
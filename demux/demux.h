@@ -177,6 +177,7 @@ struct demuxer_params {
     bstr init_fragment;
     bool skip_lavf_probing;
     bool stream_record; // if true, enable stream recording if option is set
+    bool keyframe_index; // if true, set sh_stream.keyframes if possible
     int stream_flags;
     struct stream *external_stream; // if set, use this, don't open or close streams
     // result
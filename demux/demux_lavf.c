@@ -655,6 +655,26 @@ static int dict_get_decimal(AVDictionary *dict, const char *entry, int def)
     return def;
 }
 
+static void get_index_keyframes(struct sh_stream *sh, AVStream *st)
+{
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    int num = avformat_index_get_entries_count(st);
+#else
+    int num = st->nb_index_entries;
+#endif
+    for (int n = 0; n < num; n++) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+        const AVIndexEntry *e = avformat_index_get_entry(st, n);
+#else
+        const AVIndexEntry *e = &st->index_entries[n];
+#endif
+        if (!(e->flags & AVINDEX_KEYFRAME) || e->timestamp == AV_NOPTS_VALUE)
+            continue;
+        double pts = mp_pts_from_av(e->timestamp, &st->time_base);
+        MP_TARRAY_APPEND(sh, sh->keyframes, sh->num_keyframes, pts);
+    }
+}
+
 static void handle_new_stream(demuxer_t *demuxer, int i)
 {
     lavf_priv_t *priv = demuxer->priv;
@@ -810,6 +830,9 @@ static void handle_new_stream(demuxer_t *demuxer, int i)
         sh->hls_bitrate = dict_get_decimal(st->metadata, "variant_bitrate", 0);
         sh->missing_timestamps = !!(priv->avif_flags & AVFMT_NOTIMESTAMPS);
         mp_tags_copy_from_av_dictionary(sh->tags, st->metadata);
+        if (sh->type == STREAM_VIDEO && demuxer->params &&
+            demuxer->params->keyframe_index)
+            get_index_keyframes(sh, st);
         demux_add_sh_stream(demuxer, sh);
 
         // Unfortunately, there is no better way to detect PCM codecs, other
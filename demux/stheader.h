@@ -57,6 +57,12 @@ struct sh_stream {
 
     double seek_preroll;
 
+    // Timestamps of the keyframes listed in the file's index, in increasing
+    // order (only set by some demuxers, only on opening, and only if
+    // demuxer_params.keyframe_index was set).
+    double *keyframes;
+    int num_keyframes;
+
     // stream is a picture (such as album art)
     struct demux_packet *attached_picture;
 
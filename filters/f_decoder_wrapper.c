@@ -58,6 +58,8 @@ struct dec_queue_opts {
     int64_t max_bytes;
     int64_t max_samples;
     double max_duration;
+    int adaptive;
+    double underrun_prob;
 };
 
 #define OPT_BASE_STRUCT struct dec_queue_opts
@@ -67,6 +69,8 @@ static const struct m_option dec_queue_opts_list[] = {
     {"max-secs", OPT_DOUBLE(max_duration), M_RANGE(0, DBL_MAX)},
     {"max-bytes", OPT_BYTE_SIZE(max_bytes), M_RANGE(0, M_MAX_MEM_BYTES)},
     {"max-samples", OPT_INT64(max_samples), M_RANGE(0, DBL_MAX)},
+    {"adaptive", OPT_FLAG(adaptive)},
+    {"underrun-probability", OPT_DOUBLE(underrun_prob), M_RANGE(1e-9, 0.5)},
     {0}
 };
 
@@ -78,6 +82,7 @@ static const struct m_sub_options vdec_queue_conf = {
         .max_bytes = 512 * 1024 * 1024,
         .max_samples = 50,
         .max_duration = 2,
+        .underrun_prob = 0.001,
     },
 };
 
@@ -89,6 +94,7 @@ static const struct m_sub_options adec_queue_conf = {
         .max_bytes = 1 * 1024 * 1024,
         .max_samples = 48000,
         .max_duration = 1,
+        .underrun_prob = 0.001,
     },
 };
 
@@ -210,6 +216,16 @@ struct priv {
 
     int play_dir;
 
+    // Decoder time measurement for the adaptive queue (only with a queue).
+    int64_t dec_run_start;      // start of the current decoder thread run
+    int64_t dec_busy_time;      // time spent decoding since the last frame
+    double last_frame_pts;
+    int64_t jitter_frames;
+
+    // The output queue had frames since the last reset. Only then an empty
+    // queue means that the consumer is waiting for the decoder.
+    bool queue_filled;
+
     // --- The following fields can be accessed only from the mp_decoder_wrapper
     //     user thread.
     struct mp_decoder_wrapper public;
@@ -218,6 +234,7 @@ struct priv {
     struct mp_async_queue *queue; // decoded frame output queue
     struct mp_dispatch_queue *dec_dispatch; // non-NULL if decoding thread used
     bool dec_thread_lock; // debugging (esp. for no-thread case)
+    bool dec_stats;       // dec_root_filter has stats enabled (decoder thread)
     pthread_t dec_thread;
     bool dec_thread_valid;
     pthread_mutex_t cache_lock;
@@ -230,6 +247,10 @@ struct priv {
     bool pts_reset;
     int attempt_framedrops; // try dropping this many frames
     int dropped_frames; // total frames _probably_ dropped
+    double decode_mean, decode_var; // decode time per frame (seconds)
+    double frame_duration;  // average media duration of a frame
+    double queue_target;    // adaptive queue duration (0 if not computed yet)
+    int64_t decode_hist[MP_DECODER_QUEUE_HIST_BUCKETS];
 };
 
 static int decoder_list_opt(struct mp_log *log, const m_option_t *opt,
@@ -324,6 +345,9 @@ static void decf_reset(struct mp_filter *f)
 
     p->pts = MP_NOPTS_VALUE;
     p->last_format = p->fixed_format = (struct mp_image_params){0};
+    p->last_frame_pts = MP_NOPTS_VALUE;
+    p->dec_busy_time = 0;
+    p->queue_filled = false;
 
     pthread_mutex_lock(&p->cache_lock);
     p->pts_reset = false;
@@ -508,6 +532,29 @@ int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d)
     return res;
 }
 
+void mp_decoder_wrapper_get_queue_state(struct mp_decoder_wrapper *d,
+                                        struct mp_decoder_queue_state *s)
+{
+    struct priv *p = d->f->priv;
+    *s = (struct mp_decoder_queue_state){0};
+    if (!p->queue)
+        return;
+
+    s->enabled = true;
+    s->adaptive = p->queue_opts->adaptive;
+    s->frames = mp_async_queue_get_frames(p->queue);
+    s->samples = mp_async_queue_get_samples(p->queue);
+
+    pthread_mutex_lock(&p->cache_lock);
+    s->target_duration = p->queue_target;
+    s->decode_mean = p->decode_mean;
+    s->decode_stddev = sqrt(p->decode_var);
+    s->frame_duration = p->frame_duration;
+    for (int n = 0; n < MP_DECODER_QUEUE_HIST_BUCKETS; n++)
+        s->decode_hist[n] = p->decode_hist[n];
+    pthread_mutex_unlock(&p->cache_lock);
+}
+
 double mp_decoder_wrapper_get_container_fps(struct mp_decoder_wrapper *d)
 {
     struct priv *p = d->f->priv;
@@ -887,6 +934,16 @@ static void feed_packet(struct priv *p)
             framedrop_type = 1;
         pthread_mutex_unlock(&p->cache_lock);
 
+        // Without a queue, the player requesting framedrops is the only sign
+        // of it waiting for frames.
+        bool starved = framedrop_type == 1;
+        if (p->queue) {
+            int frames = mp_async_queue_get_frames(p->queue);
+            starved |= p->queue_filled && !frames;
+            p->queue_filled |= frames > 0;
+        }
+        p->decoder->control(p->decoder->f, VDCTRL_SET_STARVED, &starved);
+
         if (start_pts != MP_NOPTS_VALUE && packet && p->play_dir > 0 &&
             packet->pts < start_pts - .005 && !p->has_broken_packet_pts)
             framedrop_type = 2;
@@ -951,6 +1008,122 @@ static void enqueue_backward_frame(struct priv *p, struct mp_frame frame)
     p->reverse_queue_complete = eof;
 }
 
+static void update_queue_config(struct priv *p)
+{
+    if (!p->queue)
+        return;
+
+    struct mp_async_queue_config cfg = {
+        .max_bytes = p->queue_opts->max_bytes,
+        .sample_unit = AQUEUE_UNIT_SAMPLES,
+        .max_samples = p->queue_opts->max_samples,
+        .max_duration = p->queue_opts->max_duration,
+    };
+
+    // The adaptive size is still limited by the normal options.
+    pthread_mutex_lock(&p->cache_lock);
+    double target = p->queue_target;
+    pthread_mutex_unlock(&p->cache_lock);
+    if (p->queue_opts->adaptive && target > 0) {
+        if (cfg.max_duration > 0)
+            target = MPMIN(target, cfg.max_duration);
+        cfg.max_duration = target;
+    }
+
+    mp_async_queue_set_config(p->queue, cfg);
+}
+
+// Called on the decoder thread for each decoded frame if a queue is used.
+// Keeps a moving average and variance of the time the decoder needs per frame,
+// and for the adaptive queue, derives the queue duration needed to keep the
+// probability of an underrun below --vd-queue-underrun-probability.
+//
+// The queue level behaves like a random walk: each frame adds its media
+// duration d and removes its decode time t (mean m, variance v). With m < d,
+// the largest expected dip over any run of k frames is
+// max_k(k*(m - d) + z*sqrt(k*v)) = z^2*v / (4*(d - m)), where z is the
+// Gaussian quantile for the target probability (approximated by the Chernoff
+// bound exp(-z^2/2) = prob). If m >= d, the decoder can't keep up, and the
+// queue is made as large as allowed.
+static void update_queue_jitter(struct priv *p, struct mp_frame frame)
+{
+    int64_t now = mp_time_us();
+    double t = (p->dec_busy_time + (now - p->dec_run_start)) / 1e6;
+    p->dec_busy_time = 0;
+    p->dec_run_start = now;
+
+    double duration = 0;
+    double pts = mp_frame_get_pts(frame);
+    if (frame.type == MP_FRAME_AUDIO) {
+        duration = mp_aframe_duration(frame.data);
+    } else if (p->fps > 0) {
+        duration = 1.0 / p->fps;
+    } else if (pts != MP_NOPTS_VALUE && p->last_frame_pts != MP_NOPTS_VALUE) {
+        duration = pts - p->last_frame_pts;
+    }
+    p->last_frame_pts = pts;
+
+    int bucket = 0;
+    while (bucket < MP_DECODER_QUEUE_HIST_BUCKETS - 1 &&
+           t >= (1 << bucket) / 1000.0)
+        bucket++;
+
+    // Moving average/variance over roughly the last 64 frames.
+    const double a = 1.0 / 64;
+
+    pthread_mutex_lock(&p->cache_lock);
+    p->decode_hist[bucket] += 1;
+    if (!p->jitter_frames) {
+        p->decode_mean = t;
+        p->decode_var = 0;
+    } else {
+        double diff = t - p->decode_mean;
+        p->decode_mean += a * diff;
+        p->decode_var = (1 - a) * (p->decode_var + a * diff * diff);
+    }
+    if (duration > 0 && duration < 10) {
+        p->frame_duration = p->frame_duration > 0
+            ? p->frame_duration + a * (duration - p->frame_duration) : duration;
+    }
+    double m = p->decode_mean, v = p->decode_var, d = p->frame_duration;
+    double old_target = p->queue_target;
+    pthread_mutex_unlock(&p->cache_lock);
+
+    p->jitter_frames += 1;
+
+    if (!p->queue_opts->adaptive || p->jitter_frames < 32 ||
+        p->jitter_frames % 16 || !(d > 0))
+        return;
+
+    double z2 = -2 * log(p->queue_opts->underrun_prob);
+    double target;
+    if (m < d) {
+        // Also cover a single slow frame: m + z*sqrt(v) - d.
+        target = MPMAX(z2 * v / (4 * (d - m)), m + sqrt(z2 * v) - d);
+        // Plus the frame currently being consumed, and at least 2 frames.
+        target = MPMAX(target + d, 2 * d);
+    } else {
+        target = p->queue_opts->max_duration > 0
+                 ? p->queue_opts->max_duration : 60 * d;
+    }
+
+    // Grow immediately, shrink slowly.
+    if (old_target > 0 && target < old_target)
+        target = MPMAX(target, old_target * 0.9);
+
+    if (old_target > 0 && fabs(target - old_target) < d / 2)
+        return;
+
+    MP_DBG(p, "Adaptive queue: %.3fs (decode %.1fms +/- %.1fms, frame %.1fms)\n",
+           target, m * 1e3, sqrt(v) * 1e3, d * 1e3);
+
+    pthread_mutex_lock(&p->cache_lock);
+    p->queue_target = target;
+    pthread_mutex_unlock(&p->cache_lock);
+
+    update_queue_config(p);
+}
+
 static void read_frame(struct priv *p)
 {
     struct mp_pin *pin = p->decf->ppins[0];
@@ -1049,23 +1222,11 @@ static void read_frame(struct priv *p)
 
 output_frame:
     process_output_frame(p, frame);
+    if (p->queue && (frame.type == MP_FRAME_VIDEO || frame.type == MP_FRAME_AUDIO))
+        update_queue_jitter(p, frame);
     mp_pin_in_write(pin, frame);
 }
 
-static void update_queue_config(struct priv *p)
-{
-    if (!p->queue)
-        return;
-
-    struct mp_async_queue_config cfg = {
-        .max_bytes = p->queue_opts->max_bytes,
-        .sample_unit = AQUEUE_UNIT_SAMPLES,
-        .max_samples = p->queue_opts->max_samples,
-        .max_duration = p->queue_opts->max_duration,
-    };
-    mp_async_queue_set_config(p->queue, cfg);
-}
-
 static void decf_process(struct mp_filter *f)
 {
     struct priv *p = f->priv;
@@ -1090,7 +1251,16 @@ static void *dec_thread(void *ptr)
     mpthread_set_name(t_name);
 
     while (!p->request_terminate_dec_thread) {
+        // Follow --filter-stats of the graph the wrapper is part of.
+        bool stats = mp_filter_graph_get_stats(p->public.f);
+        if (stats != p->dec_stats) {
+            mp_filter_graph_set_stats(p->dec_root_filter, stats);
+            p->dec_stats = stats;
+        }
+
+        p->dec_run_start = mp_time_us();
         mp_filter_graph_run(p->dec_root_filter);
+        p->dec_busy_time += mp_time_us() - p->dec_run_start;
         update_cached_values(p);
         mp_dispatch_queue_process(p->dec_dispatch, INFINITY);
     }
@@ -1208,6 +1378,13 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
         p->dec_dispatch = mp_dispatch_create(p);
         p->dec_root_filter = mp_filter_create_root(public_f->global);
         mp_filter_graph_set_wakeup_cb(p->dec_root_filter, wakeup_dec_thread, p);
+        // Keep the stats entries separate from the main graph's and other
+        // decoder threads'.
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "filter-%s%d",
+                 p->header->type == STREAM_VIDEO ? "vdec" : "adec",
+                 p->header->index);
+        mp_filter_graph_set_stats_prefix(p->dec_root_filter, prefix);
         mp_dispatch_set_onlock_fn(p->dec_dispatch, onlock_dec_thread, p);
 
         struct mp_stream_info *sinfo = mp_filter_find_stream_info(parent);
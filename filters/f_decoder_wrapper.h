@@ -50,6 +50,27 @@ void mp_decoder_wrapper_get_desc(struct mp_decoder_wrapper *d,
 void mp_decoder_wrapper_set_frame_drops(struct mp_decoder_wrapper *d, int num);
 int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d);
 
+// Buckets of mp_decoder_queue_state.decode_hist: bucket n counts frames that
+// took less than 2^n milliseconds to decode (and not less than 2^(n-1)), the
+// last bucket counts all slower frames.
+#define MP_DECODER_QUEUE_HIST_BUCKETS 9
+
+struct mp_decoder_queue_state {
+    bool enabled;           // decoder thread and queue used (all fields 0 if not)
+    bool adaptive;          // --vd-queue-adaptive/--ad-queue-adaptive
+    int frames;             // frames currently in the queue
+    int64_t samples;        // same in samples (audio)
+    double target_duration; // current adaptive queue size in seconds, or 0
+    double decode_mean;     // average decoding time per frame (seconds)
+    double decode_stddev;   // standard deviation of that (decode jitter)
+    double frame_duration;  // average media duration of a frame (seconds)
+    int64_t decode_hist[MP_DECODER_QUEUE_HIST_BUCKETS];
+};
+
+// Thread-safe.
+void mp_decoder_wrapper_get_queue_state(struct mp_decoder_wrapper *d,
+                                        struct mp_decoder_queue_state *s);
+
 double mp_decoder_wrapper_get_container_fps(struct mp_decoder_wrapper *d);
 
 // Whether to prefer spdif wrapper over real decoders on next reinit.
@@ -77,6 +98,8 @@ enum dec_ctrl {
     VDCTRL_GET_BFRAMES,
     // framedrop mode: 0=none, 1=standard, 2=hrseek
     VDCTRL_SET_FRAMEDROP,
+    // bool: the consumer is waiting for frames (decoder can't keep up)
+    VDCTRL_SET_STARVED,
 };
 
 int mp_decoder_wrapper_control(struct mp_decoder_wrapper *d,
@@ -37,6 +37,8 @@
 #include "common/av_common.h"
 #include "common/tags.h"
 #include "common/msg.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 
 #include "audio/format.h"
 #include "audio/aframe.h"
@@ -50,9 +52,26 @@
 #include "filter_internal.h"
 #include "user_filters.h"
 
+struct lavfi_opts {
+    int threads;
+};
+
+#define OPT_BASE_STRUCT struct lavfi_opts
+
+const struct m_sub_options lavfi_conf = {
+    .opts = (const struct m_option[]){
+        {"lavfi-threads", OPT_CHOICE(threads, {"auto", 0}), M_RANGE(1, 64)},
+        {0}
+    },
+    .size = sizeof(OPT_BASE_STRUCT),
+};
+
+#undef OPT_BASE_STRUCT
+
 struct lavfi {
     struct mp_log *log;
     struct mp_filter *f;
+    struct m_config_cache *opts_cache;
 
     char *graph_string;
     char **graph_opts;
@@ -67,6 +86,7 @@ struct lavfi {
     bool initialized;
 
     bool warned_nospeed;
+    bool warned_copy;
 
     // Graph is draining to either handle format changes (if input format
     // changes for one pad, recreate the graph after draining all buffered
@@ -256,6 +276,13 @@ static void precreate_graph(struct lavfi *c, bool first_init)
     if (!c->graph)
         abort();
 
+    // Must be set before the first filter is added to the graph. User graph
+    // options (like "o=threads=N") are applied afterwards and take precedence.
+    m_config_cache_update(c->opts_cache);
+    struct lavfi_opts *opts = c->opts_cache->opts;
+    c->graph->nb_threads = opts->threads;
+    c->graph->thread_type = AVFILTER_THREAD_SLICE;
+
     if (mp_set_avopts(c->log, c->graph, c->graph_opts) < 0)
         goto error;
 
@@ -609,6 +636,17 @@ static bool feed_input_pads(struct lavfi *c)
             }
         }
 
+        if (pad->pending.type == MP_FRAME_VIDEO && !c->warned_copy) {
+            // mp_image_new_ref() copies images that are not refcounted.
+            struct mp_image *img = pad->pending.data;
+            if (!img->bufs[0] && !img->hwctx) {
+                MP_VERBOSE(c, "input image is not refcounted, copying\n");
+                c->warned_copy = true;
+            }
+        }
+
+        // This references the frame data, and av_buffersrc_add_frame() moves
+        // the reference into the graph, so no image data is copied.
         AVFrame *frame = mp_frame_to_av(pad->pending, &pad->timebase);
         bool eof = pad->pending.type == MP_FRAME_EOF;
 
@@ -693,6 +731,9 @@ static bool read_output_pads(struct lavfi *c)
 
         if (r >= 0) {
             mp_tags_copy_from_av_dictionary(pad->metadata, c->tmp_frame->metadata);
+            // Takes a new reference to the frame buffers. tmp_frame is unref'd
+            // before the frame is passed on, so downstream filters see them as
+            // writable if libavfilter does not keep a reference itself.
             struct mp_frame frame =
                 mp_frame_from_av(pad->type, c->tmp_frame, &pad->timebase);
             if (c->emulate_audio_pts && frame.type == MP_FRAME_AUDIO) {
@@ -829,6 +870,7 @@ static struct lavfi *lavfi_alloc(struct mp_filter *parent)
     c->f = f;
     c->log = f->log;
     c->public.f = f;
+    c->opts_cache = m_config_cache_alloc(c, f->global, &lavfi_conf);
     c->tmp_frame = av_frame_alloc();
     if (!c->tmp_frame)
         abort();
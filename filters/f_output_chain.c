@@ -337,7 +337,17 @@ void mp_output_chain_reset_harder(struct mp_output_chain *c)
 
 static void destroy(struct mp_filter *f)
 {
+    struct chain *p = f->priv;
+
     reset(f);
+
+    if (p->stream_info.aframe_pool) {
+        struct mp_aframe_pool_stats st;
+        mp_aframe_pool_get_stats(p->stream_info.aframe_pool, &st);
+        MP_VERBOSE(p, "audio buffer pool: %"PRId64" allocations, %"PRId64
+                   " new buffers (%"PRId64" KiB)\n", st.num_allocs,
+                   st.num_new, st.new_bytes / 1024);
+    }
 }
 
 static const struct mp_filter_info output_chain_filter = {
@@ -639,6 +649,12 @@ static void create_audio_things(struct chain *p)
 {
     p->frame_type = MP_FRAME_AUDIO;
 
+    // Let the audio filters share buffers, so that frame sizes varying across
+    // the chain can be served without new allocations.
+    p->stream_info.aframe_pool = mp_aframe_pool_create(p);
+
+    p->f->stream_info = &p->stream_info;
+
     struct mp_user_filter *f = create_wrapper_filter(p);
     f->name = "userspeed";
     f->f = mp_autoaspeed_create(f->wrapper);
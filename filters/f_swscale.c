@@ -117,6 +117,7 @@ static void process(struct mp_filter *f)
     mp_image_params_guess_csp(&dst->params);
 
     bool ok = mp_sws_scale(s->sws, dst, src) >= 0;
+    mp_filter_set_debug_info(f, s->sws->method);
 
     mp_frame_unref(&frame);
     frame = (struct mp_frame){MP_FRAME_VIDEO, dst};
@@ -305,7 +305,7 @@ struct mp_filter *mp_fixed_aframe_size_create(struct mp_filter *parent,
     struct fixed_aframe_size_priv *p = f->priv;
     p->samples = samples;
     p->pad_silence = pad_silence;
-    p->pool = mp_aframe_pool_create(p);
+    p->pool = mp_filter_get_aframe_pool(f);
 
     return f;
 }
@@ -1,9 +1,14 @@
 #include <math.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "audio/aframe.h"
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/stats.h"
+#include "misc/node.h"
 #include "osdep/atomic.h"
 #include "osdep/timer.h"
 #include "video/hwdec.h"
@@ -53,6 +58,9 @@ struct mp_pin {
     // This flag is for checking and enforcing this.
     bool within_conn;
 
+    // Set for the "private" pin of a pin pair (mp_filter.ppins[]).
+    bool is_private;
+
     // This is used for the final output mp_pin in connections only.
     bool data_requested;            // true if out wants new data
     struct mp_frame data;           // possibly buffered frame (MP_FRAME_NONE if
@@ -74,6 +82,12 @@ struct filter_runner {
     // If we're currently running the filter graph (for avoiding recursion).
     bool filtering;
 
+    // Collect mp_filter_internal.stats (see mp_filter_graph_set_stats()).
+    bool stats_enabled;
+    atomic_bool stats_enabled_shared; // same, for mp_filter_graph_get_stats()
+    struct stats_ctx *stats;
+    char *stats_prefix;
+
     // If set, recursive filtering was initiated through this pin.
     struct mp_pin *recursive;
 
@@ -110,13 +124,47 @@ struct mp_filter_internal {
     struct mp_filter *error_handler;
 
     char *name;
+    char *debug_info;
     bool high_priority;
 
     bool pending;
     bool async_pending;
     bool failed;
+
+    // Only updated if filter_runner.stats_enabled is set.
+    struct mp_filter_stats stats;
+    char stats_name[32];    // info->name (stat_entry names are max. 31 chars)
 };
 
+static int64_t thread_cpu_time_ns(void)
+{
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(_POSIX_THREAD_CPUTIME)
+    struct timespec tv;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tv) == 0)
+        return tv.tv_sec * (1000LL * 1000LL * 1000LL) + tv.tv_nsec;
+#endif
+    return 0;
+}
+
+// Like calling info->process, but account the time spent in it.
+static void process_with_stats(struct mp_filter *f)
+{
+    struct filter_runner *r = f->in->runner;
+    struct mp_filter_stats *st = &f->in->stats;
+    const char *name = f->in->stats_name;
+
+    stats_time_start(r->stats, name);
+    int64_t t0 = mp_time_us();
+    int64_t c0 = thread_cpu_time_ns();
+
+    f->in->info->process(f);
+
+    st->cpu_time_ns += thread_cpu_time_ns() - c0;
+    st->time_us += mp_time_us() - t0;
+    st->calls += 1;
+    stats_time_end(r->stats, name);
+}
+
 // Called when new work needs to be done on a pin belonging to the filter:
 //  - new data was requested
 //  - new data has been queued
@@ -255,8 +303,13 @@ bool mp_filter_graph_run(struct mp_filter *filter)
             break;
 
         next->in->pending = false;
-        if (next->in->info->process)
-            next->in->info->process(next);
+        if (next->in->info->process) {
+            if (r->stats_enabled) {
+                process_with_stats(next);
+            } else {
+                next->in->info->process(next);
+            }
+        }
 
         if (end_time && mp_time_us() >= end_time)
             mp_filter_graph_interrupt(r->root_filter);
@@ -298,6 +351,9 @@ bool mp_pin_in_write(struct mp_pin *p, struct mp_frame frame)
         return false;
     }
     assert(p->conn->data.type == MP_FRAME_NONE);
+    if (p->is_private && frame.type != MP_FRAME_EOF &&
+        p->owner->in->runner->stats_enabled)
+        p->owner->in->stats.frames_out += 1;
     p->conn->data = frame;
     p->conn->data_requested = false;
     add_pending_pin(p->conn);
@@ -338,6 +394,9 @@ struct mp_frame mp_pin_out_read(struct mp_pin *p)
         return MP_NO_FRAME;
     struct mp_frame res = p->data;
     p->data = MP_NO_FRAME;
+    if (p->is_private && res.type != MP_FRAME_EOF &&
+        p->owner->in->runner->stats_enabled)
+        p->owner->in->stats.frames_in += 1;
     return res;
 }
 
@@ -626,6 +685,7 @@ struct mp_pin *mp_filter_add_pin(struct mp_filter *f, enum mp_pin_dir dir,
         .owner = f,
         .other = p,
         .manual_connection = f,
+        .is_private = true,
     };
 
     MP_TARRAY_GROW(f, f->pins, f->num_pins);
@@ -682,6 +742,14 @@ struct mp_stream_info *mp_filter_find_stream_info(struct mp_filter *f)
     return NULL;
 }
 
+struct mp_aframe_pool *mp_filter_get_aframe_pool(struct mp_filter *f)
+{
+    struct mp_stream_info *info = mp_filter_find_stream_info(f);
+    if (info && info->aframe_pool)
+        return info->aframe_pool;
+    return mp_aframe_pool_create(f);
+}
+
 struct AVBufferRef *mp_filter_load_hwdec_device(struct mp_filter *f, int avtype)
 {
     struct mp_stream_info *info = mp_filter_find_stream_info(f);
@@ -727,6 +795,65 @@ void mp_filter_graph_set_max_run_time(struct mp_filter *f, double seconds)
     r->max_run_time = seconds;
 }
 
+void mp_filter_graph_set_stats(struct mp_filter *f, bool enable)
+{
+    struct filter_runner *r = f->in->runner;
+    assert(f == r->root_filter); // user is supposed to call this on root only
+    if (enable && !r->stats) {
+        r->stats = stats_ctx_create(r, r->global,
+                                    r->stats_prefix ? r->stats_prefix : "filter");
+    }
+    r->stats_enabled = enable;
+    atomic_store(&r->stats_enabled_shared, enable);
+}
+
+void mp_filter_graph_set_stats_prefix(struct mp_filter *f, const char *prefix)
+{
+    struct filter_runner *r = f->in->runner;
+    assert(f == r->root_filter); // user is supposed to call this on root only
+    assert(!r->stats);
+    talloc_free(r->stats_prefix);
+    r->stats_prefix = talloc_strdup(r, prefix);
+}
+
+bool mp_filter_graph_get_stats(struct mp_filter *f)
+{
+    return atomic_load(&f->in->runner->stats_enabled_shared);
+}
+
+void mp_filter_get_stats(struct mp_filter *f, struct mp_filter_stats *st)
+{
+    *st = f->in->stats;
+}
+
+// dst must be an initialized MPV_FORMAT_NODE_MAP.
+static void add_stats_node(struct mp_filter *f, struct mpv_node *dst)
+{
+    struct mp_filter_stats *st = &f->in->stats;
+
+    node_map_add_string(dst, "name", f->in->info->name);
+    node_map_add_int64(dst, "calls", st->calls);
+    node_map_add_double(dst, "time", st->time_us / 1e6);
+    node_map_add_double(dst, "cpu-time", st->cpu_time_ns / 1e9);
+    node_map_add_int64(dst, "frames-in", st->frames_in);
+    node_map_add_int64(dst, "frames-out", st->frames_out);
+
+    if (f->in->num_children) {
+        struct mpv_node *list = node_map_add(dst, "children",
+                                             MPV_FORMAT_NODE_ARRAY);
+        for (int n = 0; n < f->in->num_children; n++) {
+            struct mpv_node *sub = node_array_add(list, MPV_FORMAT_NODE_MAP);
+            add_stats_node(f->in->children[n], sub);
+        }
+    }
+}
+
+void mp_filter_stats_to_node(struct mp_filter *f, struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+    add_stats_node(f, dst);
+}
+
 void mp_filter_graph_interrupt(struct mp_filter *f)
 {
     struct filter_runner *r = f->in->runner;
@@ -799,6 +926,8 @@ struct mp_filter *mp_filter_create_with_params(struct mp_filter_params *params)
         .parent = params->parent,
         .runner = params->parent ? params->parent->in->runner : NULL,
     };
+    snprintf(f->in->stats_name, sizeof(f->in->stats_name), "%s",
+             params->info->name);
 
     if (!f->in->runner) {
         assert(params->global);
@@ -888,10 +1017,20 @@ static void dump_pin_state(struct mp_filter *f, struct mp_pin *pin)
         mp_frame_type_str(pin->data.type));
 }
 
+void mp_filter_set_debug_info(struct mp_filter *f, const char *text)
+{
+    if (!text || !f->in->debug_info || strcmp(text, f->in->debug_info) != 0) {
+        talloc_free(f->in->debug_info);
+        f->in->debug_info = talloc_strdup(f->in, text);
+    }
+}
+
 void mp_filter_dump_states(struct mp_filter *f)
 {
-    MP_WARN(f, "%s[%p] (%s[%p])\n", filt_name(f), f,
-            filt_name(f->in->parent), f->in->parent);
+    MP_WARN(f, "%s[%p] (%s[%p])%s%s\n", filt_name(f), f,
+            filt_name(f->in->parent), f->in->parent,
+            f->in->debug_info ? " " : "",
+            f->in->debug_info ? f->in->debug_info : "");
     for (int n = 0; n < f->num_pins; n++) {
         dump_pin_state(f, f->pins[n]);
         dump_pin_state(f, f->ppins[n]);
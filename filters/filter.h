@@ -403,11 +403,17 @@ struct mp_stream_info {
     struct osd_state *osd;
     bool rotate90;
     struct vo *dr_vo; // for calling vo_get_image()
+    struct mp_aframe_pool *aframe_pool; // shared by audio filters in the chain
 };
 
 // Search for a parent filter (including f) that has this set, and return it.
 struct mp_stream_info *mp_filter_find_stream_info(struct mp_filter *f);
 
+// Return the audio frame pool shared by the filter chain f is part of. If
+// there is none, create a pool owned by f. Must only be used from the filter
+// graph's thread.
+struct mp_aframe_pool *mp_filter_get_aframe_pool(struct mp_filter *f);
+
 struct AVBufferRef;
 struct AVBufferRef *mp_filter_load_hwdec_device(struct mp_filter *f, int avtype);
 
@@ -465,5 +471,39 @@ struct mp_filter *mp_filter_create_root(struct mpv_global *global);
 void mp_filter_graph_set_wakeup_cb(struct mp_filter *root,
                                    void (*wakeup_cb)(void *ctx), void *ctx);
 
+struct mp_filter_stats {
+    int64_t calls;          // number of process() calls
+    int64_t time_us;        // real time spent in process()
+    int64_t cpu_time_ns;    // thread CPU time spent in process()
+    int64_t frames_in;      // non-EOF frames read from its own pins
+    int64_t frames_out;     // non-EOF frames written to its own pins
+};
+
+// Enable or disable collecting mp_filter_stats for all filters in the graph.
+// The process() time is also reported via stats_ctx (with "filter/" prefix, one
+// entry per filter type). If disabled (the default), the only overhead is a
+// flag check per process() call and pin read/write.
+// Can be called on the root filter only.
+void mp_filter_graph_set_stats(struct mp_filter *root, bool enable);
+
+// Use a different stats_ctx prefix than "filter" for this graph, so its entries
+// can be told apart from those of other graphs. Must be called before stats are
+// enabled. Can be called on the root filter only.
+void mp_filter_graph_set_stats_prefix(struct mp_filter *root, const char *prefix);
+
+// Whether stats are enabled for the graph f belongs to. Thread-safe, so it can
+// be used to mirror the setting to a graph running on another thread.
+bool mp_filter_graph_get_stats(struct mp_filter *f);
+
+// Return the statistics collected for f so far. The counters are never reset.
+// Not thread-safe; call only from the filter graph's thread.
+void mp_filter_get_stats(struct mp_filter *f, struct mp_filter_stats *st);
+
+// Write the statistics of f and all its children (recursively) to dst, as
+// MPV_FORMAT_NODE_MAP. The tree mirrors mp_filter_dump_states(). Same thread
+// restrictions as mp_filter_get_stats().
+struct mpv_node;
+void mp_filter_stats_to_node(struct mp_filter *f, struct mpv_node *dst);
+
 // Debugging internal stuff.
 void mp_filter_dump_states(struct mp_filter *f);
@@ -27,6 +27,11 @@ void mp_filter_internal_mark_progress(struct mp_filter *f);
 // Must be called from f's process function.
 void mp_filter_internal_mark_failed(struct mp_filter *f);
 
+// Set a short text describing the filter's current internal state (such as
+// the conversion method chosen), which is shown by mp_filter_dump_states().
+// The text is copied. NULL clears it.
+void mp_filter_set_debug_info(struct mp_filter *f, const char *text);
+
 // If handler is not NULL, then if filter f errors, don't propagate the error
 // flag to its parent. Also invoke the handler's process() function, which is
 // supposed to use mp_filter_has_failed(f) to check any filters for which it has
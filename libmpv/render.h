@@ -138,11 +138,13 @@ extern "C" {
  * MPV_RENDER_PARAM_SW_STRIDE, MPV_RENDER_PARAM_SW_POINTER.
  *
  * This method of rendering is very slow, because everything, including color
- * conversion, scaling, and OSD rendering, is done on the CPU, single-threaded.
- * In particular, large video or display sizes, as well as presence of OSD or
- * subtitles can make it too slow for realtime. As with other software rendering
- * VOs, setting "sw-fast" may help. Enabling or disabling zimg may help,
- * depending on the platform.
+ * conversion, scaling, and OSD rendering, is done on the CPU. Conversion and
+ * OSD blending are split across multiple threads where possible. Still, large
+ * video or display sizes, as well as presence of OSD or subtitles can make it
+ * too slow for realtime. As with other software rendering VOs, setting
+ * "sw-fast" may help. Enabling or disabling zimg may help, depending on the
+ * platform. MPV_RENDER_PARAM_SW_DIRTY_RECTS can be used to reduce the cost of
+ * presenting the rendered surface.
  *
  * In addition, certain multimedia job creation measures like HDR may not work
  * properly, and will have to be manually handled by for example inserting
@@ -421,6 +423,23 @@ typedef enum mpv_render_param_type {
      * See MPV_RENDER_PARAM_SW_STRIDE for alignment requirements.
      */
     MPV_RENDER_PARAM_SW_POINTER = 20,
+    /**
+     * MPV_RENDER_API_TYPE_SW only: output of changed surface regions, optional.
+     * Valid for MPV_RENDER_API_TYPE_SW & mpv_render_context_render().
+     * Type: mpv_render_sw_dirty_rects*
+     *
+     * mpv always renders the entire target surface. If this parameter is set,
+     * mpv_render_context_render() writes a list of rectangles to it, outside
+     * of which the rendered surface is the same as the surface rendered by the
+     * previous mpv_render_context_render() call. This can be used to upload
+     * only the changed parts of the surface to the screen. If the API user
+     * renders to multiple buffers (e.g. double buffering), it needs to
+     * accumulate the rectangles of the calls since the buffer was last used.
+     *
+     * If there are more rectangles than fit into the array, they are merged.
+     * The rectangles can overlap. num_rects is 0 if nothing changed.
+     */
+    MPV_RENDER_PARAM_SW_DIRTY_RECTS = 21,
 } mpv_render_param_type;
 
 /**
@@ -468,6 +487,31 @@ typedef struct mpv_render_param {
 // See section "Software renderer"
 #define MPV_RENDER_API_TYPE_SW "sw"
 
+/**
+ * A rectangle in pixels on the target surface. x1 and y1 are exclusive.
+ */
+typedef struct mpv_render_sw_rect {
+    int x0, y0, x1, y1;
+} mpv_render_sw_rect;
+
+/**
+ * For MPV_RENDER_PARAM_SW_DIRTY_RECTS.
+ */
+typedef struct mpv_render_sw_dirty_rects {
+    /**
+     * Caller allocated array, with space for max_rects items.
+     */
+    mpv_render_sw_rect *rects;
+    /**
+     * Size of the rects array. Must be at least 1.
+     */
+    int max_rects;
+    /**
+     * Set by mpv_render_context_render() to the number of valid items in rects.
+     */
+    int num_rects;
+} mpv_render_sw_dirty_rects;
+
 /**
  * Flags used in mpv_render_frame_info.flags. Each value represents a bit in it.
  */
@@ -0,0 +1,108 @@
+/* Copyright (C) 2021 the mpv developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+#include "osdep/atomic.h"
+#include "ring.h"
+
+struct mp_ring {
+    uint8_t *buffer;
+    int size;
+
+    // Total number of bytes ever read/written. Only the consumer writes rpos,
+    // only the producer writes wpos. The difference is the buffered amount.
+    atomic_ullong rpos, wpos;
+};
+
+struct mp_ring *mp_ring_new(void *talloc_ctx, int size)
+{
+    assert(size > 0);
+    struct mp_ring *ringbuffer = talloc_zero(talloc_ctx, struct mp_ring);
+    *ringbuffer = (struct mp_ring){
+        .buffer = talloc_size(ringbuffer, size),
+        .size = size,
+        .rpos = ATOMIC_VAR_INIT(0),
+        .wpos = ATOMIC_VAR_INIT(0),
+    };
+    return ringbuffer;
+}
+
+static int buffered(unsigned long long rpos, unsigned long long wpos)
+{
+    return wpos - rpos;
+}
+
+int mp_ring_drain(struct mp_ring *buffer, int len)
+{
+    unsigned long long rpos = atomic_load(&buffer->rpos);
+    len = MPMIN(len, buffered(rpos, atomic_load(&buffer->wpos)));
+    atomic_store(&buffer->rpos, rpos + len);
+    return len;
+}
+
+int mp_ring_read(struct mp_ring *buffer, void *dest, int len)
+{
+    unsigned long long rpos = atomic_load(&buffer->rpos);
+    // Loading wpos orders the reads below after the producer's writes.
+    len = MPMIN(len, buffered(rpos, atomic_load(&buffer->wpos)));
+
+    int read_ptr = rpos % buffer->size;
+    int len1 = MPMIN(buffer->size - read_ptr, len);
+    int len2 = len - len1;
+
+    memcpy(dest, buffer->buffer + read_ptr, len1);
+    memcpy((uint8_t *)dest + len1, buffer->buffer, len2);
+
+    // Publishing rpos releases the space to the producer.
+    atomic_store(&buffer->rpos, rpos + len);
+    return len;
+}
+
+int mp_ring_write(struct mp_ring *buffer, const void *src, int len)
+{
+    unsigned long long wpos = atomic_load(&buffer->wpos);
+    int free = buffer->size - buffered(atomic_load(&buffer->rpos), wpos);
+    len = MPMIN(len, free);
+
+    int write_ptr = wpos % buffer->size;
+    int len1 = MPMIN(buffer->size - write_ptr, len);
+    int len2 = len - len1;
+
+    memcpy(buffer->buffer + write_ptr, src, len1);
+    memcpy(buffer->buffer, (const uint8_t *)src + len1, len2);
+
+    atomic_store(&buffer->wpos, wpos + len);
+    return len;
+}
+
+int mp_ring_buffered(struct mp_ring *buffer)
+{
+    unsigned long long rpos = atomic_load(&buffer->rpos);
+    return buffered(rpos, atomic_load(&buffer->wpos));
+}
+
+int mp_ring_available(struct mp_ring *buffer)
+{
+    return buffer->size - mp_ring_buffered(buffer);
+}
+
+int mp_ring_size(struct mp_ring *buffer)
+{
+    return buffer->size;
+}
@@ -0,0 +1,40 @@
+#ifndef MPV_MP_RING_H
+#define MPV_MP_RING_H
+
+#include <stdint.h>
+
+// Lock-free single-producer single-consumer byte ring buffer. One thread may
+// call the write functions while another thread calls the read functions at
+// the same time, without any locking. Functions marked as "producer" or
+// "consumer" must only ever be called by one thread at a time each.
+// Neither side blocks, allocates memory, or makes system calls, so the consumer
+// can be an audio driver's realtime callback.
+
+struct mp_ring;
+
+// Create a ring buffer that can hold up to size bytes. Free with talloc_free().
+struct mp_ring *mp_ring_new(void *talloc_ctx, int size);
+
+// (consumer) Copy up to len bytes into dest, and remove them from the buffer.
+// Returns the number of bytes read.
+int mp_ring_read(struct mp_ring *buffer, void *dest, int len);
+
+// (consumer) Remove up to len bytes without copying them. Returns the number of
+// bytes removed.
+int mp_ring_drain(struct mp_ring *buffer, int len);
+
+// (producer) Append up to len bytes from src. Returns the number of bytes
+// written, which is less than len if the buffer is full.
+int mp_ring_write(struct mp_ring *buffer, const void *src, int len);
+
+// Number of bytes that can be read. The consumer gets a lower bound, the
+// producer an upper bound, and other threads only an estimate.
+int mp_ring_buffered(struct mp_ring *buffer);
+
+// Number of bytes that can be written. The producer gets a lower bound.
+int mp_ring_available(struct mp_ring *buffer);
+
+// Capacity of the buffer in bytes.
+int mp_ring_size(struct mp_ring *buffer);
+
+#endif
@@ -42,6 +42,7 @@
 #include "video/csputils.h"
 #include "video/hwdec.h"
 #include "video/image_writer.h"
+#include "video/mp_image_pool.h"
 #include "sub/osd.h"
 #include "player/core.h"
 #include "player/command.h"
@@ -62,6 +63,7 @@ extern const struct m_sub_options stream_dvb_conf;
 extern const struct m_sub_options stream_lavf_conf;
 extern const struct m_sub_options sws_conf;
 extern const struct m_sub_options zimg_conf;
+extern const struct m_sub_options lavfi_conf;
 extern const struct m_sub_options drm_conf;
 extern const struct m_sub_options demux_rawaudio_conf;
 extern const struct m_sub_options demux_rawvideo_conf;
@@ -77,6 +79,7 @@ extern const struct m_sub_options ao_alsa_conf;
 
 extern const struct m_sub_options demux_conf;
 extern const struct m_sub_options demux_cache_conf;
+extern const struct m_sub_options recorder_conf;
 
 extern const struct m_obj_list vf_obj_list;
 extern const struct m_obj_list af_obj_list;
@@ -500,6 +503,7 @@ static const m_option_t mp_opts[] = {
     {"subs-with-matching-audio", OPT_FLAG(subs_with_matching_audio)},
 
     {"lavfi-complex", OPT_STRING(lavfi_complex), .flags = UPDATE_LAVFI_COMPLEX},
+    {"", OPT_SUBSTRUCT(lavfi_opts, lavfi_conf)},
 
     {"audio-display", OPT_CHOICE(audio_display, {"no", 0}, {"attachment", 1})},
 
@@ -626,6 +630,7 @@ static const m_option_t mp_opts[] = {
     {"replaygain-clip", OPT_FLAG(rgain_clip), .flags = UPDATE_VOL},
     {"replaygain-fallback", OPT_FLOAT(rgain_fallback), .flags = UPDATE_VOL,
         M_RANGE(-200, 60)},
+    {"replaygain-scan", OPT_FLAG(rgain_scan)},
     {"gapless-audio", OPT_CHOICE(gapless_audio,
         {"no", 0},
         {"yes", 1},
@@ -663,6 +668,8 @@ static const m_option_t mp_opts[] = {
 
     {"untimed", OPT_FLAG(untimed)},
 
+    {"filter-stats", OPT_FLAG(filter_stats)},
+
     {"stream-dump", OPT_STRING(stream_dump), .flags = M_OPT_FILE},
 
     {"stop-playback-on-init-failure", OPT_FLAG(stop_playback_on_init_failure)},
@@ -755,6 +762,9 @@ static const m_option_t mp_opts[] = {
     {"screenshot-directory", OPT_STRING(screenshot_directory),
         .flags = M_OPT_FILE},
     {"screenshot-sw", OPT_BOOL(screenshot_sw)},
+    {"screenshot-async", OPT_BOOL(screenshot_async)},
+    {"screenshot-queue-size", OPT_INT(screenshot_queue_size),
+        M_RANGE(1, 1000)},
 
     {"record-file", OPT_STRING(record_file), .flags = M_OPT_FILE,
         .deprecation_message = "use --stream-record or the dump-cache command"},
@@ -766,6 +776,7 @@ static const m_option_t mp_opts[] = {
     {"", OPT_SUBSTRUCT(vo, vo_sub_opts)},
     {"", OPT_SUBSTRUCT(demux_opts, demux_conf)},
     {"", OPT_SUBSTRUCT(demux_cache_opts, demux_cache_conf)},
+    {"", OPT_SUBSTRUCT(recorder_opts, recorder_conf)},
     {"", OPT_SUBSTRUCT(stream_opts, stream_conf)},
 
     {"", OPT_SUBSTRUCT(gl_video_opts, gl_video_conf)},
@@ -818,6 +829,8 @@ static const m_option_t mp_opts[] = {
 
     {"sws", OPT_SUBSTRUCT(sws_opts, sws_conf)},
 
+    {"", OPT_SUBSTRUCT(frame_pool_opts, mp_image_global_pool_conf)},
+
 #if HAVE_ZIMG
     {"zimg", OPT_SUBSTRUCT(zimg_opts, zimg_conf)},
 #endif
@@ -1015,6 +1028,7 @@ static const struct MPOpts mp_default_opts = {
     .coverart_auto = 1,
     .osd_bar_visible = 1,
     .screenshot_template = "mpv-shot%n",
+    .screenshot_queue_size = 4,
     .play_dir = 1,
 
     .audio_output_channels = {
@@ -165,6 +165,7 @@ typedef struct MPOpts {
     float rgain_preamp;         // Set replaygain pre-amplification
     int rgain_clip;             // Enable/disable clipping prevention
     float rgain_fallback;
+    int rgain_scan;
     int softvol_mute;
     float softvol_max;
     int gapless_audio;
@@ -192,6 +193,7 @@ typedef struct MPOpts {
     int video_osd;
 
     int untimed;
+    int filter_stats;
     char *stream_dump;
     char *record_file;
     int stop_playback_on_init_failure;
@@ -255,6 +257,7 @@ typedef struct MPOpts {
     int keep_open_pause;
     double image_display_duration;
     char *lavfi_complex;
+    struct lavfi_opts *lavfi_opts;
     int stream_id[2][STREAM_TYPE_COUNT];
     char **stream_lang[STREAM_TYPE_COUNT];
     int stream_auto_sel;
@@ -279,6 +282,8 @@ typedef struct MPOpts {
     char *screenshot_template;
     char *screenshot_directory;
     bool screenshot_sw;
+    bool screenshot_async;
+    int screenshot_queue_size;
 
     int index_mode;
 
@@ -322,6 +327,7 @@ typedef struct MPOpts {
 
     struct demux_opts *demux_opts;
     struct demux_cache_opts *demux_cache_opts;
+    struct recorder_opts *recorder_opts;
     struct stream_opts *stream_opts;
 
     struct vd_lavc_params *vd_lavc_params;
@@ -352,6 +358,7 @@ typedef struct MPOpts {
     struct dvd_opts *dvd_opts;
     struct vaapi_opts *vaapi_opts;
     struct sws_opts *sws_opts;
+    struct mp_image_global_pool_opts *frame_pool_opts;
     struct zimg_opts *zimg_opts;
 
     int cuda_device;
@@ -57,6 +57,7 @@
 #include "video/out/vo.h"
 #include "video/csputils.h"
 #include "video/hwdec.h"
+#include "video/mp_image_pool.h"
 #include "audio/aframe.h"
 #include "audio/format.h"
 #include "audio/out/ao.h"
@@ -662,6 +663,73 @@ static int mp_property_frame_drop_dec(void *ctx, struct m_property *prop,
                              mp_decoder_wrapper_get_frames_dropped(dec));
 }
 
+static int mp_property_dec_queue_state(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    char *type = prop->priv;
+    struct track *track = NULL;
+    switch (type[0]) {
+    case 'a': track = mpctx->ao_chain ? mpctx->ao_chain->track : NULL; break;
+    case 'v': track = mpctx->vo_chain ? mpctx->vo_chain->track : NULL; break;
+    default: abort();
+    }
+    if (!track || !track->dec)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mp_decoder_queue_state s;
+    mp_decoder_wrapper_get_queue_state(track->dec, &s);
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+    node_map_add_flag(r, "enabled", s.enabled);
+    if (!s.enabled)
+        return M_PROPERTY_OK;
+
+    node_map_add_flag(r, "adaptive", s.adaptive);
+    node_map_add_int64(r, "frames", s.frames);
+    node_map_add_int64(r, "samples", s.samples);
+    if (s.target_duration > 0)
+        node_map_add_double(r, "target-duration", s.target_duration);
+    node_map_add_double(r, "decode-time", s.decode_mean);
+    node_map_add_double(r, "decode-jitter", s.decode_stddev);
+    if (s.frame_duration > 0)
+        node_map_add_double(r, "frame-duration", s.frame_duration);
+
+    struct mpv_node *hist =
+        node_map_add(r, "decode-time-histogram", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < MP_DECODER_QUEUE_HIST_BUCKETS; n++)
+        node_array_add(hist, MPV_FORMAT_INT64)->u.int64 = s.decode_hist[n];
+
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_filter_graph_stats(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->filter_root || !mpctx->opts->filter_stats)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    mp_filter_stats_to_node(mpctx->filter_root, (struct mpv_node *)arg);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_mistimed_frame_count(void *ctx, struct m_property *prop,
                                             int action, void *arg)
 {
@@ -3520,6 +3588,9 @@ static const struct m_property mp_properties_base[] = {
     {"mistimed-frame-count", mp_property_mistimed_frame_count},
     {"vsync-ratio", mp_property_vsync_ratio},
     {"decoder-frame-drop-count", mp_property_frame_drop_dec},
+    {"vd-queue-state", mp_property_dec_queue_state, .priv = "v"},
+    {"ad-queue-state", mp_property_dec_queue_state, .priv = "a"},
+    {"filter-graph-stats", mp_property_filter_graph_stats},
     {"frame-drop-count", mp_property_frame_drop_vo},
     {"vo-delayed-frame-count", mp_property_vo_delayed_frame_count},
     {"percent-pos", mp_property_percent_pos},
@@ -6130,6 +6201,7 @@ const struct mp_cmd_def mp_cmds[] = {
                 .flags = MP_CMD_OPT_ARG},
         },
         .spawn_thread = true,
+        .exec_async = true,
     },
     { "screenshot-to-file", cmd_screenshot_to_file,
         {
@@ -6141,6 +6213,7 @@ const struct mp_cmd_def mp_cmds[] = {
                 OPTDEF_INT(2)},
         },
         .spawn_thread = true,
+        .exec_async = true,
     },
     { "screenshot-raw", cmd_screenshot_raw,
         {
@@ -6539,6 +6612,12 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
     if (flags & UPDATE_INPUT)
         mp_input_update_opts(mpctx->input);
 
+    if (opt_ptr == &opts->rgain_scan || opt_ptr == &opts->rgain_mode)
+        replaygain_scan_reset(mpctx);
+
+    if (opt_ptr == &opts->filter_stats && mpctx->filter_root)
+        mp_filter_graph_set_stats(mpctx->filter_root, opts->filter_stats);
+
     if (init || opt_ptr == &opts->ipc_path || opt_ptr == &opts->ipc_client) {
         mp_uninit_ipc(mpctx->ipc_ctx);
         mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
@@ -6569,6 +6648,9 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
     if (flags & UPDATE_LAVFI_COMPLEX)
         update_lavfi_complex(mpctx);
 
+    if (flags & UPDATE_FRAME_POOL)
+        mp_image_global_pool_set_opts(opts->frame_pool_opts);
+
     if (opt_ptr == &opts->vo->android_surface_size) {
         if (mpctx->video_out)
             vo_control(mpctx->video_out, VOCTRL_EXTERNAL_RESIZE, NULL);
@@ -248,6 +248,7 @@ typedef struct MPContext {
     struct MPOpts *opts;
     struct mp_log *log;
     struct stats_ctx *stats;
+    struct stats_ctx *frame_pool_stats;
     struct m_config *mconfig;
     struct input_ctx *input;
     struct mp_client_api *clients;
@@ -443,8 +444,10 @@ typedef struct MPContext {
     char *cached_watch_later_configdir;
 
     struct screenshot_ctx *screenshot_ctx;
+    struct replaygain_scan *rg_scan;
     struct command_ctx *command_ctx;
     struct encode_lavc_context *encode_lavc_ctx;
+    bool encode_chunks;         // --ochunks: run encode_chunked() instead
 
     struct mp_ipc_ctx *ipc_ctx;
 
@@ -518,6 +521,9 @@ void mp_delete_watch_later_conf(struct MPContext *mpctx, const char *file);
 struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
                                                 struct playlist *playlist);
 
+// encode_chunks.c
+bool encode_chunked(struct MPContext *mpctx, char **args);
+
 // loadfile.c
 void mp_abort_playback_async(struct MPContext *mpctx);
 void mp_abort_add(struct MPContext *mpctx, struct mp_abort_entry *abort);
@@ -626,6 +632,12 @@ void update_screensaver_state(struct MPContext *mpctx);
 void update_ab_loop_clip(struct MPContext *mpctx);
 bool get_internal_paused(struct MPContext *mpctx);
 
+// replaygain_scan.c
+void replaygain_scan_init(struct MPContext *mpctx);
+void replaygain_scan_uninit(struct MPContext *mpctx);
+void replaygain_scan_update(struct MPContext *mpctx);
+void replaygain_scan_reset(struct MPContext *mpctx);
+
 // scripting.c
 struct mp_script_args {
     const struct mp_scripting *backend;
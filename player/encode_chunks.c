@@ -0,0 +1,531 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Chunked encoding (--ochunks): the input is split at keyframes listed in its
+// index, each chunk is encoded by a separate player instance (playing an EDL
+// that references the chunk's part of the input), and the encoded chunks are
+// concatenated into the final output file.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+
+#include "mpv_talloc.h"
+
+#include "common/av_common.h"
+#include "common/common.h"
+#include "common/encode.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "input/cmd.h"
+#include "input/input.h"
+#include "misc/bstr.h"
+#include "misc/thread_tools.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "osdep/threads.h"
+
+#include "core.h"
+
+struct chunk {
+    double start, end;          // end < 0: until the end of the input
+    char *file;                 // temporary output file
+    bool ok;
+    struct MPContext *core;     // while encoding (protected by chunk_ctx.lock)
+};
+
+struct chunk_ctx {
+    struct MPContext *mpctx;
+    struct encode_opts *opts;
+    char **args;                // command line of the parent instance
+    char *url;
+
+    struct chunk *chunks;
+    int num_chunks;
+
+    pthread_mutex_t lock;
+    int next;                   // next chunk to start encoding
+    int num_running_workers;
+    bool abort;
+};
+
+// Create chunks starting at keyframes, each at least chunk_length long.
+static bool split_input(struct chunk_ctx *cc)
+{
+    struct MPContext *mpctx = cc->mpctx;
+
+    // libavformat exposes the index of most formats in the same way.
+    struct demuxer_params params = {
+        .force_format = "lavf",
+        .keyframe_index = true,
+    };
+    struct mp_cancel *cancel = mp_cancel_new(NULL);
+    struct demuxer *demuxer = demux_open_url(cc->url, &params, cancel,
+                                             mpctx->global);
+    if (!demuxer) {
+        MP_ERR(mpctx, "Could not open '%s' to find keyframes.\n", cc->url);
+        talloc_free(cancel);
+        return false;
+    }
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *s = demux_get_stream(demuxer, n);
+        if (s->type == STREAM_VIDEO && !s->attached_picture &&
+            s->num_keyframes > 0)
+        {
+            sh = s;
+            break;
+        }
+    }
+
+    double start = demuxer->start_time;
+    if (sh) {
+        for (int n = 0; n < sh->num_keyframes; n++) {
+            double kf = sh->keyframes[n];
+            if (kf - start >= cc->opts->chunk_length) {
+                struct chunk c = {.start = start, .end = kf};
+                MP_TARRAY_APPEND(cc, cc->chunks, cc->num_chunks, c);
+                start = kf;
+            }
+        }
+    } else {
+        MP_WARN(mpctx, "No keyframe index found, encoding in one chunk.\n");
+    }
+    struct chunk c = {.start = start, .end = -1};
+    MP_TARRAY_APPEND(cc, cc->chunks, cc->num_chunks, c);
+
+    demux_free(demuxer);
+    talloc_free(cancel);
+    return true;
+}
+
+// Command line for the instance encoding the given chunk: the parent's
+// options, plus some that are needed for it to work at all. Options that make
+// an instance write or listen to something outside of the encoded output are
+// reset, because all instances would share them. Appending them after the
+// parent's options overrides them regardless of how they were given.
+static char **chunk_args(struct chunk_ctx *cc, void *ta_ctx, struct chunk *c)
+{
+    char **args = NULL;
+    int num_args = 0;
+
+    // Defaults, the user can override these.
+    MP_TARRAY_APPEND(ta_ctx, args, num_args, "--msg-level=all=warn");
+
+    const char *forced[] = {
+        talloc_asprintf(ta_ctx, "--o=%s", c->file),
+        "--ochunks=0",
+        "--input-terminal=no",
+        "--idle=no",
+        "--loop-file=no",
+        "--loop-playlist=no",
+        "--input-ipc-server=",
+        "--input-ipc-client=",
+        "--log-file=",
+        "--dump-stats=",
+        "--stream-record=",
+        "--stream-dump=",
+        "--record-file=",
+        "--save-position-on-quit=no",
+        "--resume-playback=no",
+        NULL
+    };
+
+    bool forced_added = false;
+    for (int n = 0; cc->args && cc->args[n]; n++) {
+        // Everything after "--" is a file name.
+        if (!forced_added && strcmp(cc->args[n], "--") == 0) {
+            for (int i = 0; forced[i]; i++)
+                MP_TARRAY_APPEND(ta_ctx, args, num_args, (char *)forced[i]);
+            forced_added = true;
+        }
+        MP_TARRAY_APPEND(ta_ctx, args, num_args, cc->args[n]);
+    }
+    if (!forced_added) {
+        for (int i = 0; forced[i]; i++)
+            MP_TARRAY_APPEND(ta_ctx, args, num_args, (char *)forced[i]);
+    }
+    MP_TARRAY_APPEND(ta_ctx, args, num_args, NULL);
+    return args;
+}
+
+static char *chunk_edl(void *ta_ctx, const char *url, struct chunk *c)
+{
+    char *edl = talloc_asprintf(ta_ctx, "edl://!no_chapters;%%%zu%%%s,start=%.17g",
+                                strlen(url), url, c->start);
+    if (c->end >= 0)
+        edl = talloc_asprintf_append(edl, ",length=%.17g", c->end - c->start);
+    return edl;
+}
+
+static bool encode_chunk(struct chunk_ctx *cc, struct chunk *c)
+{
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+
+    struct MPContext *core = mp_create();
+    if (!core)
+        goto done;
+
+    if (mp_initialize(core, chunk_args(cc, tmp, c)) != 0)
+        goto done;
+
+    // Replace the files from the command line with the chunk.
+    playlist_clear(core->playlist);
+    playlist_add_file(core->playlist, chunk_edl(tmp, cc->url, c));
+
+    pthread_mutex_lock(&cc->lock);
+    bool abort = cc->abort;
+    if (!abort)
+        c->core = core;
+    pthread_mutex_unlock(&cc->lock);
+    if (abort)
+        goto done;
+
+    mp_play_files(core);
+
+    pthread_mutex_lock(&cc->lock);
+    c->core = NULL;
+    pthread_mutex_unlock(&cc->lock);
+
+    ok = core->files_played && !core->files_errored && !core->files_broken &&
+         core->stop_play != PT_QUIT;
+
+done:
+    if (core)
+        mp_destroy(core);
+    talloc_free(tmp);
+    return ok;
+}
+
+static void *worker_thread(void *arg)
+{
+    struct chunk_ctx *cc = arg;
+    struct MPContext *mpctx = cc->mpctx;
+
+    mpthread_set_name("encode-chunk");
+
+    pthread_mutex_lock(&cc->lock);
+    while (!cc->abort && cc->next < cc->num_chunks) {
+        int index = cc->next++;
+        struct chunk *c = &cc->chunks[index];
+        pthread_mutex_unlock(&cc->lock);
+
+        MP_INFO(mpctx, "Encoding chunk %d/%d (%.3f - %.3f)...\n", index + 1,
+                cc->num_chunks, c->start - cc->chunks[0].start,
+                c->end >= 0 ? c->end - cc->chunks[0].start : INFINITY);
+        c->ok = encode_chunk(cc, c);
+
+        pthread_mutex_lock(&cc->lock);
+        if (!c->ok && !cc->abort) {
+            MP_ERR(mpctx, "Encoding chunk %d failed.\n", index + 1);
+            cc->abort = true;
+        }
+    }
+    cc->num_running_workers--;
+    pthread_mutex_unlock(&cc->lock);
+
+    mp_wakeup_core(mpctx);
+    return NULL;
+}
+
+// Stop encoding: don't start new chunks, and make running instances quit.
+static void abort_chunks(struct chunk_ctx *cc)
+{
+    pthread_mutex_lock(&cc->lock);
+    cc->abort = true;
+    for (int n = 0; n < cc->num_chunks; n++) {
+        struct MPContext *core = cc->chunks[n].core;
+        if (core) {
+            mp_input_queue_cmd(core->input,
+                mp_input_parse_cmd(core->input, bstr0("quit"), "encode-chunks"));
+        }
+    }
+    pthread_mutex_unlock(&cc->lock);
+}
+
+// Whether a stream of a later chunk can be appended to the output stream, which
+// was set up from the first chunk. Encoder settings that depend on the input
+// (like the size, or extradata of encoders with adaptive headers) could make
+// them differ, and the output would be broken.
+static bool same_codecpar(AVCodecParameters *a, AVCodecParameters *b)
+{
+    if (a->codec_type != b->codec_type || a->codec_id != b->codec_id ||
+        a->format != b->format || a->width != b->width ||
+        a->height != b->height || a->sample_rate != b->sample_rate ||
+        a->channels != b->channels || a->channel_layout != b->channel_layout ||
+        a->extradata_size != b->extradata_size)
+        return false;
+    return !a->extradata_size ||
+           memcmp(a->extradata, b->extradata, a->extradata_size) == 0;
+}
+
+// Write all packets of the encoded chunks to the output file. Each chunk's
+// timestamps start at 0, so they are shifted by the chunk's start time.
+static bool concat_chunks(struct chunk_ctx *cc)
+{
+    struct MPContext *mpctx = cc->mpctx;
+    struct encode_opts *opts = cc->opts;
+    AVFormatContext *out = NULL;
+    AVFormatContext *in = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    int64_t *last_dts = NULL;
+    bool ok = false;
+
+    MP_HANDLE_OOM(pkt);
+
+    for (int n = 0; n < cc->num_chunks; n++) {
+        struct chunk *c = &cc->chunks[n];
+
+        if (avformat_open_input(&in, c->file, NULL, NULL) < 0 ||
+            avformat_find_stream_info(in, NULL) < 0)
+        {
+            MP_ERR(mpctx, "Could not read encoded chunk '%s'.\n", c->file);
+            goto done;
+        }
+
+        if (!out) {
+            const char *format = opts->format && opts->format[0]
+                               ? opts->format : NULL;
+            if (avformat_alloc_output_context2(&out, NULL, format,
+                                               opts->file) < 0)
+            {
+                MP_ERR(mpctx, "Could not create output '%s'.\n", opts->file);
+                goto done;
+            }
+            for (int i = 0; i < in->nb_streams; i++) {
+                AVStream *ist = in->streams[i];
+                AVStream *st = avformat_new_stream(out, NULL);
+                MP_HANDLE_OOM(st);
+                if (avcodec_parameters_copy(st->codecpar, ist->codecpar) < 0)
+                    goto done;
+                st->time_base = ist->time_base;
+                st->disposition = ist->disposition;
+                av_dict_copy(&st->metadata, ist->metadata, 0);
+            }
+            av_dict_copy(&out->metadata, in->metadata, 0);
+
+            if (!(out->oformat->flags & AVFMT_NOFILE) &&
+                avio_open(&out->pb, opts->file, AVIO_FLAG_WRITE) < 0)
+            {
+                MP_ERR(mpctx, "Could not open '%s'.\n", opts->file);
+                goto done;
+            }
+
+            AVDictionary *fopts = NULL;
+            mp_set_avdict(&fopts, opts->fopts);
+            int r = avformat_write_header(out, &fopts);
+            av_dict_free(&fopts);
+            if (r < 0) {
+                MP_ERR(mpctx, "Could not write header to '%s'.\n", opts->file);
+                goto done;
+            }
+
+            last_dts = talloc_array(NULL, int64_t, out->nb_streams);
+            for (int i = 0; i < out->nb_streams; i++)
+                last_dts[i] = AV_NOPTS_VALUE;
+        } else if (in->nb_streams != out->nb_streams) {
+            MP_ERR(mpctx, "Chunk '%s' has different streams.\n", c->file);
+            goto done;
+        } else {
+            for (int i = 0; i < in->nb_streams; i++) {
+                if (!same_codecpar(out->streams[i]->codecpar,
+                                   in->streams[i]->codecpar))
+                {
+                    MP_ERR(mpctx, "Stream %d of chunk '%s' was encoded with "
+                           "different parameters than the first chunk.\n",
+                           i, c->file);
+                    goto done;
+                }
+            }
+        }
+
+        int64_t offset = llrint((c->start - cc->chunks[0].start) * AV_TIME_BASE);
+
+        while (av_read_frame(in, pkt) >= 0) {
+            int index = pkt->stream_index;
+            AVStream *ist = in->streams[index];
+            AVStream *st = out->streams[index];
+
+            int64_t shift = av_rescale_q(offset, AV_TIME_BASE_Q, ist->time_base);
+            if (pkt->pts != AV_NOPTS_VALUE)
+                pkt->pts += shift;
+            if (pkt->dts != AV_NOPTS_VALUE)
+                pkt->dts += shift;
+            av_packet_rescale_ts(pkt, ist->time_base, st->time_base);
+
+            // Chunk boundaries don't fall exactly on audio frame boundaries,
+            // so the last packets of a chunk can overlap with the next one.
+            if (pkt->dts != AV_NOPTS_VALUE && last_dts[index] != AV_NOPTS_VALUE &&
+                pkt->dts <= last_dts[index])
+            {
+                MP_VERBOSE(mpctx, "Dropping overlapping packet in stream %d "
+                           "of chunk %d.\n", index, n + 1);
+                av_packet_unref(pkt);
+                continue;
+            }
+            if (pkt->dts != AV_NOPTS_VALUE)
+                last_dts[index] = pkt->dts;
+
+            pkt->pos = -1;
+            if (av_interleaved_write_frame(out, pkt) < 0) {
+                MP_ERR(mpctx, "Error writing to '%s'.\n", opts->file);
+                goto done;
+            }
+        }
+
+        avformat_close_input(&in);
+    }
+
+    if (av_write_trailer(out) < 0) {
+        MP_ERR(mpctx, "Could not write trailer to '%s'.\n", opts->file);
+        goto done;
+    }
+
+    ok = true;
+
+done:
+    avformat_close_input(&in);
+    if (out && !(out->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&out->pb);
+    avformat_free_context(out);
+    av_packet_free(&pkt);
+    talloc_free(last_dts);
+    return ok;
+}
+
+// Encode the single input file to --o in chunks, with --ochunks instances
+// running in parallel. args are the command line options given to the
+// player. Returns success.
+bool encode_chunked(struct MPContext *mpctx, char **args)
+{
+    struct encode_opts *opts = mpctx->opts->encode_opts;
+
+    mp_msg_set_early_logging(mpctx->global, false);
+
+    if (mpctx->playlist->num_entries != 1) {
+        MP_ERR(mpctx, "--ochunks requires exactly one input file.\n");
+        return false;
+    }
+    if (opts->extra_outputs && opts->extra_outputs[0]) {
+        MP_ERR(mpctx, "--ochunks can't be used with --oextra.\n");
+        return false;
+    }
+    if (mpctx->opts->play_start.type != REL_TIME_NONE ||
+        mpctx->opts->play_end.type != REL_TIME_NONE ||
+        mpctx->opts->play_length.type != REL_TIME_NONE)
+    {
+        MP_ERR(mpctx, "--ochunks can't be used with --start/--end/--length.\n");
+        return false;
+    }
+
+    struct chunk_ctx *cc = talloc_ptrtype(NULL, cc);
+    *cc = (struct chunk_ctx){
+        .mpctx = mpctx,
+        .opts = opts,
+        .args = args,
+        .url = mpctx->playlist->entries[0]->filename,
+    };
+    pthread_mutex_init(&cc->lock, NULL);
+
+    bool ok = false;
+    if (!split_input(cc))
+        goto done;
+
+    bstr root;
+    char *ext = mp_splitext(opts->file, &root);
+    for (int n = 0; n < cc->num_chunks; n++) {
+        struct chunk *c = &cc->chunks[n];
+        c->file = ext ? talloc_asprintf(cc, "%.*s.chunk%03d.%s", BSTR_P(root),
+                                        n + 1, ext)
+                      : talloc_asprintf(cc, "%s.chunk%03d", opts->file, n + 1);
+    }
+
+    int num_workers = MPMIN(opts->chunks, cc->num_chunks);
+    MP_INFO(mpctx, "Encoding %d chunks, %d in parallel.\n", cc->num_chunks,
+            num_workers);
+
+    pthread_t *threads = talloc_array(cc, pthread_t, num_workers);
+    for (int n = 0; n < num_workers; n++) {
+        pthread_mutex_lock(&cc->lock);
+        cc->num_running_workers++;
+        pthread_mutex_unlock(&cc->lock);
+        if (pthread_create(&threads[n], NULL, worker_thread, cc)) {
+            pthread_mutex_lock(&cc->lock);
+            cc->num_running_workers--;
+            pthread_mutex_unlock(&cc->lock);
+            num_workers = n;
+            abort_chunks(cc);
+            break;
+        }
+    }
+
+    // Wait for the workers, while still reacting to quit commands (e.g. from
+    // a terminal signal).
+    while (1) {
+        pthread_mutex_lock(&cc->lock);
+        bool running = cc->num_running_workers > 0;
+        pthread_mutex_unlock(&cc->lock);
+        if (!running)
+            break;
+
+        struct mp_cmd *cmd = mp_input_read_cmd(mpctx->input);
+        if (cmd) {
+            if (strcmp(cmd->name, "quit") == 0 ||
+                strcmp(cmd->name, "quit-watch-later") == 0)
+            {
+                MP_INFO(mpctx, "Aborting chunked encoding.\n");
+                abort_chunks(cc);
+                mpctx->stop_play = PT_QUIT;
+            }
+            mp_cmd_free(cmd);
+            continue;
+        }
+
+        mp_wait_events(mpctx);
+    }
+
+    for (int n = 0; n < num_workers; n++)
+        pthread_join(threads[n], NULL);
+
+    if (cc->abort)
+        goto done;
+
+    MP_INFO(mpctx, "Concatenating chunks to '%s'.\n", opts->file);
+    ok = concat_chunks(cc);
+
+done:
+    for (int n = 0; n < cc->num_chunks; n++) {
+        if (cc->chunks[n].file)
+            unlink(cc->chunks[n].file);
+    }
+    pthread_mutex_destroy(&cc->lock);
+    talloc_free(cc);
+    if (ok)
+        mpctx->files_played++;
+    return ok;
+}
@@ -233,6 +233,7 @@ static void uninit_demuxer(struct MPContext *mpctx)
         talloc_free(track);
     }
     mpctx->num_tracks = 0;
+    replaygain_scan_reset(mpctx);
 
     kill_demuxers_reentrant(mpctx, demuxers, num_demuxers);
     talloc_free(demuxers);
@@ -737,6 +738,7 @@ bool mp_remove_track(struct MPContext *mpctx, struct track *track)
         index++;
     MP_TARRAY_REMOVE_AT(mpctx->tracks, mpctx->num_tracks, index);
     talloc_free(track);
+    replaygain_scan_reset(mpctx);
 
     // Close the demuxer, unless there is still a track using it. These are
     // all external tracks.
@@ -1450,6 +1452,7 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->filter_root = mp_filter_create_root(mpctx->global);
     mp_filter_graph_set_wakeup_cb(mpctx->filter_root, mp_wakeup_core_cb, mpctx);
     mp_filter_graph_set_max_run_time(mpctx->filter_root, 0.1);
+    mp_filter_graph_set_stats(mpctx->filter_root, opts->filter_stats);
 
     reset_playback_state(mpctx);
 
@@ -1624,6 +1627,7 @@ static void play_current_file(struct MPContext *mpctx)
     MP_VERBOSE(mpctx, "Starting playback...\n");
 
     mpctx->playback_initialized = true;
+    replaygain_scan_reset(mpctx);
     mp_notify(mpctx, MPV_EVENT_FILE_LOADED, NULL);
     update_screensaver_state(mpctx);
 
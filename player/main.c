@@ -58,6 +58,7 @@
 #include "misc/thread_tools.h"
 #include "sub/osd.h"
 #include "test/tests.h"
+#include "video/mp_image_pool.h"
 #include "video/out/vo.h"
 
 #include "core.h"
@@ -161,6 +162,8 @@ void mp_destroy(struct MPContext *mpctx)
 {
     mp_shutdown_clients(mpctx);
 
+    replaygain_scan_uninit(mpctx);
+
     mp_uninit_ipc(mpctx->ipc_ctx);
     mpctx->ipc_ctx = NULL;
 
@@ -188,6 +191,8 @@ void mp_destroy(struct MPContext *mpctx)
 
     mp_input_uninit(mpctx->input);
 
+    mp_image_global_pool_flush();
+
     uninit_libav(mpctx->global);
 
     mp_msg_uninit(mpctx->global);
@@ -284,6 +289,8 @@ struct MPContext *mp_create(void)
     mpctx->statusline = mp_log_new(mpctx, mpctx->log, "!statusline");
 
     mpctx->stats = stats_ctx_create(mpctx, mpctx->global, "main");
+    mpctx->frame_pool_stats = stats_ctx_create(mpctx, mpctx->global,
+                                               "frame-pool");
 
     // Create the config context and register the options
     mpctx->mconfig = m_config_new(mpctx, mpctx->log, &mp_opt_root);
@@ -298,6 +305,7 @@ struct MPContext *mp_create(void)
 
     mpctx->input = mp_input_init(mpctx->global, mp_wakeup_core_cb, mpctx);
     screenshot_init(mpctx);
+    replaygain_scan_init(mpctx);
     command_init(mpctx);
     init_libav(mpctx->global);
     mp_clients_init(mpctx);
@@ -397,7 +405,18 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     cocoa_set_mpv_handle(ctx);
 #endif
 
-    if (opts->encode_opts->file && opts->encode_opts->file[0]) {
+    if (opts->encode_opts->file && opts->encode_opts->file[0] &&
+        opts->encode_opts->chunks > 0 && mpctx->is_cli)
+    {
+        // Encoding is done by separate instances (see encode_chunked()).
+        // Apply the profile anyway, so that this instance doesn't load
+        // scripts, create a window, etc.
+        mpctx->encode_chunks = true;
+        m_config_set_profile(mpctx->mconfig, "encoding", 0);
+        mp_input_enable_section(mpctx->input, "encode", MP_INPUT_EXCLUSIVE);
+    } else if (opts->encode_opts->file && opts->encode_opts->file[0]) {
+        if (opts->encode_opts->chunks > 0)
+            MP_WARN(mpctx, "--ochunks works only with the command line player.\n");
         mpctx->encode_lavc_ctx = encode_lavc_init(mpctx->global);
         if(!mpctx->encode_lavc_ctx) {
             MP_INFO(mpctx, "Encoding initialization failed.\n");
@@ -431,8 +450,12 @@ int mpv_main(int argc, char *argv[])
 
     char **options = argv && argv[0] ? argv + 1 : NULL; // skips program name
     int r = mp_initialize(mpctx, options);
-    if (r == 0)
+    if (r == 0 && mpctx->encode_chunks) {
+        if (!encode_chunked(mpctx, options) && mpctx->stop_play != PT_QUIT)
+            r = -1;
+    } else if (r == 0) {
         mp_play_files(mpctx);
+    }
 
     int rc = 0;
     const char *reason = NULL;
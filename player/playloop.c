@@ -48,6 +48,7 @@
 #include "stream/stream.h"
 #include "sub/dec_sub.h"
 #include "sub/osd.h"
+#include "video/mp_image_pool.h"
 #include "video/out/vo.h"
 
 // Wait until mp_wakeup_core() is called, since the last time
@@ -57,6 +58,8 @@ void mp_wait_events(struct MPContext *mpctx)
     mp_client_send_property_changes(mpctx);
 
     stats_event(mpctx->stats, "iterations");
+    if (mpctx->opts->frame_pool_opts->enable)
+        mp_image_global_pool_report(mpctx->frame_pool_stats);
 
     bool sleeping = mpctx->sleeptime > 0;
     if (sleeping)
@@ -1196,6 +1199,8 @@ void run_playloop(struct MPContext *mpctx)
 
     update_demuxer_properties(mpctx);
 
+    replaygain_scan_update(mpctx);
+
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     handle_command_updates(mpctx);
@@ -0,0 +1,467 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "mpv_talloc.h"
+
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/loudness.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "filters/f_autoconvert.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+
+#include "core.h"
+
+// ReplayGain 2.0 reference level.
+#define REFERENCE_LUFS -18.0
+
+// Maximum number of finished scans to remember.
+#define MAX_CACHED 256
+
+// Scans the audio of a file, and doubles as cache entry once it's done.
+struct scan_job {
+    struct replaygain_scan *ctx;
+    struct mp_cancel *cancel;
+
+    // File identity.
+    char *path;
+    int64_t size;
+    int64_t mtime;
+
+    // Protected by ctx->lock.
+    int ff_index;       // stream to scan; -1 for the default audio stream
+    bool done;
+    bool ok;
+    bool cancelled;     // not useful anymore, and never reused
+    bool woken;         // filter graph wakeup
+    double integrated;  // LUFS
+    double peak;        // linear
+};
+
+struct replaygain_scan {
+    struct MPContext *mpctx;
+    struct mp_log *log;
+
+    // Created on demand.
+    struct mp_thread_pool *pool;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // Oldest first.
+    struct scan_job **jobs;
+    int num_jobs;
+
+    // Avoid stat() calls on every playloop iteration: only recheck the files
+    // when these change, when a scan finished, or on replaygain_scan_reset().
+    // Tracks can be reallocated at the same address, so last_track is only
+    // meaningful while the same set of tracks exists.
+    struct track *last_track;
+    uint64_t last_next_id;
+    bool changed;       // protected by lock
+};
+
+static void replaygain_scan_destroy(void *p)
+{
+    struct replaygain_scan *ctx = p;
+
+    replaygain_scan_uninit(ctx->mpctx);
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+}
+
+void replaygain_scan_init(struct MPContext *mpctx)
+{
+    struct replaygain_scan *ctx = talloc(mpctx, struct replaygain_scan);
+    *ctx = (struct replaygain_scan){
+        .mpctx = mpctx,
+        .log = mp_log_new(ctx, mpctx->log, "replaygain-scan"),
+    };
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wakeup, NULL);
+    talloc_set_destructor(ctx, replaygain_scan_destroy);
+    mpctx->rg_scan = ctx;
+}
+
+// Cancel running scans and wait until they're done.
+void replaygain_scan_uninit(struct MPContext *mpctx)
+{
+    struct replaygain_scan *ctx = mpctx->rg_scan;
+    if (!ctx)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_jobs; n++)
+        mp_cancel_trigger(ctx->jobs[n]->cancel);
+    pthread_mutex_unlock(&ctx->lock);
+
+    TA_FREEP(&ctx->pool);
+}
+
+// Make the next replaygain_scan_update() call recheck everything. Must be
+// called when tracks are freed or a new file starts, and when the options
+// change.
+void replaygain_scan_reset(struct MPContext *mpctx)
+{
+    struct replaygain_scan *ctx = mpctx->rg_scan;
+    if (!ctx)
+        return;
+
+    ctx->last_track = NULL;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->changed = true;
+    pthread_mutex_unlock(&ctx->lock);
+    mp_wakeup_core(mpctx);
+}
+
+static void wakeup_scan(void *p)
+{
+    struct scan_job *job = p;
+    struct replaygain_scan *ctx = job->ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    job->woken = true;
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static struct sh_stream *find_stream(struct demuxer *demuxer, int ff_index)
+{
+    struct sh_stream *def = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        if (sh->type != STREAM_AUDIO)
+            continue;
+        if (ff_index >= 0 && sh->ff_index == ff_index)
+            return sh;
+        if (ff_index < 0 && (!def || (sh->default_track && !def->default_track)))
+            def = sh;
+    }
+    return def;
+}
+
+// Decode the stream as fast as possible and feed it to the loudness meter.
+static bool scan_stream(struct scan_job *job, struct demuxer *demuxer,
+                        struct sh_stream *sh)
+{
+    struct replaygain_scan *ctx = job->ctx;
+    struct mpv_global *global = ctx->mpctx->global;
+    struct mp_loudness *meter = NULL;
+    struct mp_chmap chmap = {0};
+    int rate = 0;
+    bool ok = false;
+
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+
+    struct mp_filter *root = mp_filter_create_root(global);
+    mp_filter_graph_set_wakeup_cb(root, wakeup_scan, job);
+
+    struct mp_decoder_wrapper *dec = mp_decoder_wrapper_create(root, sh);
+    if (!dec || !mp_decoder_wrapper_reinit(dec)) {
+        MP_ERR(ctx, "Could not initialize decoder.\n");
+        goto done;
+    }
+
+    struct mp_autoconvert *conv = mp_autoconvert_create(root);
+    if (!conv)
+        goto done;
+    mp_autoconvert_add_afmt(conv, AF_FORMAT_FLOATP);
+    mp_pin_connect(conv->f->pins[0], dec->f->pins[0]);
+
+    while (!mp_cancel_test(job->cancel)) {
+        // E.g. the decoder failed, or there's no conversion to float.
+        if (mp_filter_has_failed(root)) {
+            MP_WARN(ctx, "'%s': decoding failed.\n", job->path);
+            break;
+        }
+
+        struct mp_frame frame = mp_pin_out_read(conv->f->pins[1]);
+        if (frame.type == MP_FRAME_EOF) {
+            ok = !!meter;
+            break;
+        } else if (frame.type == MP_FRAME_AUDIO) {
+            struct mp_aframe *aframe = frame.data;
+            struct mp_chmap fchmap = {0};
+            mp_aframe_get_chmap(aframe, &fchmap);
+            int frate = mp_aframe_get_rate(aframe);
+            if (!meter) {
+                chmap = fchmap;
+                rate = frate;
+                meter = mp_loudness_create(job, rate, &chmap);
+            } else if (rate != frate || !mp_chmap_equals(&chmap, &fchmap)) {
+                MP_WARN(ctx, "Audio format changes are not supported.\n");
+                mp_frame_unref(&frame);
+                break;
+            }
+            mp_loudness_add(meter, (float **)mp_aframe_get_data_ro(aframe),
+                            mp_aframe_get_size(aframe));
+            mp_frame_unref(&frame);
+        } else if (frame.type) {
+            mp_frame_unref(&frame);
+        } else if (!mp_filter_graph_run(root)) {
+            // Decoders with a separate thread (--ad-queue-enable) wake us up
+            // through the graph wakeup callback.
+            pthread_mutex_lock(&ctx->lock);
+            struct timespec ts = mp_rel_time_to_timespec(0.1);
+            while (!job->woken) {
+                if (pthread_cond_timedwait(&ctx->wakeup, &ctx->lock, &ts))
+                    break;
+            }
+            job->woken = false;
+            pthread_mutex_unlock(&ctx->lock);
+        }
+    }
+
+    if (ok) {
+        pthread_mutex_lock(&ctx->lock);
+        job->integrated = mp_loudness_get_integrated(meter);
+        job->peak = mp_loudness_get_true_peak(meter);
+        pthread_mutex_unlock(&ctx->lock);
+        ok = isfinite(job->integrated);
+        if (!ok)
+            MP_VERBOSE(ctx, "'%s': audio is silent.\n", job->path);
+    }
+
+done:
+    talloc_free(root);
+    talloc_free(meter);
+    return ok;
+}
+
+// Runs on a worker thread.
+static void run_scan_job(void *p)
+{
+    struct scan_job *job = p;
+    struct replaygain_scan *ctx = job->ctx;
+    struct MPContext *mpctx = ctx->mpctx;
+    bool ok = false;
+
+    int64_t start = mp_time_us();
+
+    struct demuxer_params params = {
+        .stream_flags = STREAM_ORIGIN_DIRECT,
+    };
+    struct demuxer *demuxer = demux_open_url(job->path, &params, job->cancel,
+                                             mpctx->global);
+    if (demuxer) {
+        pthread_mutex_lock(&ctx->lock);
+        int ff_index = job->ff_index;
+        pthread_mutex_unlock(&ctx->lock);
+
+        struct sh_stream *sh = find_stream(demuxer, ff_index);
+        if (sh) {
+            pthread_mutex_lock(&ctx->lock);
+            job->ff_index = sh->ff_index;
+            pthread_mutex_unlock(&ctx->lock);
+
+            ok = scan_stream(job, demuxer, sh);
+        }
+        demux_free(demuxer);
+    }
+
+    if (ok) {
+        MP_VERBOSE(ctx, "'%s': %.2f LUFS, peak %.2f dBTP (%.3f s)\n",
+                   job->path, job->integrated, 20 * log10(job->peak),
+                   (mp_time_us() - start) / 1e6);
+    } else if (!mp_cancel_test(job->cancel)) {
+        MP_VERBOSE(ctx, "'%s': scan failed.\n", job->path);
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    job->done = true;
+    job->ok = ok;
+    ctx->changed = true;
+    pthread_mutex_unlock(&ctx->lock);
+
+    mp_wakeup_core(mpctx);
+}
+
+// Return the path to scan for playing the given file, or NULL if it's not a
+// plain local file.
+static char *get_local_path(void *ta_ctx, const char *filename,
+                            struct stat *st)
+{
+    if (!filename || mp_is_url(bstr0(filename)) ||
+        stat(filename, st) || !S_ISREG(st->st_mode))
+        return NULL;
+    return talloc_strdup(ta_ctx, filename);
+}
+
+// Must be called with ctx->lock held.
+static struct scan_job *find_job(struct replaygain_scan *ctx, const char *path,
+                                 struct stat *st, int ff_index)
+{
+    for (int n = ctx->num_jobs - 1; n >= 0; n--) {
+        struct scan_job *job = ctx->jobs[n];
+        if (!job->cancelled && strcmp(job->path, path) == 0 &&
+            job->size == st->st_size && job->mtime == st->st_mtime &&
+            (ff_index < 0 || job->ff_index == ff_index ||
+             (job->ff_index < 0 && !job->done)))
+            return job;
+    }
+    return NULL;
+}
+
+// Drop cancelled scans, and the oldest results if there are too many.
+// Must be called with ctx->lock held.
+static void prune_jobs(struct replaygain_scan *ctx)
+{
+    for (int n = 0; n < ctx->num_jobs; n++) {
+        struct scan_job *job = ctx->jobs[n];
+        if (job->done && (job->cancelled || ctx->num_jobs > MAX_CACHED)) {
+            MP_TARRAY_REMOVE_AT(ctx->jobs, ctx->num_jobs, n);
+            talloc_free(job);
+            n--;
+        }
+    }
+}
+
+static struct scan_job *get_job(struct replaygain_scan *ctx,
+                                const char *filename, int ff_index)
+{
+    struct stat st;
+    char *path = get_local_path(NULL, filename, &st);
+    if (!path)
+        return NULL;
+
+    pthread_mutex_lock(&ctx->lock);
+    struct scan_job *job = find_job(ctx, path, &st, ff_index);
+    pthread_mutex_unlock(&ctx->lock);
+    if (job) {
+        talloc_free(path);
+        return job;
+    }
+
+    if (!ctx->pool) {
+        ctx->pool = mp_thread_pool_create(ctx, 0, 1, 2);
+        if (!ctx->pool) {
+            talloc_free(path);
+            return NULL;
+        }
+    }
+
+    job = talloc_ptrtype(ctx, job);
+    *job = (struct scan_job){
+        .ctx = ctx,
+        .cancel = mp_cancel_new(job),
+        .path = talloc_steal(job, path),
+        .size = st.st_size,
+        .mtime = st.st_mtime,
+        .ff_index = ff_index,
+    };
+
+    pthread_mutex_lock(&ctx->lock);
+    MP_TARRAY_APPEND(ctx, ctx->jobs, ctx->num_jobs, job);
+    prune_jobs(ctx);
+    pthread_mutex_unlock(&ctx->lock);
+
+    MP_VERBOSE(ctx, "Scanning '%s'.\n", job->path);
+    mp_thread_pool_queue(ctx->pool, run_scan_job, job);
+    return job;
+}
+
+static void apply_result(struct MPContext *mpctx, struct track *track,
+                         struct scan_job *job)
+{
+    struct replaygain_data *rg = talloc_ptrtype(track->stream, rg);
+    pthread_mutex_lock(&job->ctx->lock);
+    *rg = (struct replaygain_data){
+        .track_gain = REFERENCE_LUFS - job->integrated,
+        .track_peak = job->peak,
+        .album_gain = REFERENCE_LUFS - job->integrated,
+        .album_peak = job->peak,
+    };
+    pthread_mutex_unlock(&job->ctx->lock);
+    track->stream->codec->replaygain_data = rg;
+
+    MP_INFO(mpctx, "Scanned replaygain: %.2f dB, peak %.6f\n", rg->track_gain,
+            rg->track_peak);
+    audio_update_volume(mpctx);
+}
+
+// Start scans for the current and next file if needed, and apply finished
+// results to the current audio track. Called from the playloop.
+void replaygain_scan_update(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct replaygain_scan *ctx = mpctx->rg_scan;
+
+    if (!opts->rgain_scan || !opts->rgain_mode || !ctx)
+        return;
+
+    struct track *track = mpctx->current_track[0][STREAM_AUDIO];
+    struct playlist_entry *next = mp_next_file(mpctx, +1, false, false);
+    uint64_t next_id = next ? next->id : 0;
+
+    pthread_mutex_lock(&ctx->lock);
+    bool changed = ctx->changed;
+    ctx->changed = false;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (!changed && track == ctx->last_track && next_id == ctx->last_next_id)
+        return;
+    ctx->last_track = track;
+    ctx->last_next_id = next_id;
+
+    struct scan_job *cur = NULL;
+    if (track && track->stream && !track->stream->codec->replaygain_data &&
+        !track->demuxer->is_network && !track->demuxer->is_streaming)
+    {
+        const char *filename = track->is_external ? track->external_filename
+                                                  : mpctx->filename;
+        cur = get_job(ctx, filename, track->ff_index);
+        if (cur) {
+            pthread_mutex_lock(&ctx->lock);
+            bool done = cur->done, ok = cur->ok;
+            pthread_mutex_unlock(&ctx->lock);
+            if (done && ok)
+                apply_result(mpctx, track, cur);
+        }
+    }
+
+    // Scan the next file ahead of time, so that the result is ready when it
+    // starts. There's no way to know which track will be selected yet.
+    struct scan_job *nxt = next ? get_job(ctx, next->filename, -1) : NULL;
+
+    // Don't waste time on files that were skipped.
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_jobs; n++) {
+        struct scan_job *job = ctx->jobs[n];
+        if (job != cur && job != nxt && !job->done && !job->cancelled) {
+            job->cancelled = true;
+            mp_cancel_trigger(job->cancel);
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
@@ -15,10 +15,13 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include <libavutil/cpu.h>
+
 #include "config.h"
 
 #include "osdep/io.h"
@@ -26,11 +29,13 @@
 #include "mpv_talloc.h"
 #include "screenshot.h"
 #include "core.h"
+#include "client.h"
 #include "command.h"
 #include "input/cmd.h"
 #include "misc/bstr.h"
 #include "misc/dispatch.h"
 #include "misc/node.h"
+#include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
 #include "common/msg.h"
 #include "options/path.h"
@@ -46,16 +51,54 @@
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
+// Used to wait for an each-frame screenshot to be taken.
+struct each_frame_req {
+    bool captured;      // image was taken (but maybe not written yet)
+    bool completed;     // command finished
+    bool detached;      // waiter is gone, completion callback frees this
+};
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
 
     // Command to repeat in each-frame mode.
     struct mp_cmd *each_frame;
+    struct each_frame_req *each_frame_req;
 
     int frameno;
     uint64_t last_frame_count;
+
+    // For --screenshot-async. Created on demand.
+    struct mp_thread_pool *writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int num_pending;        // number of images queued or being written
+    // Generated file names which may not exist on disk yet, because the image
+    // is still being written. gen_fname() must not pick them again.
+    char **pending_names;
+    int num_pending_names;
 } screenshot_ctx;
 
+struct screenshot_job {
+    struct MPContext *mpctx;
+    struct mp_cmd_ctx *cmd;
+    struct mp_image *image;
+    char *filename;
+    bool reserved;      // filename was reserved by gen_fname()
+    struct image_writer_opts opts;
+    bool ok;
+};
+
+static void screenshot_ctx_destroy(void *p)
+{
+    screenshot_ctx *ctx = p;
+
+    // Blocks until all queued images are written.
+    talloc_free(ctx->writer);
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+}
+
 void screenshot_init(struct MPContext *mpctx)
 {
     mpctx->screenshot_ctx = talloc(mpctx, screenshot_ctx);
@@ -63,6 +106,9 @@ void screenshot_init(struct MPContext *mpctx)
         .mpctx = mpctx,
         .frameno = 1,
     };
+    pthread_mutex_init(&mpctx->screenshot_ctx->lock, NULL);
+    pthread_cond_init(&mpctx->screenshot_ctx->wakeup, NULL);
+    talloc_set_destructor(mpctx->screenshot_ctx, screenshot_ctx_destroy);
 }
 
 static char *stripext(void *talloc_ctx, const char *s)
@@ -73,8 +119,124 @@ static char *stripext(void *talloc_ctx, const char *s)
     return talloc_asprintf(talloc_ctx, "%.*s", (int)(end - s), s);
 }
 
-static bool write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
-                             const char *filename, struct image_writer_opts *opts)
+// Must be called with ctx->lock held.
+static int find_pending_name(screenshot_ctx *ctx, const char *filename)
+{
+    for (int n = 0; n < ctx->num_pending_names; n++) {
+        if (strcmp(ctx->pending_names[n], filename) == 0)
+            return n;
+    }
+    return -1;
+}
+
+// Allow gen_fname() to pick the name again (once the file was written, it
+// checks for its existence on disk instead).
+static void release_fname(screenshot_ctx *ctx, const char *filename)
+{
+    pthread_mutex_lock(&ctx->lock);
+    int n = find_pending_name(ctx, filename);
+    if (n >= 0) {
+        talloc_free(ctx->pending_names[n]);
+        MP_TARRAY_REMOVE_AT(ctx->pending_names, ctx->num_pending_names, n);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void report_screenshot(struct mp_cmd_ctx *cmd, const char *filename,
+                              bool ok)
+{
+    if (ok) {
+        mp_cmd_msg(cmd, MSGL_INFO, "Screenshot: '%s'", filename);
+    } else {
+        mp_cmd_msg(cmd, MSGL_ERR, "Error writing screenshot!");
+    }
+}
+
+// Runs on the core thread after a queued screenshot was written.
+static void finish_screenshot_job(void *p)
+{
+    struct screenshot_job *job = p;
+    struct MPContext *mpctx = job->mpctx;
+
+    report_screenshot(job->cmd, job->filename, job->ok);
+    job->cmd->success = job->ok;
+    mp_cmd_ctx_complete(job->cmd);
+    talloc_free(job);
+
+    mpctx->outstanding_async -= 1;
+    if (!mpctx->outstanding_async && mp_is_shutting_down(mpctx))
+        mp_wakeup_core(mpctx);
+}
+
+// Runs on a writer thread.
+static void write_screenshot_job(void *p)
+{
+    struct screenshot_job *job = p;
+    struct MPContext *mpctx = job->mpctx;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    job->ok = write_image(job->image, &job->opts, job->filename,
+                          mpctx->global, mpctx->log);
+    TA_FREEP(&job->image);
+
+    if (job->reserved)
+        release_fname(ctx, job->filename);
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->num_pending -= 1;
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+
+    mp_dispatch_enqueue(mpctx->dispatch, finish_screenshot_job, job);
+}
+
+// Queue the image for writing on a writer thread. Blocks if the queue is full.
+// Returns false if the writer could not be created; then nothing was done.
+static bool queue_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
+                             const char *filename, bool reserved,
+                             struct image_writer_opts *opts)
+{
+    struct MPContext *mpctx = cmd->mpctx;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    if (!ctx->writer) {
+        int threads = MPMAX(av_cpu_count(), 1);
+        ctx->writer = mp_thread_pool_create(ctx, 1, 1, threads);
+        if (!ctx->writer)
+            return false;
+    }
+
+    struct screenshot_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct screenshot_job){
+        .mpctx = mpctx,
+        .cmd = cmd,
+        .image = mp_image_new_ref(img),
+        .filename = talloc_strdup(job, filename),
+        .reserved = reserved,
+        .opts = *opts,
+    };
+    talloc_steal(job, job->image);
+
+    mp_core_unlock(mpctx);
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->num_pending >= mpctx->opts->screenshot_queue_size)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    ctx->num_pending += 1;
+    pthread_mutex_unlock(&ctx->lock);
+    mp_core_lock(mpctx);
+
+    mpctx->outstanding_async += 1; // prevent that core disappears
+    mp_thread_pool_queue(ctx->writer, write_screenshot_job, job);
+    return true;
+}
+
+// Write the image, and complete the command. With --screenshot-async, this
+// happens asynchronously, and the command is completed once the file has been
+// written. If reserved is set, filename was returned by gen_fname(), and is
+// released after writing.
+static void write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
+                             const char *filename, bool reserved,
+                             struct image_writer_opts *opts)
 {
     struct MPContext *mpctx = cmd->mpctx;
     struct image_writer_opts *gopts = mpctx->opts->screenshot_image_opts;
@@ -82,6 +244,10 @@ static bool write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
 
     mp_cmd_msg(cmd, MSGL_V, "Starting screenshot: '%s'", filename);
 
+    if (img && mpctx->opts->screenshot_async &&
+        queue_screenshot(cmd, img, filename, reserved, &opts_copy))
+        return;
+
     mp_core_unlock(mpctx);
 
     bool ok = img && write_image(img, &opts_copy, filename, mpctx->global,
@@ -89,12 +255,12 @@ static bool write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
 
     mp_core_lock(mpctx);
 
-    if (ok) {
-        mp_cmd_msg(cmd, MSGL_INFO, "Screenshot: '%s'", filename);
-    } else {
-        mp_cmd_msg(cmd, MSGL_ERR, "Error writing screenshot!");
-    }
-    return ok;
+    if (reserved)
+        release_fname(mpctx->screenshot_ctx, filename);
+
+    report_screenshot(cmd, filename, ok);
+    cmd->success = ok;
+    mp_cmd_ctx_complete(cmd);
 }
 
 #ifdef _WIN32
@@ -307,7 +473,16 @@ static char *gen_fname(struct mp_cmd_ctx *cmd, const char *file_ext)
             mp_mkdirp(full_dir);
         }
 
-        if (!mp_path_exists(fname))
+        // Screenshots which are still being written don't exist yet, so
+        // reserve the name until then.
+        pthread_mutex_lock(&ctx->lock);
+        bool taken = find_pending_name(ctx, fname) >= 0 || mp_path_exists(fname);
+        if (!taken) {
+            MP_TARRAY_APPEND(ctx, ctx->pending_names, ctx->num_pending_names,
+                             talloc_strdup(ctx, fname));
+        }
+        pthread_mutex_unlock(&ctx->lock);
+        if (!taken)
             return fname;
 
         if (sequence == prev_sequence) {
@@ -444,9 +619,10 @@ void cmd_screenshot_to_file(void *p)
     if (!image) {
         mp_cmd_msg(cmd, MSGL_ERR, "Taking screenshot failed.");
         cmd->success = false;
+        mp_cmd_ctx_complete(cmd);
         return;
     }
-    cmd->success = write_screenshot(cmd, image, filename, &opts);
+    write_screenshot(cmd, image, filename, false, &opts);
     talloc_free(image);
 }
 
@@ -467,6 +643,7 @@ void cmd_screenshot(void *p)
         if (each_frame_toggle) {
             if (ctx->each_frame) {
                 TA_FREEP(&ctx->each_frame);
+                mp_cmd_ctx_complete(cmd);
                 return;
             }
             ctx->each_frame = talloc_steal(ctx, mp_cmd_clone(cmd->cmd));
@@ -483,15 +660,28 @@ void cmd_screenshot(void *p)
 
     struct mp_image *image = screenshot_get(mpctx, mode, high_depth);
 
+    char *filename = NULL;
     if (image) {
-        char *filename = gen_fname(cmd, image_writer_file_ext(opts));
-        if (filename)
-            cmd->success = write_screenshot(cmd, image, filename, NULL);
-        talloc_free(filename);
+        filename = gen_fname(cmd, image_writer_file_ext(opts));
     } else {
         mp_cmd_msg(cmd, MSGL_ERR, "Taking screenshot failed.");
     }
 
+    if (filename) {
+        write_screenshot(cmd, image, filename, true, NULL);
+    } else {
+        mp_cmd_ctx_complete(cmd);
+    }
+
+    // If the image was queued for writing, the each-frame waiter can continue.
+    // (Otherwise the command was completed, and this was reset.)
+    if (each_frame_mode && ctx->each_frame_req) {
+        ctx->each_frame_req->captured = true;
+        ctx->each_frame_req = NULL;
+        mp_wakeup_core(mpctx);
+    }
+
+    talloc_free(filename);
     talloc_free(image);
 }
 
@@ -523,11 +713,14 @@ void cmd_screenshot_raw(void *p)
 
 static void screenshot_fin(struct mp_cmd_ctx *cmd)
 {
-    void **a = cmd->on_completion_priv;
-    struct MPContext *mpctx = a[0];
-    struct mp_waiter *waiter = a[1];
+    struct MPContext *mpctx = cmd->mpctx;
+    struct each_frame_req *req = cmd->on_completion_priv;
 
-    mp_waiter_wakeup(waiter, 0);
+    if (mpctx->screenshot_ctx->each_frame_req == req)
+        mpctx->screenshot_ctx->each_frame_req = NULL;
+    req->completed = true;
+    if (req->detached)
+        talloc_free(req);
     mp_wakeup_core(mpctx);
 }
 
@@ -542,14 +735,19 @@ void handle_each_frame_screenshot(struct MPContext *mpctx)
         return;
     ctx->last_frame_count = mpctx->shown_vframes;
 
-    struct mp_waiter wait = MP_WAITER_INITIALIZER;
-    void *a[] = {mpctx, &wait};
-    run_command(mpctx, mp_cmd_clone(ctx->each_frame), NULL, screenshot_fin, a);
+    struct each_frame_req *req = talloc_zero(NULL, struct each_frame_req);
+    ctx->each_frame_req = req;
+    run_command(mpctx, mp_cmd_clone(ctx->each_frame), NULL, screenshot_fin, req);
 
-    // Block (in a reentrant way) until the screenshot was written. Otherwise,
-    // we could pile up screenshot requests forever.
-    while (!mp_waiter_poll(&wait))
+    // Block (in a reentrant way) until the screenshot was taken. Otherwise,
+    // we could pile up screenshot requests forever. Writing the image can
+    // still be in progress with --screenshot-async (the queue size limits it).
+    while (!req->captured && !req->completed)
         mp_idle(mpctx);
 
-    mp_waiter_wait(&wait);
+    if (req->completed) {
+        talloc_free(req);
+    } else {
+        req->detached = true;
+    }
 }
@@ -0,0 +1,149 @@
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "common/msg.h"
+#include "filters/f_output_chain.h"
+#include "filters/filter.h"
+#include "filters/user_filters.h"
+#include "tests.h"
+
+#define RATE 48000
+
+// Frame sizes as they come from decoders with variable frame sizes.
+static const int frame_sizes[] = {1024, 1152, 960, 2048, 576, 1024, 4608, 0};
+
+static struct mp_aframe *alloc_frame(struct mp_aframe_pool *pool, int format,
+                                     int channels, int samples)
+{
+    struct mp_aframe *frame = mp_aframe_create();
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, channels);
+    assert_true(mp_aframe_set_format(frame, format));
+    assert_true(mp_aframe_set_chmap(frame, &chmap));
+    assert_true(mp_aframe_set_rate(frame, RATE));
+    assert_int_equal(mp_aframe_pool_allocate(pool, frame, samples), 0);
+    assert_int_equal(mp_aframe_get_size(frame), samples);
+    return frame;
+}
+
+// Allocate frames of all sizes, keeping a few of them referenced at a time
+// (like a queue between decoder and AO would).
+static void run_sizes(struct mp_aframe_pool *pool, int format, int channels)
+{
+    struct mp_aframe *queue[3] = {0};
+    for (int n = 0; frame_sizes[n]; n++) {
+        talloc_free(queue[n % 3]);
+        queue[n % 3] = alloc_frame(pool, format, channels, frame_sizes[n]);
+        assert_true(mp_aframe_set_silence(queue[n % 3], 0, frame_sizes[n]));
+    }
+    for (int n = 0; n < 3; n++)
+        talloc_free(queue[n]);
+}
+
+// Push audio with varying frame sizes through f, at the given speed.
+static void run_filter(struct mp_filter *root, struct mp_filter *f,
+                       struct mp_aframe_pool *in_pool, double speed,
+                       int num_frames)
+{
+    struct mp_filter_command cmd = {
+        .type = MP_FILTER_COMMAND_SET_SPEED,
+        .speed = speed,
+    };
+    assert_true(mp_filter_command(f, &cmd));
+
+    int num_in = 0;
+    while (1) {
+        if (num_in < num_frames && mp_pin_in_needs_data(f->pins[0])) {
+            int samples = frame_sizes[num_in % (MP_ARRAY_SIZE(frame_sizes) - 1)];
+            struct mp_aframe *in = alloc_frame(in_pool, AF_FORMAT_FLOAT, 2,
+                                               samples);
+            assert_true(mp_aframe_set_silence(in, 0, samples));
+            mp_pin_in_write(f->pins[0], MAKE_FRAME(MP_FRAME_AUDIO, in));
+            num_in++;
+            continue;
+        }
+
+        struct mp_frame frame = mp_pin_out_read(f->pins[1]);
+        if (!frame.type) {
+            if (!mp_filter_graph_run(root) && num_in == num_frames)
+                break;
+        }
+        mp_frame_unref(&frame);
+    }
+}
+
+// This checks that sample buffers are reused. Frame structs are not pooled, and
+// not covered by this.
+static void run(struct test_ctx *ctx)
+{
+    struct mp_aframe_pool_stats st, st2;
+
+    // Mixing sizes must not free and reallocate buffers: after warming up,
+    // every allocation is served from the pool.
+    struct mp_aframe_pool *pool = mp_aframe_pool_create(NULL);
+    run_sizes(pool, AF_FORMAT_FLOAT, 2);
+    run_sizes(pool, AF_FORMAT_S16P, 6);
+    mp_aframe_pool_get_stats(pool, &st);
+    assert_true(st.num_new > 0);
+    for (int n = 0; n < 100; n++) {
+        run_sizes(pool, AF_FORMAT_FLOAT, 2);
+        run_sizes(pool, AF_FORMAT_S16P, 6);
+    }
+    mp_aframe_pool_get_stats(pool, &st2);
+    assert_int_equal(st2.num_new, st.num_new);
+    assert_int_equal(st2.new_bytes, st.new_bytes);
+    assert_int_equal(st2.num_allocs,
+                     st.num_allocs + 100 * 2 * (MP_ARRAY_SIZE(frame_sizes) - 1));
+
+    // Frames can outlive the pool.
+    struct mp_aframe *frame = alloc_frame(pool, AF_FORMAT_FLOAT, 2, 100);
+    talloc_free(pool);
+    assert_true(mp_aframe_set_silence(frame, 0, 100));
+    talloc_free(frame);
+
+    // Filters in a chain use the shared pool. With varying input frame sizes
+    // and speed changes, steady-state filtering must not allocate.
+    struct mp_stream_info info = {
+        .aframe_pool = mp_aframe_pool_create(NULL),
+    };
+    struct mp_aframe_pool *in_pool = mp_aframe_pool_create(NULL);
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    root->stream_info = &info;
+    char *args[] = {NULL};
+    struct mp_filter *f = mp_create_user_filter(root, MP_OUTPUT_CHAIN_AUDIO,
+                                                "scaletempo", args);
+    assert_true(f);
+
+    for (int n = 0; n < 2; n++) {
+        run_filter(root, f, in_pool, 1.0, 50);
+        run_filter(root, f, in_pool, 1.5, 50);
+        run_filter(root, f, in_pool, 0.7, 50);
+    }
+    mp_aframe_pool_get_stats(info.aframe_pool, &st);
+    assert_true(st.num_allocs > 0);
+    mp_aframe_pool_get_stats(in_pool, &st2);
+    int64_t in_new = st2.num_new;
+
+    for (int n = 0; n < 10; n++) {
+        run_filter(root, f, in_pool, 1.0, 50);
+        run_filter(root, f, in_pool, 1.5, 50);
+        run_filter(root, f, in_pool, 0.7, 50);
+    }
+    mp_aframe_pool_get_stats(info.aframe_pool, &st2);
+    assert_true(st2.num_allocs > st.num_allocs);
+    assert_int_equal(st2.num_new, st.num_new);
+    mp_aframe_pool_get_stats(in_pool, &st2);
+    assert_int_equal(st2.num_new, in_new);
+
+    MP_INFO(ctx, "%"PRId64" allocations, %"PRId64" new buffers (%"PRId64
+            " KiB)\n", st.num_allocs, st.num_new, st.new_bytes / 1024);
+
+    talloc_free(root);
+    talloc_free(in_pool);
+    talloc_free(info.aframe_pool);
+}
+
+const struct unittest test_aframe_pool_buffers = {
+    .name = "aframe-pool-buffers",
+    .run = run,
+};
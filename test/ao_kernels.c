@@ -0,0 +1,226 @@
+#include <libavutil/lfg.h>
+
+#include "audio/format.h"
+#include "audio/out/internal.h"
+#include "common/msg.h"
+#include "osdep/endian.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+// Straightforward implementations of the gain and 24 bit packing code in
+// audio/out/ao.c. The optimized versions must produce exactly the same output.
+
+#define REF_GAIN_i(d, num_samples, gain, low, center, high)                     \
+    for (int n = 0; n < (num_samples); n++)                                     \
+        (d)[n] = MPCLAMP(                                                       \
+            ((((int64_t)((d)[n]) - (center)) * (gain) + 128) >> 8) + (center),  \
+            (low), (high))
+
+#define REF_GAIN_f(d, num_samples, gain)                                        \
+    for (int n = 0; n < (num_samples); n++)                                     \
+        (d)[n] = MPCLAMP(((d)[n]) * (gain), -1.0, 1.0)
+
+static void ref_gain(int format, void *data, int num_samples, float gain)
+{
+    int gi = lrint(256.0 * gain);
+    if (gi == 256)
+        return;
+    switch (af_fmt_from_planar(format)) {
+    case AF_FORMAT_U8:
+        REF_GAIN_i((uint8_t *)data, num_samples, gi, 0, 128, 255);
+        break;
+    case AF_FORMAT_S16:
+        REF_GAIN_i((int16_t *)data, num_samples, gi, INT16_MIN, 0, INT16_MAX);
+        break;
+    case AF_FORMAT_S32:
+        REF_GAIN_i((int32_t *)data, num_samples, gi, INT32_MIN, 0, INT32_MAX);
+        break;
+    case AF_FORMAT_FLOAT:
+        REF_GAIN_f((float *)data, num_samples, gain);
+        break;
+    case AF_FORMAT_DOUBLE:
+        REF_GAIN_f((double *)data, num_samples, gain);
+        break;
+    }
+}
+
+#if BYTE_ORDER == BIG_ENDIAN
+#define SHIFT24(x) ((3-(x))*8)
+#else
+#define SHIFT24(x) (((x)+1)*8)
+#endif
+
+static void ref_convert(int bytes, void *data, int num_samples)
+{
+    for (int s = 0; s < num_samples; s++) {
+        uint32_t val = *((uint32_t *)data + s);
+        uint8_t *ptr = (uint8_t *)data + s * bytes;
+        ptr[0] = val >> SHIFT24(0);
+        ptr[1] = val >> SHIFT24(1);
+        ptr[2] = val >> SHIFT24(2);
+        if (bytes == 4)
+            ptr[3] = 0;
+    }
+}
+
+static const int formats[] = {
+    AF_FORMAT_U8, AF_FORMAT_S16, AF_FORMAT_S32, AF_FORMAT_FLOAT,
+    AF_FORMAT_DOUBLE, AF_FORMAT_U8P, AF_FORMAT_S16P, AF_FORMAT_S32P,
+    AF_FORMAT_FLOATP, AF_FORMAT_DOUBLEP, 0
+};
+
+// Includes mute, unity, values near the int32 kernel limit, and the maximum
+// of --volume-max=1000 with some replaygain on top.
+static const float gains[] = {
+    0, 0.001, 0.25, 0.5, 0.999, 1.0, 1.001, 2.0, 10.0, 255.99, 256.0, 1000.0,
+    5000.0, -1
+};
+
+static void fill_random(AVLFG *lfg, int format, void *data, size_t size)
+{
+    uint8_t *d = data;
+    for (size_t n = 0; n < size; n++)
+        d[n] = av_lfg_get(lfg);
+    if (af_fmt_is_float(format)) {
+        // Mostly in [-2, 2], so that both sides of the clipping are tested.
+        int bps = af_fmt_to_bytes(format);
+        for (size_t n = 0; n < size / bps; n++) {
+            double v = ((int32_t)av_lfg_get(lfg)) / (double)INT32_MAX * 2;
+            if (bps == 4) {
+                ((float *)data)[n] = v;
+            } else {
+                ((double *)data)[n] = v;
+            }
+        }
+    }
+}
+
+static struct ao *create_ao(int format, int channels)
+{
+    struct ao *ao = talloc_zero(NULL, struct ao);
+    ao->format = format;
+    mp_chmap_from_channels(&ao->channels, channels);
+    return ao;
+}
+
+// Run both the reference and the optimized gain on a copy of the same data.
+// Returns the time taken by each in *t_ref and *t_new.
+static void check_gain(AVLFG *lfg, int format, int channels, int samples,
+                       float gain, int64_t *t_ref, int64_t *t_new)
+{
+    struct ao *ao = create_ao(format, channels);
+    ao_set_gain(ao, gain);
+
+    bool planar = af_fmt_is_planar(format);
+    int planes = planar ? channels : 1;
+    int plane_samples = samples * (planar ? 1 : channels);
+    size_t plane_size = plane_samples * af_fmt_to_bytes(format);
+
+    void *ref[MP_NUM_CHANNELS], *new[MP_NUM_CHANNELS];
+    for (int n = 0; n < planes; n++) {
+        ref[n] = talloc_size(ao, plane_size);
+        new[n] = talloc_size(ao, plane_size);
+        fill_random(lfg, format, ref[n], plane_size);
+        memcpy(new[n], ref[n], plane_size);
+    }
+
+    int64_t t0 = mp_time_us();
+    for (int n = 0; n < planes; n++)
+        ref_gain(format, ref[n], plane_samples, gain);
+    int64_t t1 = mp_time_us();
+    ao_post_process_data(ao, new, samples);
+    int64_t t2 = mp_time_us();
+
+    for (int n = 0; n < planes; n++)
+        assert_memcmp(ref[n], new[n], plane_size);
+
+    *t_ref += t1 - t0;
+    *t_new += t2 - t1;
+    talloc_free(ao);
+}
+
+static void check_convert(AVLFG *lfg, int dst_bits, int channels, int samples,
+                          int64_t *t_ref, int64_t *t_new)
+{
+    struct ao_convert_fmt fmt = {
+        .src_fmt = AF_FORMAT_S32,
+        .channels = channels,
+        .dst_bits = dst_bits,
+        .pad_msb = dst_bits == 32 ? 8 : 0,
+    };
+    assert_true(ao_can_convert_inplace(&fmt));
+
+    size_t size = samples * channels * 4;
+    void *ref = talloc_size(NULL, size);
+    void *new = talloc_size(NULL, size);
+    fill_random(lfg, AF_FORMAT_S32, ref, size);
+    memcpy(new, ref, size);
+
+    int64_t t0 = mp_time_us();
+    ref_convert(dst_bits / 8, ref, samples * channels);
+    int64_t t1 = mp_time_us();
+    ao_convert_inplace(&fmt, &new, samples);
+    int64_t t2 = mp_time_us();
+
+    assert_memcmp(ref, new, samples * channels * dst_bits / 8);
+
+    *t_ref += t1 - t0;
+    *t_new += t2 - t1;
+    talloc_free(ref);
+    talloc_free(new);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    AVLFG lfg;
+    av_lfg_init(&lfg, 123);
+    int64_t t_ref = 0, t_new = 0;
+
+    // Odd sample counts to catch tail handling.
+    for (int samples = 1; samples <= 67; samples += 11) {
+        for (int f = 0; formats[f]; f++) {
+            for (int g = 0; gains[g] >= 0; g++) {
+                check_gain(&lfg, formats[f], 3, samples, gains[g],
+                           &t_ref, &t_new);
+            }
+        }
+        check_convert(&lfg, 24, 3, samples, &t_ref, &t_new);
+        check_convert(&lfg, 32, 3, samples, &t_ref, &t_new);
+    }
+}
+
+// Time reference and optimized kernels on 32 channels at 192 kHz (1 second of
+// audio per call). Not part of all-simple, because it's only informative.
+static void run_bench(struct test_ctx *ctx)
+{
+    AVLFG lfg;
+    av_lfg_init(&lfg, 123);
+    const int channels = 32, samples = 192000;
+
+    for (int f = 0; formats[f]; f++) {
+        if (af_fmt_is_planar(formats[f]))
+            continue;
+        int64_t t_ref = 0, t_new = 0;
+        check_gain(&lfg, formats[f], channels, samples, 0.5, &t_ref, &t_new);
+        MP_INFO(ctx, "gain %-7s: reference %8.3f ms, optimized %8.3f ms\n",
+                af_fmt_to_str(formats[f]), t_ref / 1000.0, t_new / 1000.0);
+    }
+
+    for (int bits = 24; bits <= 32; bits += 8) {
+        int64_t t_ref = 0, t_new = 0;
+        check_convert(&lfg, bits, channels, samples, &t_ref, &t_new);
+        MP_INFO(ctx, "s32 to %d bit: reference %8.3f ms, optimized %8.3f ms\n",
+                bits, t_ref / 1000.0, t_new / 1000.0);
+    }
+}
+
+const struct unittest test_ao_kernels = {
+    .name = "ao-kernels",
+    .run = run,
+};
+
+const struct unittest test_ao_kernels_bench = {
+    .name = "ao-kernels-bench",
+    .is_complex = true,
+    .run = run_bench,
+};
@@ -0,0 +1,151 @@
+#include <libavutil/lfg.h>
+
+#include "common/msg.h"
+#include "osdep/timer.h"
+#include "tests.h"
+#include "video/out/dither.h"
+
+// Straightforward implementation of the fruit dither matrix generation, which
+// updates and scans the whole matrix for each assigned cell. The optimized
+// implementation must produce exactly the same output.
+
+#define REF_MAX_SIZE2 (256 * 256)
+
+struct ref_ctx {
+    unsigned int sizeb, size, size2;
+    unsigned int gauss_radius, gauss_middle;
+    uint64_t gauss[REF_MAX_SIZE2];
+    unsigned int randomat[REF_MAX_SIZE2];
+    bool calcmat[REF_MAX_SIZE2];
+    uint64_t gaussmat[REF_MAX_SIZE2];
+    unsigned int unimat[REF_MAX_SIZE2];
+    AVLFG avlfg;
+};
+
+#define REF_XY(k, x, y) ((x) | ((y) << (k)->sizeb))
+
+static void ref_makegauss(struct ref_ctx *k, unsigned int sizeb)
+{
+    av_lfg_init(&k->avlfg, 123);
+
+    k->sizeb = sizeb;
+    k->size = 1 << sizeb;
+    k->size2 = k->size * k->size;
+    k->gauss_radius = k->size / 2 - 1;
+    k->gauss_middle = REF_XY(k, k->gauss_radius, k->gauss_radius);
+
+    unsigned int gs = k->gauss_radius * 2 + 1;
+    double sigma = -log(1.5 / UINT64_MAX * gs * gs) / k->gauss_radius;
+
+    for (unsigned int y = 0; y < gs; y++) {
+        for (unsigned int x = 0; x < gs; x++) {
+            int cx = (int)x - k->gauss_radius;
+            int cy = (int)y - k->gauss_radius;
+            double e = exp(-sqrt(cx * cx + cy * cy) * sigma);
+            k->gauss[REF_XY(k, x, y)] = e / (gs * gs) * UINT64_MAX;
+        }
+    }
+}
+
+static void ref_make_matrix(float *out_matrix, int sizeb)
+{
+    struct ref_ctx *k = talloc_zero(NULL, struct ref_ctx);
+    ref_makegauss(k, sizeb);
+
+    for (unsigned int c = 0; c < k->size2; c++) {
+        uint64_t min = UINT64_MAX;
+        unsigned int resnum = 0;
+        for (unsigned int i = 0; i < k->size2; i++) {
+            if (k->calcmat[i])
+                continue;
+            if (k->gaussmat[i] <= min) {
+                if (k->gaussmat[i] != min) {
+                    min = k->gaussmat[i];
+                    resnum = 0;
+                }
+                k->randomat[resnum++] = i;
+            }
+        }
+        unsigned int r;
+        if (resnum == 1) {
+            r = k->randomat[0];
+        } else if (resnum == k->size2) {
+            r = k->size2 / 2;
+        } else {
+            r = k->randomat[av_lfg_get(&k->avlfg) % resnum];
+        }
+
+        k->calcmat[r] = true;
+        k->unimat[r] = c;
+        unsigned int offset = k->gauss_middle + k->size2 - r;
+        for (unsigned int i = 0; i < k->size2; i++)
+            k->gaussmat[i] += k->gauss[(offset + i) & (k->size2 - 1)];
+    }
+
+    for (unsigned int n = 0; n < k->size2; n++)
+        out_matrix[n] = k->unimat[n] / (float)k->size2;
+    talloc_free(k);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    for (int sizeb = 2; sizeb <= 6; sizeb++) {
+        int size2 = (1 << sizeb) * (1 << sizeb);
+        float *ref = talloc_array(NULL, float, size2);
+        float *new = talloc_array(NULL, float, size2);
+
+        ref_make_matrix(ref, sizeb);
+        mp_make_fruit_dither_matrix(new, sizeb);
+        assert_memcmp(ref, new, size2 * sizeof(float));
+
+        // Every value must appear exactly once.
+        bool *seen = talloc_zero_array(NULL, bool, size2);
+        for (int n = 0; n < size2; n++) {
+            int v = new[n] * size2;
+            assert_true(v >= 0 && v < size2 && !seen[v]);
+            seen[v] = true;
+        }
+
+        const float *cached = mp_get_fruit_dither_matrix(ctx->global, ctx->log,
+                                                         NULL, sizeb);
+        assert_true(cached);
+        assert_memcmp(cached, new, size2 * sizeof(float));
+        assert_true(cached == mp_get_fruit_dither_matrix(ctx->global, ctx->log,
+                                                         NULL, sizeb));
+
+        talloc_free(seen);
+        talloc_free(ref);
+        talloc_free(new);
+    }
+}
+
+// Compare generation time of the reference and the optimized implementation.
+// Not part of all-simple, because the reference takes a long time for size 8.
+static void run_bench(struct test_ctx *ctx)
+{
+    for (int sizeb = 2; sizeb <= 8; sizeb++) {
+        int size = 1 << sizeb;
+        float *m = talloc_array(NULL, float, size * size);
+
+        int64_t t0 = mp_time_us();
+        ref_make_matrix(m, sizeb);
+        int64_t t1 = mp_time_us();
+        mp_make_fruit_dither_matrix(m, sizeb);
+        int64_t t2 = mp_time_us();
+
+        MP_INFO(ctx, "%3dx%-3d: reference %10.3f ms, optimized %10.3f ms\n",
+                size, size, (t1 - t0) / 1000.0, (t2 - t1) / 1000.0);
+        talloc_free(m);
+    }
+}
+
+const struct unittest test_dither = {
+    .name = "dither",
+    .run = run,
+};
+
+const struct unittest test_dither_bench = {
+    .name = "dither-bench",
+    .is_complex = true,
+    .run = run_bench,
+};
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "filters/f_lavfi.h"
+#include "filters/filter.h"
+#include "osdep/timer.h"
+#include "tests.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+
+static struct mp_image *create_image(int w, int h)
+{
+    struct mp_image *img = mp_image_alloc(IMGFMT_420P, w, h);
+    assert_true(img);
+    img->params.p_w = img->params.p_h = 1;
+    for (int y = 0; y < h; y++)
+        memset(img->planes[0] + y * img->stride[0], y & 0xFF, w);
+    mp_image_clear(img, 0, h / 2, w, h);
+    return img;
+}
+
+// Push num_frames references to img through the bidir filter f, followed by
+// EOF, and return the number of frames it output. If first_out is not NULL,
+// the first output image is returned in it.
+static int run_frames(struct mp_filter *root, struct mp_filter *f,
+                      struct mp_image *img, int num_frames,
+                      struct mp_image **first_out)
+{
+    int num_in = 0, num_out = 0;
+    while (1) {
+        if (num_in <= num_frames && mp_pin_in_needs_data(f->pins[0])) {
+            struct mp_frame frame = MP_EOF_FRAME;
+            if (num_in < num_frames) {
+                struct mp_image *ref = mp_image_new_ref(img);
+                assert_true(ref);
+                ref->pts = num_in / 25.0;
+                frame = MAKE_FRAME(MP_FRAME_VIDEO, ref);
+            }
+            mp_pin_in_write(f->pins[0], frame);
+            num_in++;
+            continue;
+        }
+
+        struct mp_frame frame = mp_pin_out_read(f->pins[1]);
+        if (frame.type == MP_FRAME_EOF)
+            break;
+        if (frame.type == MP_FRAME_VIDEO) {
+            if (first_out && !num_out) {
+                *first_out = frame.data;
+                frame = MP_NO_FRAME;
+            }
+            num_out++;
+        }
+        mp_frame_unref(&frame);
+
+        mp_filter_graph_run(root);
+    }
+    return num_out;
+}
+
+static void run(struct test_ctx *ctx)
+{
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    struct mp_image *img = create_image(64, 48);
+
+    // A pass-through graph must return the input buffers as they are.
+    struct mp_lavfi *l = mp_lavfi_create_graph(root, MP_FRAME_VIDEO, true,
+                                               NULL, "null");
+    assert_true(l);
+    struct mp_image *out = NULL;
+    assert_int_equal(run_frames(root, l->f, img, 3, &out), 3);
+    assert_true(out);
+    assert_int_equal(out->imgfmt, img->imgfmt);
+    for (int p = 0; p < img->num_planes; p++)
+        assert_true(out->planes[p] == img->planes[p]);
+    talloc_free(out);
+    talloc_free(l->f);
+
+    // Frames returned by libavfilter must not be referenced by the graph
+    // anymore, so they can be modified in place.
+    l = mp_lavfi_create_graph(root, MP_FRAME_VIDEO, true, NULL, "hflip");
+    assert_true(l);
+    out = NULL;
+    assert_int_equal(run_frames(root, l->f, img, 3, &out), 3);
+    assert_true(out);
+    assert_true(out->planes[0] != img->planes[0]);
+    assert_true(mp_image_is_writeable(out));
+    talloc_free(out);
+    talloc_free(l->f);
+
+    talloc_free(img);
+    talloc_free(root);
+}
+
+static const char *const bench_chains[] = {
+    "null",
+    "hflip",
+    "scale=w=1280:h=720",
+    "scale=w=1280:h=720,format=rgb24",
+    "eq=contrast=1.2:saturation=1.1",
+    "gblur=sigma=2",
+    "yadif",
+    "unsharp",
+    NULL
+};
+
+// Throughput of common --vf=lavfi=[...] chains on 1080p input, with slice
+// threading disabled and with libavfilter's automatic thread count.
+// Not part of all-simple, because it takes a while.
+static void run_bench(struct test_ctx *ctx)
+{
+    const int num_frames = 100;
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    struct mp_image *img = create_image(1920, 1080);
+
+    for (int n = 0; bench_chains[n]; n++) {
+        double fps[2];
+        for (int i = 0; i < 2; i++) {
+            char *opts[] = {"threads", i ? "0" : "1", NULL};
+            struct mp_lavfi *l = mp_lavfi_create_graph(root, MP_FRAME_VIDEO,
+                                        true, opts, bench_chains[n]);
+            assert_true(l);
+            int64_t t0 = mp_time_us();
+            int num = run_frames(root, l->f, img, num_frames, NULL);
+            int64_t t1 = mp_time_us();
+            fps[i] = num / MPMAX((t1 - t0) / 1e6, 1e-6);
+            talloc_free(l->f);
+        }
+        MP_INFO(ctx, "%-34s 1 thread %8.1f fps, auto %8.1f fps (x%.2f)\n",
+                bench_chains[n], fps[0], fps[1], fps[1] / fps[0]);
+    }
+
+    talloc_free(img);
+    talloc_free(root);
+}
+
+const struct unittest test_lavfi = {
+    .name = "lavfi",
+    .run = run,
+};
+
+const struct unittest test_lavfi_bench = {
+    .name = "lavfi-bench",
+    .is_complex = true,
+    .run = run_bench,
+};
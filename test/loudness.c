@@ -0,0 +1,74 @@
+#include <math.h>
+
+#include "audio/chmap.h"
+#include "audio/loudness.h"
+#include "tests.h"
+
+#define SECONDS 10
+
+// Measure SECONDS of a sine in the left channel (and the right one if both is
+// set), with the first half muted if silence is set. Returns the integrated
+// loudness and sets *peak to the true peak.
+static double measure(int rate, double freq, double amp, double phase,
+                      bool both, bool silence, double *peak)
+{
+    struct mp_chmap chmap = MP_CHMAP_INIT_STEREO;
+    struct mp_loudness *l = mp_loudness_create(NULL, rate, &chmap);
+
+    int len = rate * SECONDS;
+    float *left = talloc_zero_array(l, float, len);
+    float *right = talloc_zero_array(l, float, len);
+    for (int n = 0; n < len; n++) {
+        if (silence && n < len / 2)
+            continue;
+        left[n] = amp * sin(2 * M_PI * freq * n / rate + phase);
+        if (both)
+            right[n] = left[n];
+    }
+
+    // Odd chunk size, so that blocks don't align with the input.
+    for (int n = 0; n < len; n += 1001) {
+        float *planes[2] = {left + n, right + n};
+        mp_loudness_add(l, planes, MPMIN(len - n, 1001));
+    }
+
+    double res = mp_loudness_get_integrated(l);
+    *peak = mp_loudness_get_true_peak(l);
+    talloc_free(l);
+    return res;
+}
+
+static void run(struct test_ctx *ctx)
+{
+    double peak;
+
+    // Reference from EBU Tech 3341: 997 Hz at -20 dBFS in one channel of a
+    // stereo signal reads -23 LUFS, at any sample rate.
+    assert_float_equal(measure(48000, 997, 0.1, 0, false, false, &peak),
+                       -23.0, 0.1);
+    assert_float_equal(20 * log10(peak), -20.0, 0.1);
+    assert_float_equal(measure(44100, 997, 0.1, 0, false, false, &peak),
+                       -23.0, 0.1);
+
+    // Both channels: +3 dB.
+    assert_float_equal(measure(48000, 997, 0.1, 0, true, false, &peak),
+                       -20.0, 0.1);
+
+    // Silence is gated away.
+    assert_float_equal(measure(48000, 997, 0.1, 0, false, true, &peak),
+                       -23.0, 0.2);
+    assert_true(isinf(measure(48000, 997, 0.0, 0, false, false, &peak)));
+
+    // A sine at fs/4 sampled 45 degrees off its peaks: the sample peak is
+    // 3 dB lower than the true peak.
+    static const int rates[] = {44100, 48000, 96000, 0};
+    for (int n = 0; rates[n]; n++) {
+        measure(rates[n], rates[n] / 4.0, 0.5, M_PI / 4, false, false, &peak);
+        assert_float_equal(20 * log10(peak / 0.5), 0.0, 0.3);
+    }
+}
+
+const struct unittest test_loudness = {
+    .name = "loudness",
+    .run = run,
+};
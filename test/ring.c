@@ -0,0 +1,89 @@
+#include <pthread.h>
+
+#include "common/msg.h"
+#include "misc/ring.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+#define THREADED_BYTES (64 * 1024 * 1024)
+#define CHUNK 4096
+
+static void *producer(void *arg)
+{
+    struct mp_ring *ring = arg;
+    uint8_t buf[CHUNK / 3];
+    uint32_t pos = 0;
+    while (pos < THREADED_BYTES) {
+        int len = MPMIN(sizeof(buf), THREADED_BYTES - pos);
+        for (int n = 0; n < len; n++)
+            buf[n] = (pos + n) * 7;
+        int done = 0;
+        while (done < len)
+            done += mp_ring_write(ring, buf + done, len - done);
+        pos += len;
+    }
+    return NULL;
+}
+
+static void run(struct test_ctx *ctx)
+{
+    struct mp_ring *ring = mp_ring_new(NULL, 10);
+    uint8_t data[16], out[16];
+    for (int n = 0; n < 16; n++)
+        data[n] = n + 1;
+
+    assert_int_equal(mp_ring_size(ring), 10);
+    assert_int_equal(mp_ring_buffered(ring), 0);
+    assert_int_equal(mp_ring_available(ring), 10);
+
+    assert_int_equal(mp_ring_write(ring, data, 16), 10);
+    assert_int_equal(mp_ring_available(ring), 0);
+    assert_int_equal(mp_ring_read(ring, out, 7), 7);
+    assert_memcmp(out, data, 7);
+
+    // Wrap around the end of the buffer.
+    assert_int_equal(mp_ring_write(ring, data, 6), 6);
+    assert_int_equal(mp_ring_buffered(ring), 9);
+    assert_int_equal(mp_ring_drain(ring, 3), 3);
+    assert_int_equal(mp_ring_read(ring, out, 16), 6);
+    assert_memcmp(out, data, 6);
+    assert_int_equal(mp_ring_read(ring, out, 16), 0);
+    talloc_free(ring);
+
+    // One producer and one consumer thread, with odd chunk sizes and a ring
+    // size that is not a power of 2. Also measure how long a read (what an
+    // audio callback does) takes in the worst case while the producer writes.
+    ring = mp_ring_new(NULL, CHUNK * 3 + 1);
+    pthread_t thread;
+    assert_false(pthread_create(&thread, NULL, producer, ring));
+
+    uint8_t buf[CHUNK];
+    uint32_t pos = 0;
+    int64_t worst = 0, total = 0, reads = 0;
+    while (pos < THREADED_BYTES) {
+        int64_t t = mp_time_us();
+        int len = mp_ring_read(ring, buf, sizeof(buf));
+        t = mp_time_us() - t;
+        worst = MPMAX(worst, t);
+        total += t;
+        reads++;
+        for (int n = 0; n < len; n++) {
+            if (buf[n] != (uint8_t)((pos + n) * 7)) {
+                MP_FATAL(ctx, "mismatch at byte %"PRIu32"\n", pos + n);
+                abort();
+            }
+        }
+        pos += len;
+    }
+    pthread_join(thread, NULL);
+    assert_int_equal(mp_ring_buffered(ring), 0);
+    talloc_free(ring);
+
+    MP_INFO(ctx, "%"PRId64" reads, average %.3f us, worst %"PRId64" us\n",
+            reads, total / (double)reads, worst);
+}
+
+const struct unittest test_ring = {
+    .name = "ring",
+    .run = run,
+};
@@ -0,0 +1,269 @@
+#include <libavutil/lfg.h>
+
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "common/msg.h"
+#include "filters/f_output_chain.h"
+#include "filters/filter.h"
+#include "filters/user_filters.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+#define RATE 48000
+#define FRAME_SAMPLES 1024
+
+static struct mp_aframe *create_frame(AVLFG *lfg, int channels, int64_t pos)
+{
+    struct mp_aframe *frame = mp_aframe_create();
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, channels);
+    if (!mp_aframe_set_format(frame, AF_FORMAT_FLOAT) ||
+        !mp_aframe_set_chmap(frame, &chmap) ||
+        !mp_aframe_set_rate(frame, RATE) ||
+        !mp_aframe_alloc_data(frame, FRAME_SAMPLES))
+        abort();
+    mp_aframe_set_pts(frame, pos / (double)RATE);
+
+    // Some tones plus noise, so the correlation has a clear maximum.
+    float *d = (float *)mp_aframe_get_data_rw(frame)[0];
+    for (int n = 0; n < FRAME_SAMPLES; n++) {
+        double t = (pos + n) / (double)RATE;
+        for (int c = 0; c < channels; c++) {
+            double noise = (av_lfg_get(lfg) / (double)UINT32_MAX - 0.5) * 0.1;
+            d[n * channels + c] = 0.4 * sin(2 * M_PI * 220 * (c + 1) * t) +
+                                  0.3 * sin(2 * M_PI * 331 * t) + noise;
+        }
+    }
+    return frame;
+}
+
+// Filter seconds of audio, and return the wall time it took in seconds.
+static double run_filter(struct mp_filter *root, struct mp_filter *f,
+                         int channels, double seconds)
+{
+    AVLFG lfg;
+    av_lfg_init(&lfg, 123);
+    int64_t samples = seconds * RATE;
+    int64_t pos = 0;
+    int64_t time = 0;
+    bool eof_sent = false;
+
+    while (1) {
+        if (!eof_sent && mp_pin_in_needs_data(f->pins[0])) {
+            if (pos < samples) {
+                // Don't count test signal generation.
+                struct mp_aframe *frame = create_frame(&lfg, channels, pos);
+                pos += FRAME_SAMPLES;
+                int64_t t0 = mp_time_us();
+                mp_pin_in_write(f->pins[0], MAKE_FRAME(MP_FRAME_AUDIO, frame));
+                time += mp_time_us() - t0;
+            } else {
+                mp_pin_in_write(f->pins[0], MP_EOF_FRAME);
+                eof_sent = true;
+            }
+            continue;
+        }
+
+        int64_t t0 = mp_time_us();
+        struct mp_frame frame = mp_pin_out_read(f->pins[1]);
+        if (!frame.type)
+            mp_filter_graph_run(root);
+        time += mp_time_us() - t0;
+
+        bool eof = frame.type == MP_FRAME_EOF;
+        mp_frame_unref(&frame);
+        if (eof)
+            break;
+    }
+
+    return time / 1e6;
+}
+
+static const char *const scales[] = {"0.25", "0.5", "1.0", "1.5", "2.0", "3.0",
+                                     "4.0", NULL};
+
+// Compare the direct and the FFT-based overlap search of scaletempo over a
+// range of tempo scales, at the default search length and a long one, and
+// print the real-time factors (seconds of input processed per second).
+// Not part of all-simple, because it takes a while.
+static void run_bench(struct test_ctx *ctx)
+{
+    const double seconds = 20;
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+
+    for (int channels = 2; channels <= 8; channels += 6) {
+        for (int search = 14; search <= 56; search *= 4) {
+            char search_str[20];
+            snprintf(search_str, sizeof(search_str), "%d", search);
+            for (int n = 0; scales[n]; n++) {
+                double rt[2];
+                for (int fft = 0; fft < 2; fft++) {
+                    char *args[] = {"scale", (char *)scales[n],
+                                    "speed", "none",
+                                    "search", search_str,
+                                    "fft", fft ? "yes" : "no", NULL};
+                    struct mp_filter *f = mp_create_user_filter(root,
+                                    MP_OUTPUT_CHAIN_AUDIO, "scaletempo", args);
+                    assert_true(f);
+                    rt[fft] = seconds / run_filter(root, f, channels, seconds);
+                    talloc_free(f);
+                }
+                MP_INFO(ctx, "%d ch, search=%2d, scale=%-4s: direct %7.1fx, "
+                        "fft %7.1fx realtime\n", channels, search, scales[n],
+                        rt[0], rt[1]);
+            }
+        }
+    }
+
+    talloc_free(root);
+}
+
+static const float speeds[] = {0.5, 0.8, 1.25, 2.0, 3.0, 0};
+
+// Real-time factors of scaletempo2 at several speeds, per channel count.
+// Not part of all-simple, because it takes a while.
+static void run_bench2(struct test_ctx *ctx)
+{
+    const double seconds = 20;
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    static const int channel_counts[] = {1, 2, 6, 8, 0};
+
+    for (int c = 0; channel_counts[c]; c++) {
+        for (int n = 0; speeds[n]; n++) {
+            char *args[] = {NULL};
+            struct mp_filter *f = mp_create_user_filter(root,
+                                    MP_OUTPUT_CHAIN_AUDIO, "scaletempo2", args);
+            assert_true(f);
+            struct mp_filter_command cmd = {
+                .type = MP_FILTER_COMMAND_SET_SPEED,
+                .speed = speeds[n],
+            };
+            assert_true(mp_filter_command(f, &cmd));
+            double rt = seconds / run_filter(root, f, channel_counts[c], seconds);
+            MP_INFO(ctx, "%d ch, speed=%.2f: %7.1fx realtime (%7.1fx per "
+                    "channel)\n", channel_counts[c], speeds[n], rt,
+                    rt * channel_counts[c]);
+            talloc_free(f);
+        }
+    }
+
+    talloc_free(root);
+}
+
+// Noise repeating with this period (in samples). Whenever the search range
+// (672 samples by default) contains a shifted copy of the overlap, this gives
+// a single clear correlation maximum. The period is longer than the search
+// range, so there are never two equally good offsets.
+#define NOISE_PERIOD 1499
+
+// Filter periodic noise, and return all output samples (interleaved stereo).
+static float *filter_noise(struct mp_filter *root, struct mp_filter *f,
+                           int num_frames, int *out_samples)
+{
+    AVLFG lfg;
+    av_lfg_init(&lfg, 42);
+    float noise[NOISE_PERIOD * 2];
+    for (int n = 0; n < NOISE_PERIOD * 2; n++)
+        noise[n] = av_lfg_get(&lfg) / (double)UINT32_MAX - 0.5;
+
+    float *out = NULL;
+    int num_out = 0;
+    int64_t pos = 0;
+    int num_in = 0;
+    bool eof_sent = false;
+
+    while (1) {
+        if (!eof_sent && mp_pin_in_needs_data(f->pins[0])) {
+            if (num_in < num_frames) {
+                struct mp_aframe *frame = mp_aframe_create();
+                struct mp_chmap chmap = MP_CHMAP_INIT_STEREO;
+                if (!mp_aframe_set_format(frame, AF_FORMAT_FLOAT) ||
+                    !mp_aframe_set_chmap(frame, &chmap) ||
+                    !mp_aframe_set_rate(frame, RATE) ||
+                    !mp_aframe_alloc_data(frame, FRAME_SAMPLES))
+                    abort();
+                mp_aframe_set_pts(frame, pos / (double)RATE);
+                float *d = (float *)mp_aframe_get_data_rw(frame)[0];
+                for (int n = 0; n < FRAME_SAMPLES; n++) {
+                    int i = (pos + n) % NOISE_PERIOD;
+                    d[n * 2 + 0] = noise[i * 2 + 0];
+                    d[n * 2 + 1] = noise[i * 2 + 1];
+                }
+                pos += FRAME_SAMPLES;
+                num_in++;
+                mp_pin_in_write(f->pins[0], MAKE_FRAME(MP_FRAME_AUDIO, frame));
+            } else {
+                mp_pin_in_write(f->pins[0], MP_EOF_FRAME);
+                eof_sent = true;
+            }
+            continue;
+        }
+
+        struct mp_frame frame = mp_pin_out_read(f->pins[1]);
+        if (frame.type == MP_FRAME_AUDIO) {
+            struct mp_aframe *aframe = frame.data;
+            int samples = mp_aframe_get_size(aframe);
+            float *d = (float *)mp_aframe_get_data_ro(aframe)[0];
+            MP_TARRAY_GROW(NULL, out, (num_out + samples) * 2);
+            memcpy(out + num_out * 2, d, samples * 2 * sizeof(float));
+            num_out += samples;
+        } else if (!frame.type) {
+            mp_filter_graph_run(root);
+        }
+
+        bool eof = frame.type == MP_FRAME_EOF;
+        mp_frame_unref(&frame);
+        if (eof)
+            break;
+    }
+
+    *out_samples = num_out;
+    return out;
+}
+
+// The FFT-based overlap search must find the same offsets as the direct one,
+// which means the output is identical.
+static void run(struct test_ctx *ctx)
+{
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+
+    for (int n = 0; scales[n]; n++) {
+        float *out[2];
+        int num_out[2];
+        for (int fft = 0; fft < 2; fft++) {
+            char *args[] = {"scale", (char *)scales[n],
+                            "speed", "none",
+                            "fft", fft ? "yes" : "no", NULL};
+            struct mp_filter *f = mp_create_user_filter(root,
+                                    MP_OUTPUT_CHAIN_AUDIO, "scaletempo", args);
+            assert_true(f);
+            out[fft] = filter_noise(root, f, 200, &num_out[fft]);
+            talloc_free(f);
+        }
+        assert_int_equal(num_out[0], num_out[1]);
+        assert_true(num_out[0] > 0);
+        assert_memcmp(out[0], out[1], num_out[0] * 2 * sizeof(float));
+        talloc_free(out[0]);
+        talloc_free(out[1]);
+    }
+
+    talloc_free(root);
+}
+
+const struct unittest test_scaletempo = {
+    .name = "scaletempo",
+    .run = run,
+};
+
+const struct unittest test_scaletempo_bench = {
+    .name = "scaletempo-bench",
+    .is_complex = true,
+    .run = run_bench,
+};
+
+const struct unittest test_scaletempo2_bench = {
+    .name = "scaletempo2-bench",
+    .is_complex = true,
+    .run = run_bench2,
+};
@@ -4,17 +4,29 @@
 #include "tests.h"
 
 static const struct unittest *unittests[] = {
+    &test_aframe_pool_buffers,
+    &test_ao_kernels,
+    &test_ao_kernels_bench,
     &test_chmap,
+    &test_dither,
+    &test_dither_bench,
     &test_gl_video,
     &test_img_format,
     &test_json,
+    &test_lavfi,
+    &test_lavfi_bench,
     &test_linked_list,
+    &test_loudness,
     &test_paths,
     &test_repack_sws,
 #if HAVE_ZIMG
     &test_repack, // zimg only due to cross-checking with zimg.c
     &test_repack_zimg,
 #endif
+    &test_ring,
+    &test_scaletempo,
+    &test_scaletempo_bench,
+    &test_scaletempo2_bench,
     NULL
 };
 
@@ -36,14 +36,26 @@ struct unittest {
     void (*run)(struct test_ctx *ctx);
 };
 
+extern const struct unittest test_aframe_pool_buffers;
+extern const struct unittest test_ao_kernels;
+extern const struct unittest test_ao_kernels_bench;
 extern const struct unittest test_chmap;
+extern const struct unittest test_dither;
+extern const struct unittest test_dither_bench;
 extern const struct unittest test_gl_video;
 extern const struct unittest test_img_format;
 extern const struct unittest test_json;
+extern const struct unittest test_lavfi;
+extern const struct unittest test_lavfi_bench;
 extern const struct unittest test_linked_list;
+extern const struct unittest test_loudness;
 extern const struct unittest test_repack_sws;
 extern const struct unittest test_repack_zimg;
 extern const struct unittest test_repack;
+extern const struct unittest test_ring;
+extern const struct unittest test_scaletempo;
+extern const struct unittest test_scaletempo_bench;
+extern const struct unittest test_scaletempo2_bench;
 extern const struct unittest test_paths;
 
 #define assert_true(x) assert(x)
@@ -24,6 +24,7 @@
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
 #include <libavutil/intreadwrite.h>
@@ -51,6 +52,7 @@
 #include "demux/demux.h"
 #include "demux/stheader.h"
 #include "demux/packet.h"
+#include "osdep/timer.h"
 #include "video/csputils.h"
 #include "video/sws_utils.h"
 #include "video/out/vo.h"
@@ -68,6 +70,12 @@ static int hwdec_validate_opt(struct mp_log *log, const m_option_t *opt,
 
 #define HWDEC_DELAY_QUEUE_COUNT 2
 
+// Adaptive threading: length of a measurement window, and the maximum number
+// of thread count changes per stream (to avoid oscillating).
+#define TUNE_WINDOW_SECONDS 2.0
+#define TUNE_WINDOW_MIN_FRAMES 16
+#define TUNE_MAX_CHANGES 8
+
 #define OPT_BASE_STRUCT struct vd_lavc_params
 
 struct vd_lavc_params {
@@ -78,6 +86,7 @@ struct vd_lavc_params {
     int skip_frame;
     int framedrop;
     int threads;
+    int64_t threads_max_memory;
     int bitexact;
     int old_x264;
     int check_hw_profile;
@@ -109,7 +118,10 @@ const struct m_sub_options vd_lavc_conf = {
         {"vd-lavc-skipidct", OPT_DISCARD(skip_idct)},
         {"vd-lavc-skipframe", OPT_DISCARD(skip_frame)},
         {"vd-lavc-framedrop", OPT_DISCARD(framedrop)},
-        {"vd-lavc-threads", OPT_INT(threads), M_RANGE(0, DBL_MAX)},
+        {"vd-lavc-threads", OPT_CHOICE(threads, {"adaptive", -1}),
+            M_RANGE(0, DBL_MAX)},
+        {"vd-lavc-threads-max-memory", OPT_BYTE_SIZE(threads_max_memory),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
         {"vd-lavc-bitexact", OPT_FLAG(bitexact)},
         {"vd-lavc-assume-old-x264", OPT_FLAG(old_x264)},
         {"vd-lavc-check-hw-profile", OPT_FLAG(check_hw_profile)},
@@ -134,6 +146,7 @@ const struct m_sub_options vd_lavc_conf = {
         .skip_frame = AVDISCARD_DEFAULT,
         .framedrop = AVDISCARD_NONREF,
         .dr = 1,
+        .threads_max_memory = 1024 * 1024 * 1024,
         .hwdec_api = "no",
         .hwdec_codecs = "h264,vc1,hevc,vp8,vp9,av1",
         // Maximum number of surfaces the player wants to buffer. This number
@@ -205,6 +218,17 @@ typedef struct lavc_ctx {
 
     AVBufferRef *cached_hw_frames_ctx;
 
+    // Adaptive threading (--vd-lavc-threads=adaptive, software decoding).
+    int tune_threads;           // current thread count (0 if not chosen yet)
+    int tune_target;            // requested thread count (0 if none pending)
+    int tune_changes;
+    int64_t tune_time;          // time spent in libavcodec in this window (us)
+    int tune_frames;
+    double tune_duration;       // media duration of the frames in this window
+    int tune_starved;           // frames output while the player was behind
+    bool starved;               // VDCTRL_SET_STARVED
+    struct demux_packet *tune_pkt; // keyframe held back while draining
+
     // --- The following fields are protected by dr_lock.
     pthread_mutex_t dr_lock;
     bool dr_failed;
@@ -586,6 +610,222 @@ static void reinit(struct mp_filter *vd)
         force_fallback(vd);
 }
 
+static int max_adaptive_threads(void)
+{
+    int threads = av_cpu_count();
+    if (threads > 1)
+        threads += 1; // same as mp_set_avcodec_threads()
+    return MPCLAMP(threads, 1, 16);
+}
+
+// Pick thread count and type for --vd-lavc-threads=adaptive. Starts with a
+// guess based on the resolution, and uses the count requested by
+// update_adaptive_threads() when reopening the decoder.
+static void init_adaptive_threads(struct mp_filter *vd, const AVCodec *codec)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    AVCodecContext *avctx = ctx->avctx;
+    struct mp_codec_params *c = ctx->codec;
+
+    int64_t pixels = (int64_t)c->disp_w * c->disp_h;
+    if (pixels <= 0)
+        pixels = 1920 * 1080;
+
+    int max_threads = max_adaptive_threads();
+    int threads = ctx->tune_target ? ctx->tune_target : ctx->tune_threads;
+    if (!threads) {
+        // Roughly one thread per 640x360 block. 480p starts with 2 threads,
+        // 1080p with 9, and anything larger uses all cores.
+        int64_t block = 640 * 360;
+        threads = MPCLAMP((pixels + block - 1) / block, 2, max_threads);
+    }
+    threads = MPCLAMP(threads, 1, max_threads);
+
+    // Frame threading keeps about one decoded frame per thread in flight.
+    // Assume 3 bytes per pixel (10 bit 4:2:0 plus padding) to bound the
+    // memory it uses. If not even 2 frame threads fit, use slice threading.
+    int type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    int64_t mem_threads = ctx->opts->threads_max_memory / (pixels * 3);
+    if (threads > mem_threads) {
+        if (mem_threads < 2 && (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)) {
+            type = FF_THREAD_SLICE;
+        } else {
+            threads = MPMAX(mem_threads, 1);
+        }
+    }
+
+    MP_VERBOSE(vd, "Adaptive threading: using %d threads (%s).\n", threads,
+               type == FF_THREAD_SLICE ? "slice" : "frame/slice");
+
+    avctx->thread_count = threads;
+    avctx->thread_type = type;
+
+    ctx->tune_threads = threads;
+    ctx->tune_target = 0;
+    ctx->tune_time = 0;
+    ctx->tune_frames = 0;
+    ctx->tune_duration = 0;
+    ctx->tune_starved = 0;
+}
+
+// Return the type of the first VCL NAL unit in an H.264 or HEVC packet, or -1.
+// Packets are length-prefixed if the extradata is avcC/hvcC, Annex B otherwise.
+static int get_h26x_vcl_nal_type(AVCodecContext *avctx, struct demux_packet *pkt)
+{
+    bool hevc = avctx->codec_id == AV_CODEC_ID_HEVC;
+    uint8_t *ex = avctx->extradata;
+    int len_size = 0;
+    if (!hevc && avctx->extradata_size >= 7 && ex[0] == 1)
+        len_size = (ex[4] & 3) + 1;
+    if (hevc && avctx->extradata_size >= 23 && ex[0] == 1)
+        len_size = (ex[21] & 3) + 1;
+
+    uint8_t *data = pkt->buffer;
+    size_t size = pkt->len, pos = 0;
+    while (pos < size) {
+        size_t nal_size;
+        if (len_size) {
+            if (size - pos < (size_t)len_size)
+                break;
+            nal_size = 0;
+            for (int n = 0; n < len_size; n++)
+                nal_size = (nal_size << 8) | data[pos++];
+        } else {
+            // Skip to the byte after the next 00 00 01 start code.
+            while (pos + 3 <= size && AV_RB24(data + pos) != 1)
+                pos++;
+            pos += 3;
+            nal_size = size - MPMIN(pos, size);
+        }
+        if (pos >= size || !nal_size)
+            break;
+        int type = hevc ? (data[pos] >> 1) & 0x3f : data[pos] & 0x1f;
+        if (hevc ? type < 32 : type >= 1 && type <= 5)
+            return type;
+        if (len_size)
+            pos += nal_size;
+    }
+    return -1;
+}
+
+// Whether is_restart_point() can ever be true for the codec. Codecs without
+// inter prediction can restart anywhere. Others (like MPEG-2 with open GOPs)
+// can't be checked, and are never retuned.
+static bool can_restart(AVCodecContext *avctx)
+{
+    switch (avctx->codec_id) {
+    case AV_CODEC_ID_H264:
+    case AV_CODEC_ID_HEVC:
+    case AV_CODEC_ID_VP8:
+    case AV_CODEC_ID_VP9:
+    case AV_CODEC_ID_AV1:
+        return true;
+    default: {
+        const AVCodecDescriptor *desc = avcodec_descriptor_get(avctx->codec_id);
+        return desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY);
+    }
+    }
+}
+
+// Whether the decoder can be reopened at this packet without losing frames.
+// Keyframe flags also mark open-GOP recovery points (H.264 I slices with a
+// recovery point SEI, HEVC CRA), whose leading pictures reference frames
+// before them, so only IDR (and HEVC BLA) pictures are accepted there.
+static bool is_restart_point(vd_ffmpeg_ctx *ctx, struct demux_packet *pkt)
+{
+    AVCodecContext *avctx = ctx->avctx;
+    if (!pkt->keyframe || !can_restart(avctx))
+        return false;
+
+    switch (avctx->codec_id) {
+    case AV_CODEC_ID_H264:
+        return get_h26x_vcl_nal_type(avctx, pkt) == 5;
+    case AV_CODEC_ID_HEVC: {
+        int type = get_h26x_vcl_nal_type(avctx, pkt);
+        return type >= 16 && type <= 20;
+    }
+    default:
+        return true;
+    }
+}
+
+// Called for each decoded frame with adaptive threading. Compares the time
+// spent in libavcodec with the media duration of the decoded frames, and
+// whether the player was starved (as reported by the decoder wrapper). If the
+// decoder can't keep up, request more threads; if it is mostly idle, request
+// fewer, which reduces latency and memory use. The new count is applied on the
+// next packet where is_restart_point() is true.
+static void update_adaptive_threads(struct mp_filter *vd, struct mp_image *mpi)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    if (!can_restart(ctx->avctx))
+        return;
+
+    double duration = mpi->pkt_duration;
+    if (!(duration > 0) && ctx->codec->fps > 0)
+        duration = 1.0 / ctx->codec->fps;
+    // hr-seek framedropping skips frames, which would distort the measurement.
+    if (!(duration > 0) || ctx->framedrop_flags == 2) {
+        ctx->tune_time = 0;
+        return;
+    }
+
+    ctx->tune_frames += 1;
+    ctx->tune_duration += duration;
+    if (ctx->starved)
+        ctx->tune_starved += 1;
+
+    if (ctx->tune_duration < TUNE_WINDOW_SECONDS ||
+        ctx->tune_frames < TUNE_WINDOW_MIN_FRAMES)
+        return;
+
+    double load = ctx->tune_time / 1e6 / ctx->tune_duration;
+    bool starved = ctx->tune_starved > 0;
+    int threads = ctx->tune_threads;
+    int max_threads = max_adaptive_threads();
+    int target = threads;
+
+    if ((load > 0.8 || (starved && load > 0.5)) && threads < max_threads) {
+        target = MPMIN(threads + MPMAX(threads / 2, 1), max_threads);
+    } else if (load < 0.2 && !starved && threads > 2) {
+        target = MPMAX(threads * 2 / 3, 2);
+    }
+
+    MP_DBG(vd, "Adaptive threading: %d threads, load %.0f%%, %d/%d frames "
+           "late.\n", threads, load * 100, ctx->tune_starved, ctx->tune_frames);
+
+    ctx->tune_time = 0;
+    ctx->tune_frames = 0;
+    ctx->tune_duration = 0;
+    ctx->tune_starved = 0;
+
+    if (target != threads && !ctx->tune_target &&
+        ctx->tune_changes < TUNE_MAX_CHANGES)
+    {
+        MP_VERBOSE(vd, "Adaptive threading: changing from %d to %d threads "
+                   "(decoder load %.0f%%%s).\n", threads, target, load * 100,
+                   starved ? ", player starved" : "");
+        ctx->tune_target = target;
+        ctx->tune_changes += 1;
+    }
+}
+
+// The decoder was drained up to the keyframe in ctx->tune_pkt. Reopen it with
+// the new thread count and continue decoding with that keyframe.
+static void apply_adaptive_threads(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    struct demux_packet *pkt = ctx->tune_pkt;
+    ctx->tune_pkt = NULL;
+
+    uninit_avctx(vd);
+    init_avctx(vd);
+
+    MP_TARRAY_APPEND(ctx, ctx->requeue_packets, ctx->num_requeue_packets, pkt);
+}
+
 static void init_avctx(struct mp_filter *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -654,6 +894,8 @@ static void init_avctx(struct mp_filter *vd)
         if (ctx->hwdec.copying)
             ctx->max_delay_queue = HWDEC_DELAY_QUEUE_COUNT;
         ctx->hw_probing = true;
+    } else if (lavc_param->threads < 0) {
+        init_adaptive_threads(vd, lavc_codec);
     } else {
         mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
     }
@@ -737,6 +979,9 @@ static void flush_all(struct mp_filter *vd)
         talloc_free(ctx->requeue_packets[n]);
     ctx->num_requeue_packets = 0;
 
+    talloc_free(ctx->tune_pkt);
+    ctx->tune_pkt = NULL;
+
     reset_avctx(vd);
 }
 
@@ -1011,10 +1256,21 @@ static int send_packet(struct mp_filter *vd, struct demux_packet *pkt)
     if (avctx->skip_frame == AVDISCARD_ALL)
         return 0;
 
+    if (ctx->tune_target && ctx->opts->threads < 0 && !ctx->use_hwdec &&
+        pkt && !ctx->tune_pkt && is_restart_point(ctx, pkt))
+    {
+        // Drain the decoder; receive_frame() reopens it once it's empty.
+        ctx->tune_pkt = demux_copy_packet(pkt);
+        avcodec_send_packet(avctx, NULL);
+        return 0;
+    }
+
     AVPacket avpkt;
     mp_set_av_packet(&avpkt, pkt, &ctx->codec_timebase);
 
+    int64_t t0 = mp_time_us();
     int ret = avcodec_send_packet(avctx, pkt ? &avpkt : NULL);
+    ctx->tune_time += mp_time_us() - t0;
     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
         return ret;
 
@@ -1058,7 +1314,9 @@ static int decode_frame(struct mp_filter *vd)
     if (ctx->num_requeue_packets)
         send_queued_packet(vd);
 
+    int64_t t0 = mp_time_us();
     int ret = avcodec_receive_frame(avctx, ctx->pic);
+    ctx->tune_time += mp_time_us() - t0;
     if (ret < 0) {
         if (ret == AVERROR_EOF) {
             // If flushing was initialized earlier and has ended now, make it
@@ -1127,6 +1385,11 @@ static int receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
         return 0; // force retry
     }
 
+    if (ret == AVERROR_EOF && ctx->tune_pkt && !ctx->num_delay_queue) {
+        apply_adaptive_threads(vd);
+        return 0; // force retry
+    }
+
     if (ret == AVERROR(EAGAIN) && ctx->num_requeue_packets)
         return 0; // force retry, so send_queued_packet() gets called
 
@@ -1165,6 +1428,9 @@ static int receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
         ctx->hwdec_notified = true;
     }
 
+    if (ctx->opts->threads < 0 && !ctx->use_hwdec)
+        update_adaptive_threads(vd, res);
+
     if (ctx->hw_probing) {
         for (int n = 0; n < ctx->num_sent_packets; n++)
             talloc_free(ctx->sent_packets[n]);
@@ -1183,6 +1449,9 @@ static int control(struct mp_filter *vd, enum dec_ctrl cmd, void *arg)
     case VDCTRL_SET_FRAMEDROP:
         ctx->framedrop_flags = *(int *)arg;
         return CONTROL_TRUE;
+    case VDCTRL_SET_STARVED:
+        ctx->starved = *(bool *)arg;
+        return CONTROL_TRUE;
     case VDCTRL_GET_BFRAMES: {
         AVCodecContext *avctx = ctx->avctx;
         if (!avctx)
@@ -1224,6 +1493,7 @@ static void reset(struct mp_filter *vd)
 
     ctx->state = (struct lavc_state){0};
     ctx->framedrop_flags = 0;
+    ctx->starved = false;
 }
 
 static void destroy(struct mp_filter *vd)
@@ -15,7 +15,11 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
 #include <math.h>
+#include <stdio.h>
+
+#include <libavutil/intreadwrite.h>
 
 #include "common/common.h"
 #include "common/tags.h"
@@ -23,6 +27,8 @@
 #include "filters/filter_internal.h"
 #include "filters/user_filters.h"
 #include "options/m_option.h"
+#include "options/path.h"
+#include "osdep/io.h"
 #include "video/img_format.h"
 #include "video/sws_utils.h"
 #include "video/zimg.h"
@@ -31,10 +37,19 @@
 
 #define PRINT_ENTRY_NUM 10
 
+// Binary index file header: magic, format version, fingerprint width/height,
+// 2 reserved bytes. Each following record is a 64 bit little endian double
+// (the frame pts, NAN if unknown) followed by width*height gray bytes.
+#define INDEX_MAGIC "MPFP"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 8
+
 struct f_opts {
     int type;
     int clear;
     int print;
+    char *index;
+    int fast;
 };
 
 const struct m_opt_choice_alternatives type_names[] = {
@@ -48,6 +63,8 @@ static const struct m_option f_opts_list[] = {
     {"type", OPT_CHOICE_C(type, type_names)},
     {"clear-on-query", OPT_FLAG(clear)},
     {"print", OPT_FLAG(print)},
+    {"index", OPT_STRING(index), .flags = M_OPT_FILE},
+    {"fast", OPT_FLAG(fast)},
     {0}
 };
 
@@ -69,8 +86,90 @@ struct priv {
     struct print_entry entries[PRINT_ENTRY_NUM];
     int num_entries;
     bool fallback_warning;
+    uint32_t *colsum;       // box_downscale() scratch, one entry per column
+    int colsum_size;
+    uint8_t expand_lut[256];// limited to full range luma expansion
+    FILE *index;
+    bool index_error;
 };
 
+static const char hex_digits[] = "0123456789abcdef";
+
+// Whether box_downscale() can be used on this image.
+static bool can_box_downscale(struct mp_image *mpi, int size)
+{
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(mpi->imgfmt);
+    return (desc.flags & (MP_IMGFLAG_YUV_P | MP_IMGFLAG_YUV_NV)) &&
+           (desc.flags & MP_IMGFLAG_NE) && desc.bpp[0] == 8 &&
+           mpi->w >= size && mpi->h >= size;
+}
+
+// Downscale the 8 bit luma plane of src into dst (IMGFMT_Y8) by averaging
+// each source rectangle covered by a destination pixel. This reads the
+// source exactly once, and the inner loops are simple enough to be
+// auto-vectorized. Much faster than a general purpose scaler, and it works
+// for the tiny output sizes needed here.
+static void box_downscale(struct priv *p, struct mp_image *dst,
+                          struct mp_image *src, bool expand)
+{
+    int sw = src->w, sh = src->h;
+    int size = dst->w;
+
+    if (p->colsum_size < sw) {
+        p->colsum = talloc_realloc(p, p->colsum, uint32_t, sw);
+        p->colsum_size = sw;
+    }
+    uint32_t *restrict colsum = p->colsum;
+
+    for (int y = 0; y < size; y++) {
+        int y0 = (int64_t)y * sh / size;
+        int y1 = (int64_t)(y + 1) * sh / size;
+
+        memset(colsum, 0, sw * sizeof(colsum[0]));
+        for (int sy = y0; sy < y1; sy++) {
+            const uint8_t *restrict line =
+                src->planes[0] + sy * (ptrdiff_t)src->stride[0];
+            for (int x = 0; x < sw; x++)
+                colsum[x] += line[x];
+        }
+
+        uint8_t *out = dst->planes[0] + y * (ptrdiff_t)dst->stride[0];
+        for (int x = 0; x < size; x++) {
+            int x0 = (int64_t)x * sw / size;
+            int x1 = (int64_t)(x + 1) * sw / size;
+            uint64_t sum = 0;
+            for (int sx = x0; sx < x1; sx++)
+                sum += colsum[sx];
+            uint64_t count = (uint64_t)(x1 - x0) * (y1 - y0);
+            uint8_t v = (sum + count / 2) / count;
+            out[x] = expand ? p->expand_lut[v] : v;
+        }
+    }
+}
+
+static void write_index_entry(struct mp_filter *f, double pts)
+{
+    struct priv *p = f->priv;
+    int size = p->scaled->w;
+
+    union { double d; uint64_t i; } u;
+    u.d = pts == MP_NOPTS_VALUE ? NAN : pts;
+    uint8_t buf[8 + 16 * 16];
+    assert(size <= 16);
+    AV_WL64(buf, u.i);
+    for (int y = 0; y < size; y++) {
+        memcpy(buf + 8 + y * size,
+               p->scaled->planes[0] + y * (ptrdiff_t)p->scaled->stride[0],
+               size);
+    }
+
+    size_t len = 8 + size * size;
+    if (fwrite(buf, len, 1, p->index) != 1 && !p->index_error) {
+        MP_ERR(f, "Error writing fingerprint index file.\n");
+        p->index_error = true;
+    }
+}
+
 // (Other code internal to this filter also calls this to reset the frame list.)
 static void f_reset(struct mp_filter *f)
 {
@@ -106,7 +205,10 @@ static void f_process(struct mp_filter *f)
     // Make output always full range; no reason to lose precision.
     p->scaled->params.color.levels = MP_CSP_LEVELS_PC;
 
-    if (!mp_zimg_convert(p->zimg, p->scaled, mpi)) {
+    if (p->opts->fast && can_box_downscale(mpi, p->scaled->w)) {
+        bool expand = mpi->params.color.levels != MP_CSP_LEVELS_PC;
+        box_downscale(p, p->scaled, mpi, expand);
+    } else if (!mp_zimg_convert(p->zimg, p->scaled, mpi)) {
         if (!p->fallback_warning) {
             MP_WARN(f, "Falling back to libswscale.\n");
             p->fallback_warning = true;
@@ -130,9 +232,14 @@ static void f_process(struct mp_filter *f)
         for (int x = 0; x < size; x++) {
             char *offs = &e->print[(y * size + x) * 2];
             uint8_t v = p->scaled->planes[0][y * p->scaled->stride[0] + x];
-            snprintf(offs, 3, "%02x", v);
+            offs[0] = hex_digits[v >> 4];
+            offs[1] = hex_digits[v & 15];
         }
     }
+    e->print[size * size * 2] = '\0';
+
+    if (p->index)
+        write_index_entry(f, e->pts);
 
     if (p->opts->print)
         MP_INFO(f, "%f: %s\n", e->pts, e->print);
@@ -177,11 +284,21 @@ static bool f_command(struct mp_filter *f, struct mp_filter_command *cmd)
     }
 }
 
+static void f_destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (p->index && fclose(p->index) && !p->index_error)
+        MP_ERR(f, "Error writing fingerprint index file.\n");
+    p->index = NULL;
+}
+
 static const struct mp_filter_info filter = {
     .name = "fingerprint",
     .process = f_process,
     .command = f_command,
     .reset = f_reset,
+    .destroy = f_destroy,
     .priv_size = sizeof(struct priv),
 };
 
@@ -214,6 +331,28 @@ static struct mp_filter *f_create(struct mp_filter *parent, void *options)
         .dither = ZIMG_DITHER_NONE,
         .fast = 1,
     };
+
+    for (int n = 0; n < 256; n++)
+        p->expand_lut[n] = MPCLAMP(((n - 16) * 255 + 219 / 2) / 219, 0, 255);
+
+    if (p->opts->index && p->opts->index[0]) {
+        char *path = mp_get_user_path(p, f->global, p->opts->index);
+        p->index = fopen(path, "wb");
+        if (!p->index) {
+            MP_FATAL(f, "Could not open fingerprint index file '%s'.\n", path);
+            talloc_free(f);
+            return NULL;
+        }
+        uint8_t header[INDEX_HEADER_SIZE] = {0};
+        memcpy(header, INDEX_MAGIC, 4);
+        header[4] = INDEX_VERSION;
+        header[5] = size;
+        if (fwrite(header, sizeof(header), 1, p->index) != 1) {
+            MP_ERR(f, "Error writing fingerprint index file.\n");
+            p->index_error = true;
+        }
+    }
+
     return f;
 }
 
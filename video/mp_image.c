@@ -35,6 +35,7 @@
 #include "common/common.h"
 #include "hwdec.h"
 #include "mp_image.h"
+#include "mp_image_pool.h"
 #include "sws_utils.h"
 #include "fmt-conversion.h"
 
@@ -172,7 +173,9 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
         return false;
 
     // Note: mp_image_pool assumes this creates only 1 AVBufferRef.
-    mpi->bufs[0] = av_buffer_alloc(size + align);
+    mpi->bufs[0] = mp_image_global_pool_alloc(size + align);
+    if (!mpi->bufs[0])
+        mpi->bufs[0] = av_buffer_alloc(size + align);
     if (!mpi->bufs[0])
         return false;
 
@@ -19,9 +19,14 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <pthread.h>
 #include <assert.h>
 
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
 #include <libavutil/buffer.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/mem.h>
@@ -29,6 +34,9 @@
 #include "mpv_talloc.h"
 
 #include "common/common.h"
+#include "common/stats.h"
+#include "misc/linked_list.h"
+#include "options/m_option.h"
 
 #include "fmt-conversion.h"
 #include "mp_image.h"
@@ -426,3 +434,250 @@ struct mp_image *mp_av_pool_image_hw_upload(struct AVBufferRef *hw_frames_ctx,
     mp_image_copy_attributes(dst, src);
     return dst;
 }
+
+// Process-wide pool of large image buffers. Unlike struct mp_image_pool, this
+// is not tied to a specific format or size: buffers are grouped by size class,
+// so that all decoders, filters and VOs in the process share the same set of
+// big allocations. This is fully thread-safe.
+
+#define GPOOL_MIN_SIZE_LOG2 18      // smaller allocations are never pooled
+#define GPOOL_MAX_SIZE_LOG2 31
+#define GPOOL_CLASS_STEPS 4         // classes per power of 2 (max. 25% waste)
+#define GPOOL_NUM_CLASSES \
+    ((GPOOL_MAX_SIZE_LOG2 - GPOOL_MIN_SIZE_LOG2) * GPOOL_CLASS_STEPS)
+#define GPOOL_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+struct gpool_buf {
+    // Both lists are used only while the buffer is unused and cached.
+    struct {
+        struct gpool_buf *prev, *next;
+    } lru;                          // all cached buffers, most recent at head
+    struct {
+        struct gpool_buf *prev, *next;
+    } cls;                          // cached buffers of the same size class
+    uint8_t *data;
+    size_t size;
+    int cls_index;
+};
+
+struct gpool_class {
+    struct gpool_buf *head, *tail;
+};
+
+static pthread_mutex_t gpool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    struct mp_image_global_pool_opts opts;
+    struct {
+        struct gpool_buf *head, *tail;
+    } lru;
+    struct gpool_class classes[GPOOL_NUM_CLASSES];
+    struct mp_image_global_pool_stats stats;
+} gpool;
+
+#define OPT_BASE_STRUCT struct mp_image_global_pool_opts
+
+const struct m_sub_options mp_image_global_pool_conf = {
+    .opts = (const struct m_option[]){
+        {"frame-pool", OPT_FLAG(enable), .flags = UPDATE_FRAME_POOL},
+        {"frame-pool-max-size", OPT_BYTE_SIZE(max_bytes),
+            M_RANGE(0, M_MAX_MEM_BYTES), .flags = UPDATE_FRAME_POOL},
+        {"frame-pool-hugepages", OPT_FLAG(hugepages),
+            .flags = UPDATE_FRAME_POOL},
+        {0}
+    },
+    .size = sizeof(struct mp_image_global_pool_opts),
+    .defaults = &(const struct mp_image_global_pool_opts){
+        .max_bytes = 512 * 1024 * 1024,
+    },
+};
+
+#undef OPT_BASE_STRUCT
+
+// Return the size class for the given allocation size, or -1 if it is not
+// pooled. *out_size is set to the size all buffers of this class have.
+static int gpool_size_class(size_t size, size_t *out_size)
+{
+    if (size < ((size_t)1 << GPOOL_MIN_SIZE_LOG2))
+        return -1;
+    for (int n = 0; n < GPOOL_NUM_CLASSES; n++) {
+        size_t base = (size_t)1 << (GPOOL_MIN_SIZE_LOG2 + n / GPOOL_CLASS_STEPS);
+        size_t csize = base + base / GPOOL_CLASS_STEPS * (n % GPOOL_CLASS_STEPS);
+        if (size <= csize) {
+            *out_size = csize;
+            return n;
+        }
+    }
+    return -1;
+}
+
+static void gpool_buf_free(struct gpool_buf *buf)
+{
+#if HAVE_POSIX
+    free(buf->data);
+#else
+    av_free(buf->data);
+#endif
+    talloc_free(buf);
+}
+
+static struct gpool_buf *gpool_buf_alloc(size_t size, int cls_index,
+                                         bool hugepages)
+{
+    struct gpool_buf *buf = talloc_zero(NULL, struct gpool_buf);
+    buf->size = size;
+    buf->cls_index = cls_index;
+#if HAVE_POSIX
+    size_t align = MP_IMAGE_BYTE_ALIGN;
+    if (hugepages && size >= GPOOL_HUGEPAGE_SIZE)
+        align = GPOOL_HUGEPAGE_SIZE;
+    void *data = NULL;
+    if (posix_memalign(&data, align, size))
+        data = NULL;
+    buf->data = data;
+#ifdef MADV_HUGEPAGE
+    // The kernel can back only whole, aligned 2 MB regions with hugepages.
+    if (buf->data && align == GPOOL_HUGEPAGE_SIZE)
+        madvise(buf->data, size & ~(size_t)(GPOOL_HUGEPAGE_SIZE - 1), MADV_HUGEPAGE);
+#endif
+#else
+    buf->data = av_malloc(size);
+#endif
+    if (!buf->data) {
+        talloc_free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// Free cached buffers (least recently used first) until the size limit is met.
+// Returns a list of buffers the caller must free outside of the lock.
+static struct gpool_buf *gpool_trim_locked(int64_t limit)
+{
+    struct gpool_buf *freelist = NULL;
+    while (gpool.lru.tail && gpool.stats.cached_bytes > limit) {
+        struct gpool_buf *buf = gpool.lru.tail;
+        LL_REMOVE(lru, &gpool.lru, buf);
+        LL_REMOVE(cls, &gpool.classes[buf->cls_index], buf);
+        gpool.stats.cached_bytes -= buf->size;
+        gpool.stats.trimmed++;
+        buf->lru.next = freelist; // reuse as singly linked free list
+        freelist = buf;
+    }
+    return freelist;
+}
+
+static void gpool_free_list(struct gpool_buf *list)
+{
+    while (list) {
+        struct gpool_buf *next = list->lru.next;
+        gpool_buf_free(list);
+        list = next;
+    }
+}
+
+static void gpool_release(void *opaque, uint8_t *data)
+{
+    struct gpool_buf *buf = opaque;
+    struct gpool_buf *freelist = buf;
+
+    pthread_mutex_lock(&gpool_mutex);
+    gpool.stats.used_bytes -= buf->size;
+    if (gpool.opts.enable && buf->size <= gpool.opts.max_bytes) {
+        // Most recently used buffers are reused first (likely still in cache).
+        LL_PREPEND(lru, &gpool.lru, buf);
+        LL_PREPEND(cls, &gpool.classes[buf->cls_index], buf);
+        gpool.stats.cached_bytes += buf->size;
+        freelist = gpool_trim_locked(gpool.opts.max_bytes);
+    } else {
+        buf->lru.next = NULL;
+    }
+    pthread_mutex_unlock(&gpool_mutex);
+
+    gpool_free_list(freelist);
+}
+
+// Allocate a buffer of at least the given size from the global pool. Returns
+// NULL if the pool is disabled or the size is not handled by it; the caller
+// is supposed to fall back to a normal allocation in this case.
+struct AVBufferRef *mp_image_global_pool_alloc(size_t size)
+{
+    size_t csize;
+    int cls_index = gpool_size_class(size, &csize);
+    if (cls_index < 0)
+        return NULL;
+
+    pthread_mutex_lock(&gpool_mutex);
+    if (!gpool.opts.enable) {
+        pthread_mutex_unlock(&gpool_mutex);
+        return NULL;
+    }
+    bool hugepages = gpool.opts.hugepages;
+    struct gpool_buf *buf = gpool.classes[cls_index].head;
+    if (buf) {
+        LL_REMOVE(lru, &gpool.lru, buf);
+        LL_REMOVE(cls, &gpool.classes[cls_index], buf);
+        gpool.stats.cached_bytes -= buf->size;
+        gpool.stats.hits++;
+    } else {
+        gpool.stats.misses++;
+    }
+    pthread_mutex_unlock(&gpool_mutex);
+
+    if (!buf)
+        buf = gpool_buf_alloc(csize, cls_index, hugepages);
+    if (!buf)
+        return NULL;
+
+    pthread_mutex_lock(&gpool_mutex);
+    gpool.stats.used_bytes += buf->size;
+    pthread_mutex_unlock(&gpool_mutex);
+
+    // Note: buf->size can be larger than requested; users rely on ->size.
+    AVBufferRef *ref = av_buffer_create(buf->data, buf->size, gpool_release,
+                                        buf, 0);
+    if (!ref)
+        gpool_release(buf, buf->data);
+    return ref;
+}
+
+// Apply new options. Since the pool is process-wide, the last caller wins.
+void mp_image_global_pool_set_opts(struct mp_image_global_pool_opts *opts)
+{
+    pthread_mutex_lock(&gpool_mutex);
+    gpool.opts = *opts;
+    struct gpool_buf *freelist =
+        gpool_trim_locked(gpool.opts.enable ? gpool.opts.max_bytes : 0);
+    pthread_mutex_unlock(&gpool_mutex);
+
+    gpool_free_list(freelist);
+}
+
+// Free all cached (unused) buffers.
+void mp_image_global_pool_flush(void)
+{
+    pthread_mutex_lock(&gpool_mutex);
+    struct gpool_buf *freelist = gpool_trim_locked(0);
+    pthread_mutex_unlock(&gpool_mutex);
+
+    gpool_free_list(freelist);
+}
+
+void mp_image_global_pool_get_stats(struct mp_image_global_pool_stats *st)
+{
+    pthread_mutex_lock(&gpool_mutex);
+    *st = gpool.stats;
+    pthread_mutex_unlock(&gpool_mutex);
+}
+
+// Export the pool counters through the stats mechanism.
+void mp_image_global_pool_report(struct stats_ctx *ctx)
+{
+    struct mp_image_global_pool_stats st;
+    mp_image_global_pool_get_stats(&st);
+    stats_size_value(ctx, "cached", st.cached_bytes);
+    stats_size_value(ctx, "used", st.used_bytes);
+    stats_value(ctx, "hits", st.hits);
+    stats_value(ctx, "misses", st.misses);
+    stats_value(ctx, "trimmed", st.trimmed);
+}
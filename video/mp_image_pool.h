@@ -2,6 +2,8 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
@@ -41,4 +43,28 @@ bool mp_update_av_hw_frames_pool(struct AVBufferRef **hw_frames_ctx,
 struct mp_image *mp_av_pool_image_hw_upload(struct AVBufferRef *hw_frames_ctx,
                                             struct mp_image *src);
 
+struct mp_image_global_pool_opts {
+    int enable;
+    int64_t max_bytes;
+    int hugepages;
+};
+
+extern const struct m_sub_options mp_image_global_pool_conf;
+
+struct mp_image_global_pool_stats {
+    int64_t cached_bytes;   // unused buffers kept for reuse
+    int64_t used_bytes;     // buffers currently referenced by images
+    uint64_t hits;          // allocations served from cached buffers
+    uint64_t misses;        // allocations that required a new buffer
+    uint64_t trimmed;       // cached buffers freed due to the size limit
+};
+
+struct stats_ctx;
+
+struct AVBufferRef *mp_image_global_pool_alloc(size_t size);
+void mp_image_global_pool_set_opts(struct mp_image_global_pool_opts *opts);
+void mp_image_global_pool_flush(void);
+void mp_image_global_pool_get_stats(struct mp_image_global_pool_stats *st);
+void mp_image_global_pool_report(struct stats_ctx *ctx);
+
 #endif
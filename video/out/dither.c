@@ -27,10 +27,15 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <libavutil/lfg.h>
 
 #include "mpv_talloc.h"
+#include "common/msg.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "stream/stream.h"
 #include "dither.h"
 
 #define MAX_SIZEB 8
@@ -48,8 +53,11 @@ struct ctx {
     unsigned int gauss_middle;
     uint64_t gauss[MAX_SIZE2];
     index_t randomat[MAX_SIZE2];
-    bool calcmat[MAX_SIZE2];
+    // Cells which were not assigned a value yet (in ascending order), and the
+    // sum of the gauss kernels centered on all assigned cells for each of them.
+    index_t freemat[MAX_SIZE2];
     uint64_t gaussmat[MAX_SIZE2];
+    unsigned int num_free;
     index_t unimat[MAX_SIZE2];
     AVLFG avlfg;
 };
@@ -100,43 +108,46 @@ static void makegauss(struct ctx *k, unsigned int sizeb)
     }
 }
 
-static void setbit(struct ctx *k, index_t c)
+static inline void update_min(uint64_t total, unsigned int n, uint64_t *min,
+                              index_t *randomat, index_t *resnum)
 {
-    if (k->calcmat[c])
-        return;
-    k->calcmat[c] = true;
-    uint64_t *m = k->gaussmat;
-    uint64_t *me = k->gaussmat + k->size2;
-    uint64_t *g = k->gauss + WRAP_SIZE2(k, k->gauss_middle + k->size2 - c);
-    uint64_t *ge = k->gauss + k->size2;
-    while (g < ge)
-        *m++ += *g++;
-    g = k->gauss;
-    while (m < me)
-        *m++ += *g++;
+    if (total <= *min) {
+        if (total != *min) {
+            *min = total;
+            *resnum = 0;
+        }
+        randomat[(*resnum)++] = n;
+    }
 }
 
-static index_t getmin(struct ctx *k)
+// Mark the cell at position pos in the free list as assigned: remove it, and
+// add the gauss kernel centered on it to all remaining free cells. At the same
+// time, pick the free cell with the minimum sum (ties are broken randomly),
+// and return its position in the updated free list.
+// Doing both in one pass, and only over cells that are still free, gives
+// exactly the same result as updating and then scanning the whole matrix.
+static unsigned int setbit_getmin(struct ctx *k, unsigned int pos)
 {
+    const uint64_t *g = k->gauss;
+    index_t goffset = k->gauss_middle + k->size2 - k->freemat[pos];
     uint64_t min = UINT64_MAX;
     index_t resnum = 0;
-    unsigned int size2 = k->size2;
-    for (index_t c = 0; c < size2; c++) {
-        if (k->calcmat[c])
-            continue;
-        uint64_t total = k->gaussmat[c];
-        if (total <= min) {
-            if (total != min) {
-                min = total;
-                resnum = 0;
-            }
-            k->randomat[resnum++] = c;
-        }
+    for (unsigned int n = 0; n < pos; n++) {
+        index_t c = k->freemat[n];
+        uint64_t total = k->gaussmat[n] + g[WRAP_SIZE2(k, goffset + c)];
+        k->gaussmat[n] = total;
+        update_min(total, n, &min, k->randomat, &resnum);
+    }
+    for (unsigned int n = pos + 1; n < k->num_free; n++) {
+        index_t c = k->freemat[n];
+        uint64_t total = k->gaussmat[n] + g[WRAP_SIZE2(k, goffset + c)];
+        k->freemat[n - 1] = c;
+        k->gaussmat[n - 1] = total;
+        update_min(total, n - 1, &min, k->randomat, &resnum);
     }
+    k->num_free -= 1;
     if (resnum == 1)
         return k->randomat[0];
-    if (resnum == size2)
-        return size2 / 2;
     return k->randomat[av_lfg_get(&k->avlfg) % resnum];
 }
 
@@ -144,9 +155,16 @@ static void makeuniform(struct ctx *k)
 {
     unsigned int size2 = k->size2;
     for (index_t c = 0; c < size2; c++) {
-        index_t r = getmin(k);
-        setbit(k, r);
-        k->unimat[r] = c;
+        k->freemat[c] = c;
+        k->gaussmat[c] = 0;
+    }
+    k->num_free = size2;
+    // All cells are equal initially; start in the middle.
+    unsigned int pos = size2 / 2;
+    k->unimat[pos] = 0;
+    for (index_t c = 1; c < size2; c++) {
+        pos = setbit_getmin(k, pos);
+        k->unimat[k->freemat[pos]] = c;
     }
 }
 
@@ -164,6 +182,73 @@ void mp_make_fruit_dither_matrix(float *out_matrix, int size)
     talloc_free(k);
 }
 
+// Matrices generated so far, indexed by size. Never freed.
+static pthread_mutex_t fruit_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static float *fruit_cache[MAX_SIZEB + 1];
+
+static bool load_fruit_matrix(struct mpv_global *global, const char *file,
+                              float *out_matrix, size_t bytes)
+{
+    if (stat(file, &(struct stat){0}) != 0)
+        return false;
+    void *tmp = talloc_new(NULL);
+    struct bstr data = stream_read_file(file, tmp, global, bytes + 1);
+    bool ok = data.len == bytes;
+    if (ok)
+        memcpy(out_matrix, data.start, bytes);
+    talloc_free(tmp);
+    return ok;
+}
+
+const float *mp_get_fruit_dither_matrix(struct mpv_global *global,
+                                        struct mp_log *log,
+                                        const char *cache_dir, int size)
+{
+    assert(size >= 1 && size <= MAX_SIZEB);
+
+    pthread_mutex_lock(&fruit_cache_lock);
+
+    float *res = fruit_cache[size];
+    if (res)
+        goto done;
+
+    int tsize = 1 << size;
+    size_t bytes = tsize * tsize * sizeof(float);
+    res = malloc(bytes);
+    if (!res)
+        goto done;
+
+    char *file = NULL;
+    if (cache_dir && cache_dir[0]) {
+        char *dir = mp_get_user_path(NULL, global, cache_dir);
+        char name[40];
+        snprintf(name, sizeof(name), "fruit-dither-v1-%d.bin", size);
+        file = mp_path_join(NULL, dir, name);
+        mp_mkdirp(dir);
+        talloc_free(dir);
+    }
+
+    if (file && load_fruit_matrix(global, file, res, bytes)) {
+        mp_verbose(log, "Loaded dither matrix from '%s'.\n", file);
+    } else {
+        mp_make_fruit_dither_matrix(res, size);
+        if (file) {
+            FILE *out = fopen(file, "wb");
+            if (out) {
+                fwrite(res, bytes, 1, out);
+                fclose(out);
+            }
+        }
+    }
+    talloc_free(file);
+
+    fruit_cache[size] = res;
+
+done:
+    pthread_mutex_unlock(&fruit_cache_lock);
+    return res;
+}
+
 void mp_make_ordered_dither_matrix(unsigned char *m, int size)
 {
     m[0] = 0;
@@ -1,2 +1,13 @@
+struct mpv_global;
+struct mp_log;
+
 void mp_make_fruit_dither_matrix(float *out_matrix, int size);
 void mp_make_ordered_dither_matrix(unsigned char *m, int size);
+
+// Like mp_make_fruit_dither_matrix(), but the result is memoized for the
+// lifetime of the process, and if cache_dir is set, also stored in and loaded
+// from that directory. The returned matrix must not be freed. Returns NULL on
+// OOM.
+const float *mp_get_fruit_dither_matrix(struct mpv_global *global,
+                                        struct mp_log *log,
+                                        const char *cache_dir, int size);
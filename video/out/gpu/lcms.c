@@ -36,9 +36,17 @@
 #if HAVE_LCMS2
 
 #include <lcms2.h>
+#include <libavutil/cpu.h>
 #include <libavutil/sha.h>
 #include <libavutil/mem.h>
 
+#include "misc/thread_pool.h"
+
+struct lut_cache_entry {
+    uint8_t hash[32];
+    uint16_t *data;
+};
+
 struct gl_lcms {
     void *icc_data;
     size_t icc_size;
@@ -52,6 +60,11 @@ struct gl_lcms {
     struct mp_log *log;
     struct mpv_global *global;
     struct mp_icc_opts *opts;
+
+    // Recently used LUTs, most recently used first.
+    struct lut_cache_entry *lut_cache;
+    int num_lut_cache;
+    size_t lut_cache_size;
 };
 
 static bool parse_3dlut_size(const char *arg, int *p1, int *p2, int *p3)
@@ -82,6 +95,8 @@ const struct m_sub_options mp_icc_conf = {
         {"icc-profile", OPT_STRING(profile), .flags = M_OPT_FILE},
         {"icc-profile-auto", OPT_FLAG(profile_auto)},
         {"icc-cache-dir", OPT_STRING(cache_dir), .flags = M_OPT_FILE},
+        {"icc-cache-memory", OPT_BYTE_SIZE(cache_memory),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
         {"icc-intent", OPT_INT(intent)},
         {"icc-contrast", OPT_CHOICE(contrast, {"inf", -1}),
             M_RANGE(0, 1000000)},
@@ -95,6 +110,7 @@ const struct m_sub_options mp_icc_conf = {
         .size_str = "64x64x64",
         .intent = INTENT_RELATIVE_COLORIMETRIC,
         .use_embedded = true,
+        .cache_memory = 128 * 1024 * 1024,
     },
 };
 
@@ -132,6 +148,49 @@ static void load_profile(struct gl_lcms *p)
     p->current_profile = talloc_strdup(p, p->opts->profile);
 }
 
+// Remove the least recently used LUTs until at most max_size bytes are used.
+static void lut_cache_trim(struct gl_lcms *p, int64_t max_size)
+{
+    while (p->num_lut_cache && (int64_t)p->lut_cache_size > max_size) {
+        struct lut_cache_entry *e = &p->lut_cache[p->num_lut_cache - 1];
+        p->lut_cache_size -= talloc_get_size(e->data);
+        talloc_free(e->data);
+        p->num_lut_cache -= 1;
+    }
+}
+
+// If a LUT with the given hash is cached, copy it to output (which must have
+// the correct size) and make it the most recently used one.
+static bool lut_cache_get(struct gl_lcms *p, uint8_t *hash, uint16_t *output)
+{
+    for (int n = 0; n < p->num_lut_cache; n++) {
+        struct lut_cache_entry e = p->lut_cache[n];
+        if (memcmp(e.hash, hash, sizeof(e.hash)) == 0) {
+            size_t size = talloc_get_size(e.data);
+            if (size != talloc_get_size(output))
+                return false;
+            memcpy(output, e.data, size);
+            MP_TARRAY_REMOVE_AT(p->lut_cache, p->num_lut_cache, n);
+            MP_TARRAY_INSERT_AT(p, p->lut_cache, p->num_lut_cache, 0, e);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void lut_cache_add(struct gl_lcms *p, uint8_t *hash, uint16_t *data)
+{
+    size_t size = talloc_get_size(data);
+    if ((int64_t)size > p->opts->cache_memory)
+        return;
+    lut_cache_trim(p, p->opts->cache_memory - size);
+
+    struct lut_cache_entry e = { .data = talloc_memdup(p, data, size) };
+    memcpy(e.hash, hash, sizeof(e.hash));
+    MP_TARRAY_INSERT_AT(p, p->lut_cache, p->num_lut_cache, 0, e);
+    p->lut_cache_size += size;
+}
+
 static void gl_lcms_destructor(void *ptr)
 {
     struct gl_lcms *p = ptr;
@@ -161,6 +220,8 @@ void gl_lcms_update_options(struct gl_lcms *p)
         load_profile(p);
     }
 
+    lut_cache_trim(p, p->opts->cache_memory);
+
     p->changed = true; // probably
 }
 
@@ -345,6 +406,109 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
     return vid_profile;
 }
 
+struct lut_slice {
+    struct gl_lcms *p;
+    bstr vid_icc;           // serialized video profile
+    int size[3];
+    int b0, b1;             // range of blue values to compute
+    uint16_t *output;
+    bool ok;
+};
+
+// Compute a part of the LUT. This creates its own lcms context and transform,
+// so that it can run concurrently with other slices.
+static void compute_lut_slice(void *ctx)
+{
+    struct lut_slice *s = ctx;
+    struct gl_lcms *p = s->p;
+    int s_r = s->size[0], s_g = s->size[1], s_b = s->size[2];
+
+    cmsContext cms = cmsCreateContext(NULL, p);
+    if (!cms)
+        return;
+    cmsSetLogErrorHandlerTHR(cms, lcms2_error_handler);
+
+    cmsHTRANSFORM trafo = NULL;
+    cmsHPROFILE profile =
+        cmsOpenProfileFromMemTHR(cms, p->icc_data, p->icc_size);
+    cmsHPROFILE vid_hprofile =
+        cmsOpenProfileFromMemTHR(cms, s->vid_icc.start, s->vid_icc.len);
+    if (profile && vid_hprofile) {
+        trafo = cmsCreateTransformTHR(cms, vid_hprofile, TYPE_RGB_16,
+                                      profile, TYPE_RGBA_16,
+                                      p->opts->intent,
+                                      cmsFLAGS_HIGHRESPRECALC |
+                                      cmsFLAGS_BLACKPOINTCOMPENSATION);
+    }
+    if (profile)
+        cmsCloseProfile(profile);
+    if (vid_hprofile)
+        cmsCloseProfile(vid_hprofile);
+
+    if (trafo) {
+        // transform a (s_r)x(s_g)x(s_b) cube, with 3 components per channel
+        uint16_t *input = talloc_array(NULL, uint16_t, s_r * 3);
+        for (int b = s->b0; b < s->b1; b++) {
+            for (int g = 0; g < s_g; g++) {
+                for (int r = 0; r < s_r; r++) {
+                    input[r * 3 + 0] = r * 65535 / (s_r - 1);
+                    input[r * 3 + 1] = g * 65535 / (s_g - 1);
+                    input[r * 3 + 2] = b * 65535 / (s_b - 1);
+                }
+                size_t base = (b * s_r * s_g + g * s_r) * 4;
+                cmsDoTransform(trafo, input, s->output + base, s_r);
+            }
+        }
+        talloc_free(input);
+        cmsDeleteTransform(trafo);
+        s->ok = true;
+    }
+
+    cmsDeleteContext(cms);
+}
+
+// Fill output with the LUT, split into slices along the blue axis, which are
+// computed in parallel.
+static bool compute_lut(struct gl_lcms *p, void *tmp, bstr vid_icc,
+                        int s_r, int s_g, int s_b, uint16_t *output)
+{
+    int num_slices = MPCLAMP(av_cpu_count(), 1, s_b);
+    struct mp_thread_pool *pool = NULL;
+    if (num_slices > 1) {
+        pool = mp_thread_pool_create(tmp, num_slices - 1, num_slices - 1,
+                                     num_slices - 1);
+        if (!pool)
+            num_slices = 1;
+    }
+
+    MP_VERBOSE(p, "Computing 3D LUT using %d threads.\n", num_slices);
+
+    struct lut_slice *slices = talloc_zero_array(tmp, struct lut_slice,
+                                                 num_slices);
+    for (int n = 0; n < num_slices; n++) {
+        slices[n] = (struct lut_slice){
+            .p = p,
+            .vid_icc = vid_icc,
+            .size = {s_r, s_g, s_b},
+            .b0 = s_b * n / num_slices,
+            .b1 = s_b * (n + 1) / num_slices,
+            .output = output,
+        };
+    }
+
+    // The last slice is computed on this thread.
+    for (int n = 0; n < num_slices - 1; n++)
+        mp_thread_pool_queue(pool, compute_lut_slice, &slices[n]);
+    compute_lut_slice(&slices[num_slices - 1]);
+    talloc_free(pool); // waits until all slices are done
+
+    for (int n = 0; n < num_slices; n++) {
+        if (!slices[n].ok)
+            return false;
+    }
+    return true;
+}
+
 bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
                        enum mp_csp_prim prim, enum mp_csp_trc trc,
                        struct AVBufferRef *vid_profile)
@@ -378,28 +542,36 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
     struct lut3d *lut = NULL;
     cmsContext cms = NULL;
 
+    bool from_memory = false;
+
+    // Gamma is included in the header to help uniquely identify it,
+    // because we may change the parameter in the future or make it
+    // customizable, same for the primaries.
+    char *cache_info = talloc_asprintf(tmp,
+            "ver=1.4, intent=%d, size=%dx%dx%d, prim=%d, trc=%d, "
+            "contrast=%d\n",
+            p->opts->intent, s_r, s_g, s_b, prim, trc, p->opts->contrast);
+
+    uint8_t hash[32];
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    av_sha_update(sha, cache_info, strlen(cache_info));
+    if (vid_profile)
+        av_sha_update(sha, vid_profile->data, vid_profile->size);
+    av_sha_update(sha, p->icc_data, p->icc_size);
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    if (lut_cache_get(p, hash, output)) {
+        MP_VERBOSE(p, "Using 3D LUT from memory cache.\n");
+        from_memory = true;
+        goto done;
+    }
+
     char *cache_file = NULL;
     if (p->opts->cache_dir && p->opts->cache_dir[0]) {
-        // Gamma is included in the header to help uniquely identify it,
-        // because we may change the parameter in the future or make it
-        // customizable, same for the primaries.
-        char *cache_info = talloc_asprintf(tmp,
-                "ver=1.4, intent=%d, size=%dx%dx%d, prim=%d, trc=%d, "
-                "contrast=%d\n",
-                p->opts->intent, s_r, s_g, s_b, prim, trc, p->opts->contrast);
-
-        uint8_t hash[32];
-        struct AVSHA *sha = av_sha_alloc();
-        if (!sha)
-            abort();
-        av_sha_init(sha, 256);
-        av_sha_update(sha, cache_info, strlen(cache_info));
-        if (vid_profile)
-            av_sha_update(sha, vid_profile->data, vid_profile->size);
-        av_sha_update(sha, p->icc_data, p->icc_size);
-        av_sha_final(sha, hash);
-        av_free(sha);
-
         char *cache_dir = mp_get_user_path(tmp, p->global, p->opts->cache_dir);
         cache_file = talloc_strdup(tmp, "");
         for (int i = 0; i < sizeof(hash); i++)
@@ -438,32 +610,25 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
         goto error_exit;
     }
 
-    cmsHTRANSFORM trafo = cmsCreateTransformTHR(cms, vid_hprofile, TYPE_RGB_16,
-                                                profile, TYPE_RGBA_16,
-                                                p->opts->intent,
-                                                cmsFLAGS_HIGHRESPRECALC |
-                                                cmsFLAGS_BLACKPOINTCOMPENSATION);
     cmsCloseProfile(profile);
+
+    // The worker threads use their own lcms contexts, so pass the generated
+    // video profile to them in serialized form.
+    cmsUInt32Number vid_icc_size = 0;
+    bstr vid_icc = {0};
+    if (cmsSaveProfileToMem(vid_hprofile, NULL, &vid_icc_size)) {
+        vid_icc.start = talloc_size(tmp, vid_icc_size);
+        vid_icc.len = vid_icc_size;
+        if (!cmsSaveProfileToMem(vid_hprofile, vid_icc.start, &vid_icc_size))
+            vid_icc.len = 0;
+    }
     cmsCloseProfile(vid_hprofile);
 
-    if (!trafo)
+    if (!vid_icc.len)
         goto error_exit;
 
-    // transform a (s_r)x(s_g)x(s_b) cube, with 3 components per channel
-    uint16_t *input = talloc_array(tmp, uint16_t, s_r * 3);
-    for (int b = 0; b < s_b; b++) {
-        for (int g = 0; g < s_g; g++) {
-            for (int r = 0; r < s_r; r++) {
-                input[r * 3 + 0] = r * 65535 / (s_r - 1);
-                input[r * 3 + 1] = g * 65535 / (s_g - 1);
-                input[r * 3 + 2] = b * 65535 / (s_b - 1);
-            }
-            size_t base = (b * s_r * s_g + g * s_r) * 4;
-            cmsDoTransform(trafo, input, output + base, s_r);
-        }
-    }
-
-    cmsDeleteTransform(trafo);
+    if (!compute_lut(p, tmp, vid_icc, s_r, s_g, s_b, output))
+        goto error_exit;
 
     if (cache_file) {
         FILE *out = fopen(cache_file, "wb");
@@ -475,6 +640,9 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
 
 done: ;
 
+    if (!from_memory)
+        lut_cache_add(p, hash, output);
+
     lut = talloc_ptrtype(NULL, lut);
     *lut = (struct lut3d) {
         .data = talloc_steal(lut, output),
@@ -14,6 +14,7 @@ struct mp_icc_opts {
     char *profile;
     int profile_auto;
     char *cache_dir;
+    int64_t cache_memory;
     char *size_str;
     int intent;
     int contrast;
@@ -274,10 +274,6 @@ struct gl_video {
     int frames_rendered;
     AVLFG lfg;
 
-    // Cached because computing it can take relatively long
-    int last_dither_matrix_size;
-    float *last_dither_matrix;
-
     struct cached_file *files;
     int num_files;
 
@@ -425,6 +421,7 @@ const struct m_sub_options gl_video_conf = {
             {"error-diffusion", DITHER_ERROR_DIFFUSION},
             {"no", DITHER_NONE})},
         {"dither-size-fruit", OPT_INT(dither_size), M_RANGE(2, 8)},
+        {"dither-cache-dir", OPT_STRING(dither_cache_dir), .flags = M_OPT_FILE},
         {"temporal-dither", OPT_FLAG(temporal_dither)},
         {"temporal-dither-period", OPT_INT(temporal_dither_period),
             M_RANGE(1, 128)},
@@ -2741,12 +2738,10 @@ static void pass_dither(struct gl_video *p)
             int sizeb = p->opts.dither_size;
             int size = 1 << sizeb;
 
-            if (p->last_dither_matrix_size != size) {
-                p->last_dither_matrix = talloc_realloc(p, p->last_dither_matrix,
-                                                       float, size * size);
-                mp_make_fruit_dither_matrix(p->last_dither_matrix, sizeb);
-                p->last_dither_matrix_size = size;
-            }
+            const float *matrix =
+                mp_get_fruit_dither_matrix(p->global, p->log,
+                                           p->opts.dither_cache_dir, sizeb);
+            MP_HANDLE_OOM(matrix);
 
             // Prefer R16 texture since they provide higher precision.
             fmt = ra_find_unorm_format(p->ra, 2, 1);
@@ -2754,11 +2749,11 @@ static void pass_dither(struct gl_video *p)
                 fmt = ra_find_float16_format(p->ra, 1);
             if (fmt) {
                 tex_size = size;
-                tex_data = p->last_dither_matrix;
+                tex_data = (void *)matrix;
                 if (fmt->ctype == RA_CTYPE_UNORM) {
                     uint16_t *t = temp = talloc_array(NULL, uint16_t, size * size);
                     for (int n = 0; n < size * size; n++)
-                        t[n] = p->last_dither_matrix[n] * UINT16_MAX;
+                        t[n] = matrix[n] * UINT16_MAX;
                     tex_data = t;
                 }
             } else {
@@ -132,6 +132,7 @@ struct gl_video_opts {
     int dither_depth;
     int dither_algo;
     int dither_size;
+    char *dither_cache_dir;
     int temporal_dither;
     int temporal_dither_period;
     char *error_diffusion;
@@ -1,9 +1,29 @@
+#include <limits.h>
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+
 #include "config.h"
 #include "libmpv/render_gl.h"
 #include "libmpv.h"
+#include "misc/thread_pool.h"
+#include "sub/draw_bmp.h"
 #include "sub/osd.h"
 #include "video/sws_utils.h"
 
+#define MAX_SLICES 16
+#define MAX_OSD_RCS 64
+#define MAX_DIRTY_RCS (MAX_OSD_RCS + 1)
+
+struct priv;
+
+struct slice {
+    struct priv *p;
+    int index;
+    struct mp_sws_context *sws;     // for sliced conversion only
+    bool ok;
+};
+
 struct priv {
     struct libmpv_gpu_context *context;
 
@@ -14,13 +34,194 @@ struct priv {
     struct mp_rect src_rc, dst_rc;
     struct mp_osd_res osd_rc;
     bool anything_changed;
+
+    // Slice threading. Slice 0 runs on the render thread.
+    struct mp_thread_pool *pool;
+    struct slice slices[MAX_SLICES];
+    int num_slices;
+    void (*slice_fn)(struct slice *s, int num_slices);
+    int active_slices;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int num_running;
+
+    // Arguments for the slice functions during render().
+    struct mp_image *cur_src, *cur_dst, *cur_target;
+
+    // OSD is blended directly with the overlay from osd_cache if the target
+    // format allows it.
+    struct mp_draw_sub_cache *osd_cache;
+    struct mp_image *osd_overlay;
+    struct mp_rect osd_act_rcs[MAX_OSD_RCS];
+    int num_osd_act_rcs;
+    bool osd_blend_ok;
+    int osd_bpp;                    // target bytes per pixel
+    int osd_offsets[4];             // target byte offset of R, G, B, A (or -1)
+
+    bool had_frame;
+    uint64_t last_frame_id;
 };
 
+static void slice_worker(void *ctx)
+{
+    struct slice *s = ctx;
+    struct priv *p = s->p;
+
+    p->slice_fn(s, p->active_slices);
+
+    pthread_mutex_lock(&p->lock);
+    p->num_running -= 1;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Run fn on num_slices slices in parallel, and wait until all are done.
+static void run_slices(struct priv *p, void (*fn)(struct slice *s, int num),
+                       int num_slices)
+{
+    num_slices = MPCLAMP(num_slices, 1, p->num_slices);
+
+    p->slice_fn = fn;
+    p->active_slices = num_slices;
+    p->num_running = num_slices - 1;
+    for (int n = 1; n < num_slices; n++)
+        mp_thread_pool_queue(p->pool, slice_worker, &p->slices[n]);
+
+    fn(&p->slices[0], num_slices);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->num_running)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Smallest or largest component bit depth.
+static int comp_bits(struct mp_imgfmt_desc *desc, bool smallest)
+{
+    int res = smallest ? INT_MAX : 0;
+    for (int n = 0; n < MP_NUM_COMPONENTS; n++) {
+        int size = desc->comps[n].size;
+        if (size)
+            res = smallest ? MPMIN(res, size) : MPMAX(res, size);
+    }
+    return res;
+}
+
+// Whether converting src to dst in independent horizontal bands gives the
+// same result as converting the whole image. With vertical chroma subsampling,
+// swscale's chroma interpolation would be clamped at each band edge, and if it
+// dithers (reducing the bit depth), the dither pattern would restart at each
+// band; both leave visible seams.
+static bool can_scale_slices(struct mp_image *src, struct mp_image *dst)
+{
+    struct mp_imgfmt_desc s = src->fmt, d = dst->fmt;
+    if (src->h != dst->h || s.chroma_ys ||
+        !(s.flags & MP_IMGFLAG_HAS_COMPS) || !(d.flags & MP_IMGFLAG_HAS_COMPS))
+        return false;
+    return comp_bits(&s, false) <= comp_bits(&d, true);
+}
+
+// Convert a horizontal band of cur_src to cur_dst. Use only if
+// can_scale_slices() is true, so the bands are independent.
+static void scale_slice(struct slice *s, int num_slices)
+{
+    struct priv *p = s->p;
+    struct mp_image src = *p->cur_src;
+    struct mp_image dst = *p->cur_dst;
+
+    int align = MPMAX(src.fmt.align_y, 1);
+    int y0 = MP_ALIGN_DOWN(src.h * s->index / num_slices, align);
+    int y1 = s->index == num_slices - 1
+           ? src.h : MP_ALIGN_DOWN(src.h * (s->index + 1) / num_slices, align);
+
+    s->ok = true;
+    if (y0 >= y1)
+        return;
+
+    mp_image_crop(&src, 0, y0, src.w, y1);
+    mp_image_crop(&dst, 0, y0, dst.w, y1);
+    s->ok = mp_sws_scale(s->sws, &dst, &src) >= 0;
+}
+
+// Blend the premultiplied BGRA OSD overlay onto a horizontal band of the
+// target. Uses the same arithmetic as draw_bmp.c.
+static void blend_slice(struct slice *s, int num_slices)
+{
+    struct priv *p = s->p;
+    struct mp_image *ov = p->osd_overlay;
+    struct mp_image *dst = p->cur_target;
+    int bpp = p->osd_bpp;
+    int o_r = p->osd_offsets[0], o_g = p->osd_offsets[1],
+        o_b = p->osd_offsets[2], o_a = p->osd_offsets[3];
+
+    int h = MPMIN(ov->h, dst->h);
+    int y0 = h * s->index / num_slices;
+    int y1 = h * (s->index + 1) / num_slices;
+
+    for (int n = 0; n < p->num_osd_act_rcs; n++) {
+        struct mp_rect rc = p->osd_act_rcs[n];
+        rc.x1 = MPMIN(rc.x1, MPMIN(ov->w, dst->w));
+        rc.y0 = MPMAX(rc.y0, y0);
+        rc.y1 = MPMIN(rc.y1, y1);
+
+        for (int y = rc.y0; y < rc.y1; y++) {
+            uint8_t *src_line = ov->planes[0] + y * (ptrdiff_t)ov->stride[0];
+            uint8_t *dst_line = dst->planes[0] + y * (ptrdiff_t)dst->stride[0];
+            for (int x = rc.x0; x < rc.x1; x++) {
+                uint8_t *sp = src_line + x * 4;
+                unsigned ia = 255u - sp[3];
+                if (ia == 255u)
+                    continue;
+                uint8_t *dp = dst_line + x * bpp;
+                dp[o_r] = sp[2] + dp[o_r] * ia / 255u;
+                dp[o_g] = sp[1] + dp[o_g] * ia / 255u;
+                dp[o_b] = sp[0] + dp[o_b] * ia / 255u;
+                if (o_a >= 0)
+                    dp[o_a] = sp[3] + dp[o_a] * ia / 255u;
+            }
+        }
+    }
+}
+
+// Whether the target format is simple enough for blend_slice().
+static void setup_osd_blend(struct priv *p)
+{
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(p->dst_params.imgfmt);
+
+    p->osd_blend_ok = false;
+    if (!(desc.flags & MP_IMGFLAG_HAS_COMPS) ||
+        !(desc.flags & MP_IMGFLAG_TYPE_UINT) || desc.endian_shift ||
+        (desc.bpp[0] != 24 && desc.bpp[0] != 32))
+        return;
+
+    for (int n = 0; n < 4; n++) {
+        struct mp_imgfmt_comp_desc c = desc.comps[n];
+        p->osd_offsets[n] = -1;
+        if (n == 3 && !c.size)
+            continue;
+        if (c.plane != 0 || c.size != 8 || c.offset % 8 || c.pad)
+            return;
+        p->osd_offsets[n] = c.offset / 8;
+    }
+
+    p->osd_bpp = desc.bpp[0] / 8;
+    p->osd_blend_ok = true;
+}
+
+static void add_dirty_rc(struct mp_rect *rcs, int *num_rcs, struct mp_rect rc)
+{
+    if (rc.x0 < rc.x1 && rc.y0 < rc.y1 && *num_rcs < MAX_DIRTY_RCS)
+        rcs[(*num_rcs)++] = rc;
+}
+
 static int init(struct render_backend *ctx, mpv_render_param *params)
 {
     ctx->priv = talloc_zero(NULL, struct priv);
     struct priv *p = ctx->priv;
 
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
     char *api = get_mpv_render_param(params, MPV_RENDER_PARAM_API_TYPE, NULL);
     if (!api)
         return MPV_ERROR_INVALID_PARAMETER;
@@ -31,6 +232,24 @@ static int init(struct render_backend *ctx, mpv_render_param *params)
     p->sws = mp_sws_alloc(p);
     mp_sws_enable_cmdline_opts(p->sws, ctx->global);
 
+    p->osd_cache = mp_draw_sub_alloc(p, ctx->global);
+
+    p->num_slices = MPCLAMP(av_cpu_count(), 1, MAX_SLICES);
+    if (p->num_slices > 1) {
+        int threads = p->num_slices - 1;
+        p->pool = mp_thread_pool_create(p, threads, threads, threads);
+        if (!p->pool)
+            p->num_slices = 1;
+    }
+    for (int n = 0; n < p->num_slices; n++) {
+        struct slice *s = &p->slices[n];
+        s->p = p;
+        s->index = n;
+        s->sws = mp_sws_alloc(p);
+        mp_sws_enable_cmdline_opts(s->sws, ctx->global);
+        s->sws->force_scaler = MP_SWS_SWS;
+    }
+
     p->anything_changed = true;
 
     return 0;
@@ -104,9 +323,15 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
     size_t *stride = get_mpv_render_param(params, MPV_RENDER_PARAM_SW_STRIDE, NULL);
     void *ptr = get_mpv_render_param(params, MPV_RENDER_PARAM_SW_POINTER, NULL);
 
+    mpv_render_sw_dirty_rects *dirty =
+        get_mpv_render_param(params, MPV_RENDER_PARAM_SW_DIRTY_RECTS, NULL);
+
     if (!sz || !fmt || !stride || !ptr)
         return MPV_ERROR_INVALID_PARAMETER;
 
+    if (dirty)
+        dirty->num_rects = 0;
+
     char *prev_fmt = mp_imgfmt_to_name(p->dst_params.imgfmt);
     if (strcmp(prev_fmt, fmt) != 0)
         p->anything_changed = true;
@@ -114,6 +339,8 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
     if (sz[0] != p->dst_params.w || sz[1] != p->dst_params.h)
         p->anything_changed = true;
 
+    bool full_redraw = p->anything_changed;
+
     if (p->anything_changed) {
         p->dst_params = (struct mp_image_params){
             .imgfmt = mp_imgfmt_from_name(bstr0(fmt)),
@@ -148,6 +375,8 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
                 return MPV_ERROR_UNSUPPORTED; // probably
         }
 
+        setup_osd_blend(p);
+
         p->anything_changed = false;
     }
 
@@ -161,7 +390,19 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
     wrap_img.planes[0] = ptr;
     wrap_img.stride[0] = *stride;
 
+    struct mp_rect dirty_rcs[MAX_DIRTY_RCS];
+    int num_dirty_rcs = 0;
+
     struct mp_image *img = frame->current;
+
+    // Border and video area change only if the frame changes.
+    if (!!img != p->had_frame)
+        full_redraw = true;
+    if (img && frame->frame_id != p->last_frame_id)
+        add_dirty_rc(dirty_rcs, &num_dirty_rcs, p->dst_rc);
+    p->had_frame = !!img;
+    p->last_frame_id = img ? frame->frame_id : 0;
+
     if (img) {
         assert(p->src_params.imgfmt);
 
@@ -176,7 +417,23 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
         struct mp_image dst = wrap_img;
         mp_image_crop_rc(&dst, p->dst_rc);
 
-        if (mp_sws_scale(p->sws, &dst, &src) < 0) {
+        // zimg does its own slice threading. swscale does not, but if there's
+        // no vertical scaling, horizontal bands can be converted separately.
+        bool ok;
+        if (!p->sws->zimg_ok && p->num_slices > 1 &&
+            can_scale_slices(&src, &dst))
+        {
+            p->cur_src = &src;
+            p->cur_dst = &dst;
+            run_slices(p, scale_slice, dst.h / 16);
+            ok = true;
+            for (int n = 0; n < p->active_slices; n++)
+                ok &= p->slices[n].ok;
+        } else {
+            ok = mp_sws_scale(p->sws, &dst, &src) >= 0;
+        }
+
+        if (!ok) {
             mp_image_clear(&wrap_img, 0, 0, wrap_img.w, wrap_img.h);
             return MPV_ERROR_GENERIC;
         }
@@ -184,15 +441,67 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
         mp_image_clear(&wrap_img, 0, 0, wrap_img.w, wrap_img.h);
     }
 
-    if (p->osd)
-        osd_draw_on_image(p->osd, p->osd_rc, img ? img->pts : 0, 0, &wrap_img);
+    double pts = img ? img->pts : 0;
+    if (p->osd && p->osd_blend_ok) {
+        struct sub_bitmap_list *sbs =
+            osd_render(p->osd, p->osd_rc, pts, 0, mp_draw_sub_formats);
+        struct mp_rect mod_rcs[MAX_OSD_RCS];
+        int num_mod_rcs = 0;
+        p->osd_overlay = mp_draw_sub_overlay(p->osd_cache, sbs,
+                                             p->osd_act_rcs, MAX_OSD_RCS,
+                                             &p->num_osd_act_rcs,
+                                             mod_rcs, MAX_OSD_RCS,
+                                             &num_mod_rcs);
+        if (p->osd_overlay) {
+            for (int n = 0; n < num_mod_rcs; n++)
+                add_dirty_rc(dirty_rcs, &num_dirty_rcs, mod_rcs[n]);
+            if (p->num_osd_act_rcs) {
+                p->cur_target = &wrap_img;
+                run_slices(p, blend_slice, wrap_img.h / 16);
+            }
+        } else {
+            MP_WARN(ctx, "Failed rendering OSD.\n");
+            full_redraw = true;
+        }
+        p->osd_overlay = NULL;
+        talloc_free(sbs);
+    } else if (p->osd) {
+        osd_draw_on_image(p->osd, p->osd_rc, pts, 0, &wrap_img);
+        full_redraw = true; // unknown which parts changed
+    }
+
+    if (dirty) {
+        struct mp_rect all = {0, 0, wrap_img.w, wrap_img.h};
+        if (full_redraw) {
+            dirty_rcs[0] = all;
+            num_dirty_rcs = 1;
+        } else if (num_dirty_rcs > dirty->max_rects) {
+            struct mp_rect bb = dirty_rcs[0];
+            for (int n = 1; n < num_dirty_rcs; n++)
+                mp_rect_union(&bb, &dirty_rcs[n]);
+            dirty_rcs[0] = bb;
+            num_dirty_rcs = 1;
+        }
+        for (int n = 0; n < num_dirty_rcs && n < dirty->max_rects; n++) {
+            struct mp_rect rc = dirty_rcs[n];
+            if (!mp_rect_intersection(&rc, &all))
+                continue;
+            dirty->rects[dirty->num_rects++] = (mpv_render_sw_rect){
+                .x0 = rc.x0, .y0 = rc.y0, .x1 = rc.x1, .y1 = rc.y1,
+            };
+        }
+    }
 
     return 0;
 }
 
 static void destroy(struct render_backend *ctx)
 {
-    // nop
+    struct priv *p = ctx->priv;
+
+    talloc_free(p->pool);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
 }
 
 const struct render_backend_fns render_backend_sw = {
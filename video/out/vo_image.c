@@ -20,18 +20,22 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
+#include <libavutil/cpu.h>
 #include <libswscale/swscale.h>
 
 #include "config.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "options/m_config.h"
 #include "options/path.h"
 #include "mpv_talloc.h"
 #include "common/common.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
@@ -50,6 +54,7 @@ static const struct m_sub_options image_writer_conf = {
 struct vo_image_opts {
     struct image_writer_opts *opts;
     char *outdir;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct vo_image_opts
@@ -58,16 +63,36 @@ static const struct m_sub_options vo_image_conf = {
     .opts = (const struct m_option[]) {
         {"vo-image", OPT_SUBSTRUCT(opts, image_writer_conf)},
         {"vo-image-outdir", OPT_STRING(outdir), .flags = M_OPT_FILE},
+        {"vo-image-threads", OPT_CHOICE(threads, {"auto", -1}),
+            M_RANGE(0, 64)},
         {0},
     },
     .size = sizeof(struct vo_image_opts),
 };
 
+struct image_job {
+    struct priv *p;
+    struct mp_image *image;
+    char *filename;
+    bool done, ok;      // protected by priv.lock
+};
+
 struct priv {
     struct vo_image_opts *opts;
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct stats_ctx *stats;
 
     struct mp_image *current;
     int frame;
+
+    // Asynchronous encoding, if encoder!=NULL.
+    struct mp_thread_pool *encoder;
+    int max_jobs;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct image_job **jobs; // in frame order
+    int num_jobs;
 };
 
 static bool checked_mkdir(struct vo *vo, const char *buf)
@@ -104,6 +129,51 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     osd_draw_on_image(vo->osd, dim, mpi->pts, OSD_DRAW_SUB_ONLY, p->current);
 }
 
+static void encode_job(void *ctx)
+{
+    struct image_job *job = ctx;
+    struct priv *p = job->p;
+
+    bool ok = write_image(job->image, p->opts->opts, job->filename,
+                          p->global, p->log);
+
+    pthread_mutex_lock(&p->lock);
+    job->ok = ok;
+    job->done = true;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Remove finished jobs from the head of the queue, so that completion is
+// reported in frame order. Wait until at most max_pending jobs are left.
+static void retire_jobs(struct vo *vo, int max_pending)
+{
+    struct priv *p = vo->priv;
+
+    pthread_mutex_lock(&p->lock);
+    while (p->num_jobs) {
+        struct image_job *job = p->jobs[0];
+        if (!job->done) {
+            if (p->num_jobs <= max_pending)
+                break;
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+        MP_TARRAY_REMOVE_AT(p->jobs, p->num_jobs, 0);
+        pthread_mutex_unlock(&p->lock);
+
+        if (job->ok) {
+            MP_INFO(vo, "Saved %s\n", job->filename);
+            stats_event(p->stats, "written");
+        }
+        talloc_free(job);
+
+        pthread_mutex_lock(&p->lock);
+    }
+    stats_value(p->stats, "queue", p->num_jobs);
+    pthread_mutex_unlock(&p->lock);
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
@@ -119,8 +189,27 @@ static void flip_page(struct vo *vo)
     if (p->opts->outdir && strlen(p->opts->outdir))
         filename = mp_path_join(t, p->opts->outdir, filename);
 
-    MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts->opts, filename, vo->global, vo->log);
+    if (p->encoder) {
+        struct image_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct image_job){
+            .p = p,
+            .image = p->current,
+            .filename = talloc_strdup(job, filename),
+        };
+        talloc_steal(job, job->image);
+        p->current = NULL;
+
+        pthread_mutex_lock(&p->lock);
+        MP_TARRAY_APPEND(p, p->jobs, p->num_jobs, job);
+        pthread_mutex_unlock(&p->lock);
+        mp_thread_pool_queue(p->encoder, encode_job, job);
+
+        // Limit memory usage by the number of frames in flight.
+        retire_jobs(vo, p->max_jobs);
+    } else {
+        MP_INFO(vo, "Saving %s\n", filename);
+        write_image(p->current, p->opts->opts, filename, vo->global, vo->log);
+    }
 
     talloc_free(t);
     mp_image_unrefp(&p->current);
@@ -137,6 +226,13 @@ static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
+    if (p->encoder) {
+        retire_jobs(vo, 0);
+        talloc_free(p->encoder);
+        pthread_cond_destroy(&p->wakeup);
+        pthread_mutex_destroy(&p->lock);
+    }
+
     mp_image_unrefp(&p->current);
 }
 
@@ -146,6 +242,26 @@ static int preinit(struct vo *vo)
     p->opts = mp_get_config_group(vo, vo->global, &vo_image_conf);
     if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir))
         return -1;
+    p->global = vo->global;
+    p->log = vo->log;
+    p->stats = stats_ctx_create(p, vo->global, "vo-image");
+
+    int threads = p->opts->threads;
+    if (threads < 0)
+        threads = av_cpu_count();
+    if (threads > 0) {
+        pthread_mutex_init(&p->lock, NULL);
+        pthread_cond_init(&p->wakeup, NULL);
+        p->max_jobs = threads * 2;
+        p->encoder = mp_thread_pool_create(p, threads, threads, threads);
+        if (!p->encoder) {
+            MP_ERR(vo, "Could not create encoder threads.\n");
+            pthread_cond_destroy(&p->wakeup);
+            pthread_mutex_destroy(&p->lock);
+            return -1;
+        }
+        MP_VERBOSE(vo, "Using %d encoder threads.\n", threads);
+    }
     return 0;
 }
 
@@ -20,14 +20,17 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "config.h"
 #include "common/common.h"
 #include "options/options.h"
+#include "osdep/atomic.h"
 #include "video/fmt-conversion.h"
 #include "video/mp_image.h"
+#include "video/sws_utils.h"
 #include "mpv_talloc.h"
 #include "vo.h"
 
@@ -35,8 +38,18 @@
 
 #include "sub/osd.h"
 
-struct priv {
+// One per output file (the main one, and each --oextra).
+struct output {
+    struct vo *vo;
     struct encoder_context *enc;
+    int scale_w, scale_h;           // requested size, see encode_lavc_context
+    struct mp_sws_context *sws;     // if the output size differs from input
+};
+
+struct priv {
+    struct output *outputs;
+    int num_outputs;
+    atomic_int num_ready;           // number of outputs with muxer initialized
 
     bool shutdown;
 };
@@ -44,42 +57,75 @@ struct priv {
 static int preinit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
-    vc->enc = encoder_context_alloc(vo->encode_lavc_ctx, STREAM_VIDEO, vo->log);
-    if (!vc->enc)
-        return -1;
-    talloc_steal(vc, vc->enc);
+    struct encode_lavc_context *ctx = vo->encode_lavc_ctx;
+
+    for (int n = 0; n < (ctx ? 1 + ctx->num_extra : 1); n++) {
+        struct encode_lavc_context *octx = n ? ctx->extra[n - 1] : ctx;
+        struct output out = {
+            .vo = vo,
+            .enc = encoder_context_alloc(octx, STREAM_VIDEO, vo->log),
+            .scale_w = octx ? octx->scale_w : 0,
+            .scale_h = octx ? octx->scale_h : 0,
+        };
+        if (!out.enc)
+            return -1;
+        talloc_steal(vc, out.enc);
+        MP_TARRAY_APPEND(vc, vc->outputs, vc->num_outputs, out);
+    }
     return 0;
 }
 
 static void uninit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
-    struct encoder_context *enc = vc->enc;
 
-    if (!vc->shutdown)
-        encoder_encode(enc, NULL); // finish encoding
+    if (!vc->shutdown) {
+        for (int n = 0; n < vc->num_outputs; n++)
+            encoder_encode(vc->outputs[n].enc, NULL); // finish encoding
+    }
 }
 
 static void on_ready(void *ptr)
 {
-    struct vo *vo = ptr;
+    struct output *out = ptr;
+    struct vo *vo = out->vo;
+    struct priv *vc = vo->priv;
 
-    vo_event(vo, VO_EVENT_INITIAL_UNBLOCK);
+    // Each output's muxer is initialized separately, and frames must not be
+    // sent before all of them are.
+    if (atomic_fetch_add(&vc->num_ready, 1) + 1 == vc->num_outputs)
+        vo_event(vo, VO_EVENT_INITIAL_UNBLOCK);
 }
 
-static int reconfig2(struct vo *vo, struct mp_image *img)
+// Return the size of the encoded video for the given input size.
+static void get_output_size(struct output *out, struct mp_image_params *params,
+                            int *w, int *h)
 {
-    struct priv *vc = vo->priv;
-    AVCodecContext *encoder = vc->enc->encoder;
+    *w = params->w;
+    *h = params->h;
+    if (out->scale_w > 0 && out->scale_h > 0) {
+        *w = out->scale_w;
+        *h = out->scale_h;
+    } else if (out->scale_w > 0) {
+        // Keep the display aspect ratio, rounded to an even size for the
+        // benefit of subsampled formats.
+        *w = out->scale_w;
+        *h = MPMAX(lrint((double)*w * params->h / params->w / 2) * 2, 2);
+    } else if (out->scale_h > 0) {
+        *h = out->scale_h;
+        *w = MPMAX(lrint((double)*h * params->w / params->h / 2) * 2, 2);
+    }
+}
+
+static bool reconfig_output(struct vo *vo, struct output *out,
+                            struct mp_image_params *params)
+{
+    AVCodecContext *encoder = out->enc->encoder;
 
-    struct mp_image_params *params = &img->params;
     enum AVPixelFormat pix_fmt = imgfmt2pixfmt(params->imgfmt);
     AVRational aspect = {params->p_w, params->p_h};
-    int width = params->w;
-    int height = params->h;
-
-    if (vc->shutdown)
-        return -1;
+    int width, height;
+    get_output_size(out, params, &width, &height);
 
     if (avcodec_is_open(encoder)) {
         if (width == encoder->width && height == encoder->height &&
@@ -87,12 +133,12 @@ static int reconfig2(struct vo *vo, struct mp_image *img)
         {
             // consider these changes not critical
             MP_ERR(vo, "Ignoring mid-stream parameter changes!\n");
-            return 0;
+            return true;
         }
 
         /* FIXME Is it possible with raw video? */
         MP_ERR(vo, "resolution changes not supported.\n");
-        goto error;
+        return false;
     }
 
     // When we get here, this must be the first call to reconfigure(). Thus, we
@@ -106,7 +152,17 @@ static int reconfig2(struct vo *vo, struct mp_image *img)
     if (pix_fmt == AV_PIX_FMT_NONE) {
         MP_FATAL(vo, "Format %s not supported by lavc.\n",
                  mp_imgfmt_to_name(params->imgfmt));
-        goto error;
+        return false;
+    }
+
+    if (width != params->w || height != params->h) {
+        // Scaling changes the pixel aspect, but not the display aspect.
+        aspect = av_mul_q(aspect, (AVRational){params->w * height,
+                                               params->h * width});
+        out->sws = mp_sws_alloc(vo);
+        mp_sws_enable_cmdline_opts(out->sws, vo->global);
+        MP_INFO(vo, "Scaling %dx%d to %dx%d for %s.\n", params->w, params->h,
+                width, height, out->enc->options->file);
     }
 
     encoder->sample_aspect_ratio = aspect;
@@ -134,8 +190,20 @@ static int reconfig2(struct vo *vo, struct mp_image *img)
 
     encoder->time_base = av_inv_q(tb);
 
-    if (!encoder_init_codec_and_muxer(vc->enc, on_ready, vo))
-        goto error;
+    return encoder_init_codec_and_muxer(out->enc, on_ready, out);
+}
+
+static int reconfig2(struct vo *vo, struct mp_image *img)
+{
+    struct priv *vc = vo->priv;
+
+    if (vc->shutdown)
+        return -1;
+
+    for (int n = 0; n < vc->num_outputs; n++) {
+        if (!reconfig_output(vo, &vc->outputs[n], &img->params))
+            goto error;
+    }
 
     return 0;
 
@@ -149,24 +217,58 @@ static int query_format(struct vo *vo, int format)
     struct priv *vc = vo->priv;
 
     enum AVPixelFormat pix_fmt = imgfmt2pixfmt(format);
-    const enum AVPixelFormat *p = vc->enc->encoder->codec->pix_fmts;
 
-    if (!p)
-        return 1;
+    // All outputs get the same format (scaling doesn't convert it).
+    for (int n = 0; n < vc->num_outputs; n++) {
+        const enum AVPixelFormat *p = vc->outputs[n].enc->encoder->codec->pix_fmts;
+        if (!p)
+            continue;
 
-    while (*p != AV_PIX_FMT_NONE) {
-        if (*p == pix_fmt)
-            return 1;
-        p++;
+        while (*p != AV_PIX_FMT_NONE && *p != pix_fmt)
+            p++;
+        if (*p == AV_PIX_FMT_NONE)
+            return 0;
     }
 
-    return 0;
+    return 1;
+}
+
+static void encode_output(struct output *out, struct mp_image *mpi,
+                          double outpts)
+{
+    AVCodecContext *avc = out->enc->encoder;
+    struct mp_image *img = mpi;
+
+    if (out->sws) {
+        img = mp_image_alloc(mpi->imgfmt, avc->width, avc->height);
+        MP_HANDLE_OOM(img);
+        mp_image_copy_attributes(img, mpi);
+        img->params.p_w = avc->sample_aspect_ratio.num;
+        img->params.p_h = avc->sample_aspect_ratio.den;
+        if (mp_sws_scale(out->sws, img, mpi) < 0) {
+            MP_ERR(out->vo, "Scaling failed for %s.\n", out->enc->options->file);
+            talloc_free(img);
+            return;
+        }
+    }
+
+    AVFrame *frame = mp_image_to_av_frame(img);
+    if (!frame)
+        abort();
+    if (img != mpi)
+        talloc_free(img);
+
+    frame->pts = rint(outpts * av_q2d(av_inv_q(avc->time_base)));
+    frame->pict_type = 0; // keep this at unknown/undefined
+    frame->quality = avc->global_quality;
+    encoder_encode(out->enc, frame);
+    av_frame_free(&frame);
 }
 
 static void draw_frame(struct vo *vo, struct vo_frame *voframe)
 {
     struct priv *vc = vo->priv;
-    struct encoder_context *enc = vc->enc;
+    struct encoder_context *enc = vc->outputs[0].enc;
     struct encode_lavc_context *ectx = enc->encode_lavc_ctx;
     AVCodecContext *avc = enc->encoder;
 
@@ -216,15 +318,10 @@ static void draw_frame(struct vo *vo, struct vo_frame *voframe)
 
     pthread_mutex_unlock(&ectx->lock);
 
-    AVFrame *frame = mp_image_to_av_frame(mpi);
-    if (!frame)
-        abort();
-
-    frame->pts = rint(outpts * av_q2d(av_inv_q(avc->time_base)));
-    frame->pict_type = 0; // keep this at unknown/undefined
-    frame->quality = avc->global_quality;
-    encoder_encode(enc, frame);
-    av_frame_free(&frame);
+    // The frame is decoded, filtered and has OSD rendered once, and then
+    // encoded by every output.
+    for (int n = 0; n < vc->num_outputs; n++)
+        encode_output(&vc->outputs[n], mpi, outpts);
 }
 
 static void flip_page(struct vo *vo)
@@ -21,6 +21,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -28,6 +29,7 @@
 #include <sixel.h>
 
 #include "config.h"
+#include "misc/thread_pool.h"
 #include "options/m_config.h"
 #include "osdep/terminal.h"
 #include "sub/osd.h"
@@ -48,6 +50,18 @@
 #define ESC_GOTOXY                  "\033[%d;%df"
 #define ESC_USE_GLOBAL_COLOR_REG    "\033[?1070l"
 
+// A frame ready to be written to the terminal.
+struct sixel_job {
+    uint8_t        *buffer;
+    sixel_dither_t *dither;     // referenced
+    int width, height;
+    int top, left;
+    int cell_height;            // px height of a terminal cell row
+    bool partial;               // if true, write only the bands below
+    struct mp_rect *bands;      // only x0/x1 = 0, y0/y1 = pixel rows
+    int num_bands;
+};
+
 struct priv {
 
     // User specified options
@@ -64,6 +78,8 @@ struct priv {
     int opt_rows;
     int opt_cols;
     int opt_clear;
+    int opt_threaded;
+    int opt_partial;
 
     // Internal data
     sixel_output_t *output;
@@ -78,6 +94,19 @@ struct priv {
     int canvas_ok;  // whether canvas vo->dwidth and vo->dheight are positive
 
     int previous_histgram_colors;
+    int cell_height;  // px height of a terminal cell row, 0 if unknown
+
+    // The last frame passed to the encoder. job.buffer and buffer are swapped
+    // on every submitted frame, so job.buffer also serves as reference for
+    // partial updates.
+    struct sixel_job job;
+    bool job_valid;         // job.buffer contains the last written frame
+
+    // If opt_threaded is set, jobs are encoded on this thread.
+    struct mp_thread_pool *encoder;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool job_busy;          // job is being encoded by the encoder thread
 
     struct mp_rect src_rect;
     struct mp_rect dst_rect;
@@ -115,10 +144,71 @@ static int detect_scene_change(struct vo* vo)
 
 }
 
+static void encode_job(struct priv *priv, struct sixel_job *job)
+{
+    if (job->partial) {
+        for (int n = 0; n < job->num_bands; n++) {
+            struct mp_rect *band = &job->bands[n];
+            printf(ESC_GOTOXY, job->top + band->y0 / job->cell_height,
+                   job->left);
+            sixel_encode(job->buffer + band->y0 * job->width * depth,
+                         job->width, band->y1 - band->y0, depth,
+                         job->dither, priv->output);
+        }
+    } else {
+        // Go to the offset row and column, then display the image
+        printf(ESC_GOTOXY, job->top, job->left);
+        sixel_encode(job->buffer, job->width, job->height,
+                     depth, job->dither, priv->output);
+    }
+    fflush(stdout);
+}
+
+static void encode_worker(void *ctx)
+{
+    struct priv *priv = ctx;
+
+    encode_job(priv, &priv->job);
+
+    pthread_mutex_lock(&priv->lock);
+    priv->job_busy = false;
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+}
+
+// Wait until the encoder thread is done with the current job. Must be called
+// before touching the terminal, priv->job, or reallocating the buffers.
+static void wait_encoder(struct vo *vo)
+{
+    struct priv *priv = vo->priv;
+
+    if (!priv->encoder)
+        return;
+
+    pthread_mutex_lock(&priv->lock);
+    while (priv->job_busy)
+        pthread_cond_wait(&priv->wakeup, &priv->lock);
+    pthread_mutex_unlock(&priv->lock);
+}
+
 static void dealloc_dithers_and_buffers(struct vo* vo)
 {
     struct priv* priv = vo->priv;
 
+    wait_encoder(vo);
+
+    if (priv->job.buffer) {
+        talloc_free(priv->job.buffer);
+        priv->job.buffer = NULL;
+    }
+
+    if (priv->job.dither) {
+        sixel_dither_unref(priv->job.dither);
+        priv->job.dither = NULL;
+    }
+
+    priv->job_valid = false;
+
     if (priv->buffer) {
         talloc_free(priv->buffer);
         priv->buffer = NULL;
@@ -150,9 +240,9 @@ static SIXELSTATUS prepare_static_palette(struct vo* vo)
             return SIXEL_FALSE;
 
         sixel_dither_set_diffusion_type(priv->dither, priv->opt_diffuse);
+        sixel_dither_set_body_only(priv->dither, 0);
     }
 
-    sixel_dither_set_body_only(priv->dither, 0);
     return SIXEL_OK;
 }
 
@@ -184,12 +274,12 @@ static SIXELSTATUS prepare_dynamic_palette(struct vo *vo)
             return status;
 
         sixel_dither_set_diffusion_type(priv->dither, priv->opt_diffuse);
+        sixel_dither_set_body_only(priv->dither, 0);
     } else {
         if (priv->dither == NULL)
             return SIXEL_FALSE;
     }
 
-    sixel_dither_set_body_only(priv->dither, 0);
     return status;
 }
 
@@ -258,6 +348,7 @@ static void update_canvas_dimensions(struct vo *vo)
 
     priv->num_rows = num_rows;
     priv->num_cols = num_cols;
+    priv->cell_height = num_rows > 0 ? total_px_height / num_rows : 0;
 
     priv->canvas_ok = vo->dwidth > 0 && vo->dheight > 0;
 }
@@ -322,6 +413,8 @@ static int update_sixel_swscaler(struct vo *vo, struct mp_image_params *params)
 
     priv->buffer =
         talloc_array(NULL, uint8_t, depth * priv->width * priv->height);
+    priv->job.buffer =
+        talloc_array(NULL, uint8_t, depth * priv->width * priv->height);
 
     return 0;
 }
@@ -330,6 +423,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *priv = vo->priv;
     int ret = 0;
+    wait_encoder(vo);
     update_canvas_dimensions(vo);
     if (priv->canvas_ok) {  // if too small - succeed but skip the rendering
         set_sixel_output_parameters(vo);
@@ -360,6 +454,11 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
     if (prev_rows != priv->num_rows || prev_cols != priv->num_cols ||
         prev_width != vo->dwidth || prev_height != vo->dheight)
     {
+        // The encoder thread may still be writing the previous frame with the
+        // old buffers. Everything else below only touches priv->buffer and
+        // priv->frame, which are not used by the encoder, so scaling and
+        // palette preparation overlap with encoding.
+        wait_encoder(vo);
         set_sixel_output_parameters(vo);
         // Not checking for vo->config_ok because draw_frame is never called
         // with a failed reconfig.
@@ -427,6 +526,46 @@ static int sixel_write(char *data, int size, void *priv)
     return fwrite(data, 1, size, (FILE *)priv);
 }
 
+// Compare priv->buffer against the last written frame, and set the bands of
+// rows that need to be redrawn. Returns false if a full redraw is better.
+static bool find_changed_bands(struct priv *priv)
+{
+    struct sixel_job *job = &priv->job;
+    int stride = priv->width * depth;
+
+    if (!priv->opt_partial || !priv->job_valid || job->dither != priv->dither ||
+        priv->cell_height <= 0)
+        return false;
+
+    // Bands must start on a cell row (the cursor can only be placed there),
+    // and consist of whole sixel rows (6 px), so that band edges aren't
+    // encoded as partial sixel rows.
+    int unit = priv->cell_height;
+    while (unit % 6)
+        unit += priv->cell_height;
+
+    job->num_bands = 0;
+    int changed = 0;
+    for (int y = 0; y < priv->height; y += unit) {
+        int h = MPMIN(unit, priv->height - y);
+        if (memcmp(priv->buffer + y * stride, job->buffer + y * stride,
+                   h * stride) == 0)
+            continue;
+        struct mp_rect *last =
+            job->num_bands ? &job->bands[job->num_bands - 1] : NULL;
+        if (last && last->y1 == y) {
+            last->y1 = y + h;
+        } else {
+            struct mp_rect band = {.y0 = y, .y1 = y + h};
+            MP_TARRAY_APPEND(priv, job->bands, job->num_bands, band);
+        }
+        changed += h;
+    }
+
+    // Encoding the whole frame at once is cheaper if most of it changed.
+    return changed < priv->height * 3 / 4;
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv* priv = vo->priv;
@@ -441,11 +580,37 @@ static void flip_page(struct vo *vo)
     if (priv->buffer == NULL || priv->dither == NULL)
         return;
 
-    // Go to the offset row and column, then display the image
-    printf(ESC_GOTOXY, priv->top, priv->left);
-    sixel_encode(priv->buffer, priv->width, priv->height,
-                 depth, priv->dither, priv->output);
-    fflush(stdout);
+    // Wait for the previous frame; in threaded mode, the current frame was
+    // prepared by draw_frame() while the previous one was being encoded.
+    wait_encoder(vo);
+
+    struct sixel_job *job = &priv->job;
+    job->partial = find_changed_bands(priv);
+    if (job->partial && !job->num_bands)
+        return; // nothing changed
+
+    MPSWAP(uint8_t *, job->buffer, priv->buffer);
+    if (job->dither != priv->dither) {
+        if (job->dither)
+            sixel_dither_unref(job->dither);
+        job->dither = priv->dither;
+        sixel_dither_ref(job->dither);
+    }
+    job->width = priv->width;
+    job->height = priv->height;
+    job->top = priv->top;
+    job->left = priv->left;
+    job->cell_height = priv->cell_height;
+    priv->job_valid = true;
+
+    if (priv->encoder) {
+        pthread_mutex_lock(&priv->lock);
+        priv->job_busy = true;
+        pthread_mutex_unlock(&priv->lock);
+        mp_thread_pool_queue(priv->encoder, encode_worker, priv);
+    } else {
+        encode_job(priv, job);
+    }
 }
 
 static int preinit(struct vo *vo)
@@ -454,6 +619,9 @@ static int preinit(struct vo *vo)
     SIXELSTATUS status = SIXEL_FALSE;
     FILE* sixel_output_file = stdout;
 
+    pthread_mutex_init(&priv->lock, NULL);
+    pthread_cond_init(&priv->wakeup, NULL);
+
     // Parse opts set by CLI or conf
     priv->sws = mp_sws_alloc(vo);
     priv->sws->log = vo->log;
@@ -487,6 +655,12 @@ static int preinit(struct vo *vo)
 
     priv->previous_histgram_colors = 0;
 
+    if (priv->opt_threaded) {
+        priv->encoder = mp_thread_pool_create(priv, 1, 1, 1);
+        if (!priv->encoder)
+            MP_WARN(vo, "preinit: Failed to create encoder thread.\n");
+    }
+
     return 0;
 }
 
@@ -507,6 +681,8 @@ static void uninit(struct vo *vo)
 {
     struct priv *priv = vo->priv;
 
+    wait_encoder(vo);
+
     printf(ESC_RESTORE_CURSOR);
 
     if (priv->opt_clear) {
@@ -521,6 +697,10 @@ static void uninit(struct vo *vo)
     }
 
     dealloc_dithers_and_buffers(vo);
+
+    talloc_free(priv->encoder);
+    pthread_cond_destroy(&priv->wakeup);
+    pthread_mutex_destroy(&priv->lock);
 }
 
 #define OPT_BASE_STRUCT struct priv
@@ -550,6 +730,8 @@ const struct vo_driver video_out_sixel = {
         .opt_rows = 0,
         .opt_cols = 0,
         .opt_clear = 1,
+        .opt_threaded = 0,
+        .opt_partial = 0,
     },
     .options = (const m_option_t[]) {
         {"dither", OPT_CHOICE(opt_diffuse,
@@ -574,6 +756,8 @@ const struct vo_driver video_out_sixel = {
         {"rows", OPT_INT(opt_rows)},
         {"cols", OPT_INT(opt_cols)},
         {"exit-clear", OPT_FLAG(opt_clear), },
+        {"threaded", OPT_FLAG(opt_threaded)},
+        {"partial-update", OPT_FLAG(opt_partial)},
         {0}
     },
     .options_prefix = "vo-sixel",
@@ -25,6 +25,7 @@
 
 #include <libswscale/swscale.h>
 
+#include "common/stats.h"
 #include "options/m_config.h"
 #include "config.h"
 #include "osdep/terminal.h"
@@ -42,6 +43,7 @@
 #define ESC_CLEAR_SCREEN "\033[2J"
 #define ESC_CLEAR_COLORS "\033[0m"
 #define ESC_GOTOXY "\033[%d;%df"
+#define ESC_CURSOR_FORWARD "\033[%dC"
 #define ESC_COLOR_BG "\033[48;2;%d;%d;%dm"
 #define ESC_COLOR_FG "\033[38;2;%d;%d;%dm"
 #define ESC_COLOR256_BG "\033[48;5;%dm"
@@ -54,6 +56,7 @@ struct vo_tct_opts {
     int width;   // 0 -> default
     int height;  // 0 -> default
     int term256;  // 0 -> true color
+    int diff;
 };
 
 #define OPT_BASE_STRUCT struct vo_tct_opts
@@ -65,6 +68,7 @@ static const struct m_sub_options vo_tct_conf = {
         {"vo-tct-width", OPT_INT(width)},
         {"vo-tct-height", OPT_INT(height)},
         {"vo-tct-256", OPT_FLAG(term256)},
+        {"vo-tct-diff", OPT_FLAG(diff)},
         {0}
     },
     .defaults = &(const struct vo_tct_opts) {
@@ -82,97 +86,131 @@ struct priv {
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_sws_context *sws;
+    struct stats_ctx *stats;
+
+    // Colors of the last written frame, 2 per cell (bg, fg).
+    uint32_t *cells;
+    bool cells_valid;
+
+    bstr out; // escape sequences for the current frame
+
+    uint8_t lut_ci[256];    // channel value => 0..5 color cube index
+    uint16_t lut_err[256];  // squared error of that mapping
 };
 
+// Precompute the per-channel parts of the xterm-256 conversion.
+#define v2ci(v) (v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40)
+static void init_x256_lut(struct priv *p)
+{
+    static const int i2cv[6] = {0, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
+    for (int v = 0; v < 256; v++) {
+        int ci = v2ci(v);
+        p->lut_ci[v] = ci;
+        p->lut_err[v] = (i2cv[ci] - v) * (i2cv[ci] - v);
+    }
+}
+
 // Convert RGB24 to xterm-256 8-bit value
 // For simplicity, assume RGB space is perceptually uniform.
 // There are 5 places where one of two outputs needs to be chosen when the
 // input is the exact middle:
 // - The r/g/b channels and the gray value: the higher value output is chosen.
 // - If the gray and color have same distance from the input - color is chosen.
-static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
+static int rgb_to_x256(struct priv *p, uint8_t r, uint8_t g, uint8_t b)
 {
-    // Calculate the nearest 0-based color index at 16 .. 231
-#   define v2ci(v) (v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40)
-    int ir = v2ci(r), ig = v2ci(g), ib = v2ci(b);   // 0..5 each
-#   define color_index() (36 * ir + 6 * ig + ib)  /* 0..215, lazy evaluation */
+    // Nearest 0-based color index at 16 .. 231 (0..5 each)
+    int ir = p->lut_ci[r], ig = p->lut_ci[g], ib = p->lut_ci[b];
 
     // Calculate the nearest 0-based gray index at 232 .. 255
     int average = (r + g + b) / 3;
     int gray_index = average > 238 ? 23 : (average - 3) / 10;  // 0..23
-
-    // Calculate the represented colors back from the index
-    static const int i2cv[6] = {0, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
-    int cr = i2cv[ir], cg = i2cv[ig], cb = i2cv[ib];  // r/g/b, 0..255 each
     int gv = 8 + 10 * gray_index;  // same value for r/g/b, 0..255
 
     // Return the one which is nearer to the original input rgb value
-#   define dist_square(A,B,C, a,b,c) ((A-a)*(A-a) + (B-b)*(B-b) + (C-c)*(C-c))
-    int color_err = dist_square(cr, cg, cb, r, g, b);
-    int gray_err  = dist_square(gv, gv, gv, r, g, b);
-    return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
+    int color_err = p->lut_err[r] + p->lut_err[g] + p->lut_err[b];
+    int gray_err = (gv - r) * (gv - r) + (gv - g) * (gv - g) + (gv - b) * (gv - b);
+    return color_err <= gray_err ? 16 + 36 * ir + 6 * ig + ib : 232 + gray_index;
 }
 
-static void write_plain(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256)
+static uint32_t pixel_color(struct priv *p, const unsigned char *px)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        printf(ESC_GOTOXY, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                printf(ESC_COLOR_BG, r, g, b);
-            }
-            printf(" ");
-        }
-        printf(ESC_CLEAR_COLORS);
+    // source is BGR24
+    if (p->opts->term256)
+        return rgb_to_x256(p, px[2], px[1], px[0]);
+    return (px[2] << 16) | (px[1] << 8) | px[0];
+}
+
+static void append_color(struct priv *p, bool bg, uint32_t c)
+{
+    if (p->opts->term256) {
+        bstr_xappend_asprintf(p, &p->out, bg ? ESC_COLOR256_BG : ESC_COLOR256_FG,
+                              (int)c);
+    } else {
+        bstr_xappend_asprintf(p, &p->out, bg ? ESC_COLOR_BG : ESC_COLOR_FG,
+                              (int)(c >> 16), (int)((c >> 8) & 0xFF),
+                              (int)(c & 0xFF));
     }
-    printf("\n");
 }
 
-static void write_half_blocks(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256)
+// Render the frame into p->out. If p->cells contains the previous frame, only
+// changed cells are written, and the cursor is moved over unchanged ones.
+static void write_frame(struct vo *vo, const unsigned char *source,
+                        int source_stride)
 {
+    struct priv *p = vo->priv;
     assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        printf(ESC_GOTOXY, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                printf(ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
+    const bool half_blocks = p->opts->algo == ALGO_HALF_BLOCKS;
+    const bool diff = p->opts->diff && p->cells_valid;
+    const int tx = (vo->dwidth - p->swidth) / 2;
+    const int ty = (vo->dheight - p->sheight) / 2;
+
+    // Colors which are currently set on the terminal, if known.
+    bool have_bg = false, have_fg = false;
+    uint32_t cur_bg = 0, cur_fg = 0;
+
+    const int mul = half_blocks ? 2 : 1;
+    for (int y = 0; y < p->sheight; y++) {
+        const unsigned char *row_up = source + y * mul * source_stride;
+        const unsigned char *row_down = row_up + source_stride;
+        uint32_t *cells = p->cells + y * p->swidth * 2;
+        int next_x = -1; // cursor position within the row, -1 if unknown
+
+        for (int x = 0; x < p->swidth; x++) {
+            uint32_t bg = pixel_color(p, row_up + x * 3);
+            uint32_t fg = half_blocks ? pixel_color(p, row_down + x * 3) : 0;
+            if (diff && cells[x * 2 + 0] == bg && cells[x * 2 + 1] == fg)
+                continue;
+            cells[x * 2 + 0] = bg;
+            cells[x * 2 + 1] = fg;
+
+            if (next_x < 0) {
+                bstr_xappend_asprintf(p, &p->out, ESC_GOTOXY, ty + y, tx + x);
+            } else if (next_x != x) {
+                bstr_xappend_asprintf(p, &p->out, ESC_CURSOR_FORWARD,
+                                      x - next_x);
+            }
+            if (!have_bg || cur_bg != bg)
+                append_color(p, true, bg);
+            have_bg = true;
+            cur_bg = bg;
+            if (half_blocks) {
+                if (!have_fg || cur_fg != fg)
+                    append_color(p, false, fg);
+                have_fg = true;
+                cur_fg = fg;
+                // UTF8 bytes of U+2584 (lower half block)
+                bstr_xappend(p, &p->out, bstr0("\xe2\x96\x84"));
             } else {
-                printf(ESC_COLOR_BG, r_up, g_up, b_up);
-                printf(ESC_COLOR_FG, r_down, g_down, b_down);
+                bstr_xappend(p, &p->out, bstr0(" "));
             }
-            printf("\xe2\x96\x84");  // UTF8 bytes of U+2584 (lower half block)
+            next_x = x + 1;
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
+    bstr_xappend(p, &p->out, bstr0(ESC_CLEAR_COLORS));
+    // The cursor position is not restored in diff mode, so don't scroll.
+    if (!p->opts->diff)
+        bstr_xappend(p, &p->out, bstr0("\n"));
+    p->cells_valid = true;
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -218,6 +256,10 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     if (mp_sws_reinit(p->sws) < 0)
         return -1;
 
+    talloc_free(p->cells);
+    p->cells = talloc_zero_array(p, uint32_t, p->swidth * p->sheight * 2);
+    p->cells_valid = false;
+
     printf(ESC_HIDE_CURSOR);
     printf(ESC_CLEAR_SCREEN);
     vo->want_redraw = true;
@@ -236,18 +278,12 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->opts->algo == ALGO_PLAIN) {
-        write_plain(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    } else {
-        write_half_blocks(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    }
+    p->out.len = 0;
+    write_frame(vo, p->frame->planes[0], p->frame->stride[0]);
+    // Write everything at once, instead of many small terminal writes.
+    fwrite(p->out.start, p->out.len, 1, stdout);
     fflush(stdout);
+    stats_size_value(p->stats, "frame-bytes", p->out.len);
 }
 
 static void uninit(struct vo *vo)
@@ -271,6 +307,8 @@ static int preinit(struct vo *vo)
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
+    p->stats = stats_ctx_create(p, vo->global, "vo-tct");
+    init_x256_lut(p);
     return 0;
 }
 
@@ -16,6 +16,8 @@
  */
 
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
@@ -35,6 +37,7 @@
 #include "csputils.h"
 #include "common/msg.h"
 #include "osdep/endian.h"
+#include "osdep/timer.h"
 
 #if HAVE_ZIMG
 #include "zimg.h"
@@ -52,6 +55,7 @@ struct sws_opts {
     int fast;
     int bitexact;
     int zimg;
+    int benchmark;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -78,6 +82,7 @@ const struct m_sub_options sws_conf = {
         {"fast", OPT_FLAG(fast)},
         {"bitexact", OPT_FLAG(bitexact)},
         {"allow-zimg", OPT_FLAG(zimg)},
+        {"benchmark", OPT_FLAG(benchmark)},
         {0}
     },
     .size = sizeof(struct sws_opts),
@@ -114,6 +119,7 @@ static void mp_sws_update_from_cmdline(struct mp_sws_context *ctx)
         ctx->flags |= SWS_BITEXACT;
 
     ctx->allow_zimg = opts->zimg;
+    ctx->benchmark = opts->benchmark;
 }
 
 bool mp_sws_supported_format(int imgfmt)
@@ -167,6 +173,7 @@ static bool cache_valid(struct mp_sws_context *ctx)
            mp_image_params_equal(&ctx->dst, &old->dst) &&
            ctx->flags == old->flags &&
            ctx->allow_zimg == old->allow_zimg &&
+           ctx->benchmark == old->benchmark &&
            ctx->force_scaler == old->force_scaler &&
            (!ctx->opts_cache || !m_config_cache_update(ctx->opts_cache));
 }
@@ -220,46 +227,11 @@ void mp_sws_enable_cmdline_opts(struct mp_sws_context *ctx, struct mpv_global *g
 #endif
 }
 
-// Reinitialize (if needed) - return error code.
-// Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
-int mp_sws_reinit(struct mp_sws_context *ctx)
+static int init_sws(struct mp_sws_context *ctx)
 {
     struct mp_image_params src = ctx->src;
     struct mp_image_params dst = ctx->dst;
 
-    if (cache_valid(ctx))
-        return 0;
-
-    if (ctx->opts_cache)
-        mp_sws_update_from_cmdline(ctx);
-
-    sws_freeContext(ctx->sws);
-    ctx->sws = NULL;
-    ctx->zimg_ok = false;
-    TA_FREEP(&ctx->aligned_src);
-    TA_FREEP(&ctx->aligned_dst);
-
-#if HAVE_ZIMG
-    if (allow_zimg(ctx)) {
-        ctx->zimg->log = ctx->log;
-        ctx->zimg->src = src;
-        ctx->zimg->dst = dst;
-        if (ctx->zimg_opts)
-            ctx->zimg->opts = *ctx->zimg_opts;
-        if (mp_zimg_config(ctx->zimg)) {
-            ctx->zimg_ok = true;
-            MP_VERBOSE(ctx, "Using zimg.\n");
-            goto success;
-        }
-        MP_WARN(ctx, "Not using zimg, falling back to swscale.\n");
-    }
-#endif
-
-    if (!allow_sws(ctx)) {
-        MP_ERR(ctx, "No scaler.\n");
-        return -1;
-    }
-
     ctx->sws = sws_alloc_context();
     if (!ctx->sws)
         return -1;
@@ -323,7 +295,204 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
         return -1;
 
+    return 0;
+}
+
+#if HAVE_ZIMG
+
+// Results of --sws-benchmark, shared by all mp_sws_contexts in the process.
+// The key includes the color parameters, because they decide whether
+// libswscale can do the conversion correctly at all.
+struct bench_entry {
+    struct mp_image_params src, dst;
+    int flags;
+    struct zimg_opts zopts;
+    bool use_zimg;
+    double t_zimg, t_sws; // in seconds
+};
+
+#define MAX_BENCH_ENTRIES 64
+
+static pthread_mutex_t bench_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct bench_entry bench_cache[MAX_BENCH_ENTRIES];
+static int num_bench_cache, next_bench_entry;
+
+static bool zimg_opts_equal(struct zimg_opts *a, struct zimg_opts *b)
+{
+    return a->scaler == b->scaler &&
+           a->scaler_params[0] == b->scaler_params[0] &&
+           a->scaler_params[1] == b->scaler_params[1] &&
+           a->scaler_chroma == b->scaler_chroma &&
+           a->scaler_chroma_params[0] == b->scaler_chroma_params[0] &&
+           a->scaler_chroma_params[1] == b->scaler_chroma_params[1] &&
+           a->dither == b->dither && a->fast == b->fast &&
+           a->threads == b->threads;
+}
+
+static bool bench_entry_matches(struct bench_entry *e, struct mp_sws_context *ctx)
+{
+    return mp_image_params_equal(&e->src, &ctx->src) &&
+           mp_image_params_equal(&e->dst, &ctx->dst) &&
+           e->flags == ctx->flags && zimg_opts_equal(&e->zopts, &ctx->zimg->opts);
+}
+
+// Return the best time of a few runs of one converter, or INFINITY on failure.
+static double bench_run(struct mp_sws_context *ctx, bool zimg,
+                        struct mp_image *dst, struct mp_image *src)
+{
+    double best = INFINITY;
+    for (int n = 0; n < 4; n++) {
+        int64_t t0 = mp_time_us();
+        if (zimg) {
+            if (!mp_zimg_convert(ctx->zimg, dst, src))
+                return INFINITY;
+        } else {
+            sws_scale(ctx->sws, (const uint8_t *const *)src->planes,
+                      src->stride, 0, src->h, dst->planes, dst->stride);
+        }
+        // The first run includes one-time setup (e.g. zimg's graph and
+        // buffers), so it's not counted.
+        if (n > 0)
+            best = MPMIN(best, (mp_time_us() - t0) / 1e6);
+    }
+    return best;
+}
+
+// Called with a successfully configured ctx->zimg. Time zimg and libswscale
+// for the current parameters, or reuse the result of an earlier run. Returns
+// whether zimg should be used; if not, ctx->sws is initialized.
+static bool bench_prefer_zimg(struct mp_sws_context *ctx)
+{
+    struct bench_entry res = {0};
+    bool found = false;
+
+    pthread_mutex_lock(&bench_lock);
+    for (int n = 0; n < num_bench_cache; n++) {
+        if (bench_entry_matches(&bench_cache[n], ctx)) {
+            res = bench_cache[n];
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bench_lock);
+
+    if (!found) {
+        res = (struct bench_entry){
+            .src = ctx->src,
+            .dst = ctx->dst,
+            .flags = ctx->flags,
+            .zopts = ctx->zimg->opts,
+            .use_zimg = true,
+            .t_sws = INFINITY,
+        };
+
+        struct mp_image *src = mp_image_alloc(ctx->src.imgfmt, ctx->src.w,
+                                              ctx->src.h);
+        struct mp_image *dst = mp_image_alloc(ctx->dst.imgfmt, ctx->dst.w,
+                                              ctx->dst.h);
+        if (!src || !dst || init_sws(ctx) < 0 || !ctx->supports_csp) {
+            // Can't compare; zimg is the only valid (or correct) choice.
+            talloc_free(src);
+            talloc_free(dst);
+            sws_freeContext(ctx->sws);
+            ctx->sws = NULL;
+            return true;
+        }
+
+        mp_image_set_params(src, &ctx->src);
+        mp_image_set_params(dst, &ctx->dst);
+        mp_image_clear(src, 0, 0, src->w, src->h);
+
+        res.t_zimg = bench_run(ctx, true, dst, src);
+        res.t_sws = bench_run(ctx, false, dst, src);
+        // zimg is generally more correct, so require a clear advantage.
+        res.use_zimg = res.t_zimg <= res.t_sws * 1.1;
+
+        talloc_free(src);
+        talloc_free(dst);
+
+        pthread_mutex_lock(&bench_lock);
+        bench_cache[next_bench_entry] = res;
+        next_bench_entry = (next_bench_entry + 1) % MAX_BENCH_ENTRIES;
+        num_bench_cache = MPMIN(num_bench_cache + 1, MAX_BENCH_ENTRIES);
+        pthread_mutex_unlock(&bench_lock);
+
+        MP_VERBOSE(ctx, "Benchmark %s %dx%d -> %s %dx%d: zimg %.3f ms, "
+                   "swscale %.3f ms.\n", mp_imgfmt_to_name(res.src.imgfmt),
+                   res.src.w, res.src.h, mp_imgfmt_to_name(res.dst.imgfmt),
+                   res.dst.w, res.dst.h, res.t_zimg * 1e3, res.t_sws * 1e3);
+    } else if (!res.use_zimg) {
+        // libswscale setup also depends on things outside of the key (like
+        // the --sws-* filter options), so check again that it's usable.
+        if (init_sws(ctx) < 0 || !ctx->supports_csp)
+            res.use_zimg = true;
+    }
+
+    snprintf(ctx->method, sizeof(ctx->method), "%s (zimg %.3f ms, "
+             "swscale %.3f ms)", res.use_zimg ? "zimg" : "swscale",
+             res.t_zimg * 1e3, res.t_sws * 1e3);
+
+    if (res.use_zimg) {
+        sws_freeContext(ctx->sws);
+        ctx->sws = NULL;
+    }
+    return res.use_zimg;
+}
+
+#endif
+
+// Reinitialize (if needed) - return error code.
+// Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
+int mp_sws_reinit(struct mp_sws_context *ctx)
+{
+    if (cache_valid(ctx))
+        return 0;
+
+    if (ctx->opts_cache)
+        mp_sws_update_from_cmdline(ctx);
+
+    sws_freeContext(ctx->sws);
+    ctx->sws = NULL;
+    ctx->zimg_ok = false;
+    ctx->method[0] = '\0';
+    TA_FREEP(&ctx->aligned_src);
+    TA_FREEP(&ctx->aligned_dst);
+
+#if HAVE_ZIMG
+    if (allow_zimg(ctx)) {
+        ctx->zimg->log = ctx->log;
+        ctx->zimg->src = ctx->src;
+        ctx->zimg->dst = ctx->dst;
+        if (ctx->zimg_opts)
+            ctx->zimg->opts = *ctx->zimg_opts;
+        if (mp_zimg_config(ctx->zimg)) {
+            if (ctx->force_scaler != MP_SWS_AUTO || !ctx->benchmark ||
+                bench_prefer_zimg(ctx))
+            {
+                ctx->zimg_ok = true;
+                MP_VERBOSE(ctx, "Using zimg.\n");
+                goto success;
+            }
+            MP_VERBOSE(ctx, "Using swscale, as it was faster.\n");
+            goto success; // initialized by the benchmark
+        } else {
+            MP_WARN(ctx, "Not using zimg, falling back to swscale.\n");
+        }
+    }
+#endif
+
+    if (!allow_sws(ctx)) {
+        MP_ERR(ctx, "No scaler.\n");
+        return -1;
+    }
+
+    if (init_sws(ctx) < 0)
+        return -1;
+
 success:
+    if (!ctx->method[0])
+        snprintf(ctx->method, sizeof(ctx->method), "%s",
+                 ctx->zimg_ok ? "zimg" : "swscale");
     ctx->force_reload = false;
     *ctx->cached = *ctx;
     return 1;
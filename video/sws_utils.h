@@ -36,6 +36,7 @@ struct mp_sws_context {
     // mp_sws_scale() will handle the changes transparently.
     int flags;
     bool allow_zimg; // use zimg if available (ignores filters and all)
+    bool benchmark; // choose between zimg and sws by measuring both
     bool force_reload;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
@@ -64,6 +65,7 @@ struct mp_sws_context {
     struct mp_zimg_context *zimg;
     bool zimg_ok;
     struct mp_image *aligned_src, *aligned_dst;
+    char method[80]; // description of the converter in use (for debugging)
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
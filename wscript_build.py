@@ -230,6 +230,7 @@ def build(ctx):
         ( "audio/filter/af_scaletempo2_internals.c" ),
         ( "audio/fmt-conversion.c" ),
         ( "audio/format.c" ),
+        ( "audio/loudness.c" ),
         ( "audio/out/ao.c" ),
         ( "audio/out/ao_alsa.c",                 "alsa" ),
         ( "audio/out/ao_audiotrack.c",           "android" ),
@@ -319,6 +320,7 @@ def build(ctx):
         ( "misc/natural_sort.c" ),
         ( "misc/node.c" ),
         ( "misc/rendezvous.c" ),
+        ( "misc/ring.c" ),
         ( "misc/thread_pool.c" ),
         ( "misc/thread_tools.c" ),
 
@@ -337,6 +339,7 @@ def build(ctx):
         ( "player/client.c" ),
         ( "player/command.c" ),
         ( "player/configfiles.c" ),
+        ( "player/encode_chunks.c" ),
         ( "player/external_files.c" ),
         ( "player/javascript.c",                 "javascript" ),
         ( "player/loadfile.c" ),
@@ -345,6 +348,7 @@ def build(ctx):
         ( "player/misc.c" ),
         ( "player/osd.c" ),
         ( "player/playloop.c" ),
+        ( "player/replaygain_scan.c" ),
         ( "player/screenshot.c" ),
         ( "player/scripting.c" ),
         ( "player/sub.c" ),
@@ -384,15 +388,22 @@ def build(ctx):
         ( "sub/sd_lavc.c" ),
 
         ## Tests
+        ( "test/aframe_pool.c",                  "tests" ),
+        ( "test/ao_kernels.c",                   "tests" ),
         ( "test/chmap.c",                        "tests" ),
+        ( "test/dither.c",                       "tests" ),
         ( "test/gl_video.c",                     "tests" ),
         ( "test/img_format.c",                   "tests" ),
         ( "test/json.c",                         "tests" ),
+        ( "test/lavfi.c",                        "tests" ),
         ( "test/linked_list.c",                  "tests" ),
+        ( "test/loudness.c",                     "tests" ),
         ( "test/paths.c",                        "tests" ),
         ( "test/repack.c",                       "tests && zimg" ),
+        ( "test/ring.c",                         "tests" ),
         ( "test/scale_sws.c",                    "tests" ),
         ( "test/scale_test.c",                   "tests" ),
+        ( "test/scaletempo.c",                   "tests" ),
         ( "test/scale_zimg.c",                   "tests && zimg" ),
         ( "test/tests.c",                        "tests" ),
 